@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include "impl/config_json_reader.hpp"
+#include "impl/managed_shmem.hpp"
 
 #include <stdexcept>
 
@@ -219,6 +220,78 @@ size_t ConfigReader::getSHMSize(const std::string& sensorNamespace,
     }
 }
 
+NamespaceOptions
+    ConfigReader::getNamespaceOptions(const std::string& sensorNamespace)
+{
+    if (shmMappingJson == nullptr)
+    {
+        string errorMessage = "SHMEMDEBUG: Json file is not loaded";
+        LOG_ERROR(errorMessage);
+        throw runtime_error("Json file is not loaded");
+    }
+    NamespaceOptions options;
+    if (!shmMappingJson->contains("Namespaces") ||
+        !(*shmMappingJson)["Namespaces"].contains(sensorNamespace))
+    {
+        return options;
+    }
+    const auto& namespaceEntry =
+        (*shmMappingJson)["Namespaces"][sensorNamespace];
+    if (namespaceEntry.contains("PublishMode"))
+    {
+        const auto& publishMode = namespaceEntry["PublishMode"];
+        if (publishMode == "Snapshot")
+        {
+            options.publishMode = PublishMode::snapshot;
+        }
+        else if (publishMode != "Live")
+        {
+            string errorMessage = "SHMEMDEBUG: Namespace " + sensorNamespace +
+                                  " has unknown PublishMode";
+            LOG_ERROR(errorMessage);
+            throw runtime_error("Unknown PublishMode");
+        }
+    }
+    if (namespaceEntry.contains("WarmRestart"))
+    {
+        options.warmRestart = namespaceEntry["WarmRestart"].get<bool>();
+    }
+    if (namespaceEntry.contains("MaxEntries"))
+    {
+        options.maxEntries = namespaceEntry["MaxEntries"].get<size_t>();
+    }
+    if (namespaceEntry.contains("MaxSizeInBytes"))
+    {
+        options.maxSizeInBytes =
+            namespaceEntry["MaxSizeInBytes"].get<size_t>();
+    }
+    if (namespaceEntry.contains("HistorySamples"))
+    {
+        options.historySamples =
+            namespaceEntry["HistorySamples"].get<uint32_t>();
+    }
+    if (namespaceEntry.contains("JournalRecords"))
+    {
+        options.journalRecords =
+            namespaceEntry["JournalRecords"].get<uint32_t>();
+    }
+    if (namespaceEntry.contains("AggregationWindowSeconds"))
+    {
+        options.aggregationWindowSeconds =
+            namespaceEntry["AggregationWindowSeconds"].get<uint32_t>();
+    }
+    if (namespaceEntry.contains("MetricPropertyIndex"))
+    {
+        options.indexMetricProperty =
+            namespaceEntry["MetricPropertyIndex"].get<bool>();
+    }
+    // Keys are built from the platform prefixes, a new image with different
+    // values must not reuse the old entries.
+    options.configHash = hashString(namespaceEntry.dump() + PLATFORMSYSTEMID +
+                                    PLATFORMDEVICEPREFIX);
+    return options;
+}
+
 unordered_map<string, vector<string>> ConfigReader::getMRDNamespaceLookup()
 {
     unordered_map<string, vector<string>> mrdNamespaceLookup;
@@ -251,3 +324,42 @@ unordered_map<string, vector<string>> ConfigReader::getMRDNamespaceLookup()
     }
     return mrdNamespaceLookup;
 }
+
+unordered_map<string, string> ConfigReader::getSharedSegments()
+{
+    unordered_map<string, string> sharedSegments;
+    try
+    {
+        ConfigReader::loadSHMMappingConfig();
+        if (shmMappingJson->contains("SharedSegmentProducers"))
+        {
+            for (const auto& producerName :
+                 (*shmMappingJson)["SharedSegmentProducers"]
+                     .get<vector<string>>())
+            {
+                sharedSegments.emplace(producerName, producerName + "_shared");
+            }
+        }
+    }
+    catch (const exception& e)
+    {
+        lg2::error(
+            "SHMEMDEBUG: Exception {EXCEPTION} while getting shared segments config. ",
+            "EXCEPTION", e.what());
+    }
+    return sharedSegments;
+}
+
+size_t ConfigReader::getSharedSegmentSize(const std::string& producerName)
+{
+    size_t size = 0;
+    for (const auto& producerEntry : getProducers())
+    {
+        if (find(producerEntry.second.begin(), producerEntry.second.end(),
+                 producerName) != producerEntry.second.end())
+        {
+            size += getSHMSize(producerEntry.first, producerName);
+        }
+    }
+    return size;
+}
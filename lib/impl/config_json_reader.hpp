@@ -18,6 +18,7 @@
 #pragma once
 
 #include "impl/error_logger.hpp"
+#include "impl/namespace_options.hpp"
 
 #include <shm_common.h>
 
@@ -97,6 +98,21 @@ struct ConfigReader
     static size_t getSHMSize(const std::string& sensorNamespace,
                              const std::string& producerName);
 
+    /**
+     * @brief Method to get the producer options of a sensor namespace from
+     * shared memory mapping file. Optional keys "PublishMode" with value
+     * "Live" (default) or "Snapshot", "WarmRestart" (default false),
+     * "MaxEntries" and "MaxSizeInBytes". The config hash covers the whole
+     * namespace entry.
+     *
+     * @param[in] sensorNamespace - sensor namespace
+     * @return NamespaceOptions
+     * @throws std::exception if json file is not loaded or a value is not
+     * known
+     */
+    static NamespaceOptions
+        getNamespaceOptions(const std::string& sensorNamespace);
+
     /**
      * @brief Method to get MRDNamspaceLookup config from shared memory mapping
      * file. This is a static method and called only once during first look up.
@@ -105,6 +121,26 @@ struct ConfigReader
      * @throws std::exception if there are parsing errors or json errors
      */
     static unordered_map<string, vector<string>> getMRDNamespaceLookup();
+
+    /**
+     * @brief Method to get the shared segments from shared memory mapping
+     * file. Producers listed under the optional "SharedSegmentProducers" key
+     * host all their namespaces in one segment named <producer>_shared.
+     *
+     * @return unordered_map<string, string> - segment name by producer name,
+     * empty if the file can not be loaded
+     */
+    static unordered_map<string, string> getSharedSegments();
+
+    /**
+     * @brief Method to get the size of the shared segment of a producer: the
+     * sum of the SizeInBytes of all its namespaces.
+     *
+     * @param[in] producerName - producer name
+     * @return size_t
+     * @throws std::exception if json file is not loaded or a size is invalid
+     */
+    static size_t getSharedSegmentSize(const std::string& producerName);
 };
 } // namespace shmem
 } // namespace nv
@@ -0,0 +1,316 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <shm_common.h>
+
+#include <bit>
+#include <cstdint>
+#include <span>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/**
+ * @brief Encoder state of a Gorilla compressed block of samples, as described
+ * in "Gorilla: A Fast, Scalable, In-Memory Time Series Database" (VLDB 2015).
+ *
+ * @details The first sample of a block is stored in full. The timestamp of
+ * every following sample is stored as the difference between its delta and
+ * the previous delta, one bit for regular intervals. The value is XORed with
+ * the previous value and only the bits between the leading and trailing zeros
+ * are stored, one bit for an unchanged value. The state holds what the next
+ * append needs and lives next to the block.
+ */
+struct GorillaState
+{
+    /** Number of samples in the block */
+    uint32_t count = 0;
+    /** Number of bits written to the block */
+    uint32_t bits = 0;
+    uint64_t firstTimestamp = 0;
+    uint64_t lastTimestamp = 0;
+    int64_t lastDelta = 0;
+    uint64_t lastValue = 0;
+    /** Zero bits around the meaningful bits of the last stored XOR, leading
+     * is noLeading before the first one */
+    uint8_t leading = noLeading;
+    uint8_t trailing = 0;
+
+    static constexpr uint8_t noLeading = 0xFF;
+};
+
+/** @brief Writes bits most significant first into a byte buffer, or only
+ * counts them when the buffer is empty */
+class GorillaBitWriter
+{
+  public:
+    GorillaBitWriter(span<uint8_t> buffer, uint32_t bits) :
+        buffer(buffer), bits(bits)
+    {}
+
+    void write(uint64_t value, uint32_t length)
+    {
+        for (uint32_t i = length; i > 0; i--, bits++)
+        {
+            if (buffer.empty())
+            {
+                continue;
+            }
+            uint8_t mask = static_cast<uint8_t>(0x80U >> (bits % 8));
+            if ((value >> (i - 1)) & 1U)
+            {
+                buffer[bits / 8] |= mask;
+            }
+            else
+            {
+                buffer[bits / 8] &= static_cast<uint8_t>(~mask);
+            }
+        }
+    }
+
+    uint32_t size() const
+    {
+        return bits;
+    }
+
+  private:
+    span<uint8_t> buffer;
+    uint32_t bits;
+};
+
+/** @brief Reads the bits written by GorillaBitWriter. Reading past end yields
+ * zeros and sets overrun, so a torn block can not read out of bounds. */
+class GorillaBitReader
+{
+  public:
+    GorillaBitReader(span<const uint8_t> buffer, uint32_t end) :
+        buffer(buffer), end(min<size_t>(end, buffer.size() * 8))
+    {}
+
+    uint64_t read(uint32_t length)
+    {
+        uint64_t value = 0;
+        for (uint32_t i = 0; i < length; i++, bits++)
+        {
+            value <<= 1;
+            if (bits >= end)
+            {
+                overrun = true;
+                continue;
+            }
+            value |= (buffer[bits / 8] >> (7 - bits % 8)) & 1U;
+        }
+        return value;
+    }
+
+    bool overrun = false;
+
+  private:
+    span<const uint8_t> buffer;
+    uint32_t end;
+    uint32_t bits = 0;
+};
+
+/** @brief Write the encoding of a sample and advance state
+ *  @param[in,out] writer - bit sink
+ *  @param[in,out] state - encoder state of the block
+ *  @param[in] timestampMs - timestamp of the sample
+ *  @param[in] value - value of the sample
+ */
+inline void gorillaEncode(GorillaBitWriter& writer, GorillaState& state,
+                          uint64_t timestampMs, double value)
+{
+    uint64_t valueBits = bit_cast<uint64_t>(value);
+    if (state.count == 0)
+    {
+        writer.write(timestampMs, 64);
+        writer.write(valueBits, 64);
+        state.firstTimestamp = timestampMs;
+        state.lastTimestamp = timestampMs;
+        state.lastValue = valueBits;
+        state.count = 1;
+        return;
+    }
+    int64_t delta = static_cast<int64_t>(timestampMs - state.lastTimestamp);
+    // Wrapping arithmetic, decode wraps back
+    int64_t deltaOfDelta = static_cast<int64_t>(
+        static_cast<uint64_t>(delta) - static_cast<uint64_t>(state.lastDelta));
+    if (deltaOfDelta == 0)
+    {
+        writer.write(0b0, 1);
+    }
+    else if (deltaOfDelta >= -64 && deltaOfDelta < 64)
+    {
+        writer.write(0b10, 2);
+        writer.write(static_cast<uint64_t>(deltaOfDelta), 7);
+    }
+    else if (deltaOfDelta >= -256 && deltaOfDelta < 256)
+    {
+        writer.write(0b110, 3);
+        writer.write(static_cast<uint64_t>(deltaOfDelta), 9);
+    }
+    else if (deltaOfDelta >= -2048 && deltaOfDelta < 2048)
+    {
+        writer.write(0b1110, 4);
+        writer.write(static_cast<uint64_t>(deltaOfDelta), 12);
+    }
+    else
+    {
+        writer.write(0b1111, 4);
+        writer.write(static_cast<uint64_t>(deltaOfDelta), 64);
+    }
+
+    uint64_t xorBits = valueBits ^ state.lastValue;
+    if (xorBits == 0)
+    {
+        writer.write(0b0, 1);
+    }
+    else
+    {
+        // The leading count is stored in 5 bits
+        auto leading = static_cast<uint8_t>(min(countl_zero(xorBits), 31));
+        auto trailing = static_cast<uint8_t>(countr_zero(xorBits));
+        if (state.leading != GorillaState::noLeading &&
+            leading >= state.leading && trailing >= state.trailing)
+        {
+            writer.write(0b10, 2);
+            writer.write(xorBits >> state.trailing,
+                         64U - state.leading - state.trailing);
+        }
+        else
+        {
+            uint32_t length = 64U - leading - trailing;
+            writer.write(0b11, 2);
+            writer.write(leading, 5);
+            writer.write(length - 1, 6);
+            writer.write(xorBits >> trailing, length);
+            state.leading = leading;
+            state.trailing = trailing;
+        }
+    }
+    state.lastTimestamp = timestampMs;
+    state.lastDelta = delta;
+    state.lastValue = valueBits;
+    state.count++;
+}
+
+/** @brief Append a sample to a block if it fits
+ *  @param[in,out] state - encoder state of the block
+ *  @param[in,out] block - encoded samples
+ *  @param[in] timestampMs - timestamp of the sample
+ *  @param[in] value - value of the sample
+ *  @return False if the block has no room for the sample, it is unchanged
+ */
+inline bool gorillaAppend(GorillaState& state, span<uint8_t> block,
+                          uint64_t timestampMs, double value)
+{
+    GorillaState next = state;
+    GorillaBitWriter counter({}, state.bits);
+    gorillaEncode(counter, next, timestampMs, value);
+    if (counter.size() > block.size() * 8)
+    {
+        return false;
+    }
+    GorillaBitWriter writer(block, state.bits);
+    gorillaEncode(writer, state, timestampMs, value);
+    state.bits = writer.size();
+    return true;
+}
+
+/** @brief Sign extend the low length bits of value */
+inline int64_t gorillaSigned(uint64_t value, uint32_t length)
+{
+    uint64_t sign = uint64_t{1} << (length - 1);
+    return static_cast<int64_t>((value ^ sign) - sign);
+}
+
+/** @brief Decode the samples of a block
+ *  @param[in] block - encoded samples
+ *  @param[in] state - state of the block after the last append
+ *  @param[in] visit - callable taking the timestamp and value of each sample
+ *  @return False if the block is inconsistent with state
+ */
+template <typename Visitor>
+bool gorillaDecode(span<const uint8_t> block, const GorillaState& state,
+                   Visitor&& visit)
+{
+    GorillaBitReader reader(block, state.bits);
+    uint64_t timestamp = 0;
+    int64_t delta = 0;
+    uint64_t value = 0;
+    uint32_t leading = 0;
+    uint32_t trailing = 0;
+    for (uint32_t i = 0; i < state.count && !reader.overrun; i++)
+    {
+        if (i == 0)
+        {
+            timestamp = reader.read(64);
+            value = reader.read(64);
+            visit(timestamp, bit_cast<double>(value));
+            continue;
+        }
+        int64_t deltaOfDelta = 0;
+        if (reader.read(1) != 0)
+        {
+            if (reader.read(1) == 0)
+            {
+                deltaOfDelta = gorillaSigned(reader.read(7), 7);
+            }
+            else if (reader.read(1) == 0)
+            {
+                deltaOfDelta = gorillaSigned(reader.read(9), 9);
+            }
+            else if (reader.read(1) == 0)
+            {
+                deltaOfDelta = gorillaSigned(reader.read(12), 12);
+            }
+            else
+            {
+                deltaOfDelta = static_cast<int64_t>(reader.read(64));
+            }
+        }
+        delta = static_cast<int64_t>(static_cast<uint64_t>(delta) +
+                                     static_cast<uint64_t>(deltaOfDelta));
+        timestamp += static_cast<uint64_t>(delta);
+        if (reader.read(1) != 0)
+        {
+            if (reader.read(1) != 0)
+            {
+                leading = static_cast<uint32_t>(reader.read(5));
+                uint32_t length = static_cast<uint32_t>(reader.read(6)) + 1;
+                if (leading + length > 64)
+                {
+                    return false;
+                }
+                trailing = 64 - leading - length;
+            }
+            value ^= reader.read(64 - leading - trailing) << trailing;
+        }
+        visit(timestamp, bit_cast<double>(value));
+    }
+    return !reader.overrun;
+}
+
+} // namespace shmem
+} // namespace nv
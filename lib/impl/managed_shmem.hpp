@@ -19,12 +19,24 @@
 
 #include <shm_common.h>
 
-#include <boost/interprocess/sync/named_upgradable_mutex.hpp>
-#include <boost/interprocess/sync/scoped_lock.hpp>
-#include <boost/interprocess/sync/sharable_lock.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include "namespace_options.hpp"
+#include "robust_mutex.hpp"
+#include "shmem_hash_map.hpp"
 
+#include <boost/version.hpp>
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
 
 using namespace std;
 
@@ -34,36 +46,196 @@ namespace nv
 namespace shmem
 {
 
-using shmem_write_lock_t = boost::interprocess::scoped_lock<
-    boost::interprocess::named_upgradable_mutex>;
-using shmem_read_lock_t = boost::interprocess::sharable_lock<
-    boost::interprocess::named_upgradable_mutex>;
+using shmem_write_lock_t = unique_lock<RobustMutex>;
+using shmem_read_lock_t = unique_lock<RobustMutex>;
+
+/** @brief Number of attempts to register as a reader before falling back to
+ * the namespace lock. */
+constexpr int maxOptimisticReads = 8;
+
+/** @brief Number of retries of a single entry read before it starts
+ * checking the clock. */
+constexpr int maxEntryReadSpins = 1000;
+
+/** @brief Time a reader retries an entry locked by a writer, and interval at
+ * which a structural writer reports readers that do not leave. The same one
+ * second budget as TryReadLock. */
+constexpr auto readerDrainTimeout = chrono::seconds(1);
+
+/** @brief Time a structural writer that can defer its change waits for
+ * in-flight readers before deferring it. */
+constexpr auto structuralDrainTimeout = chrono::milliseconds(10);
+
+/** @brief Number of mappings of the reader counters of a namespace that can
+ * be registered at once, each reader or producer instance claims one slot. */
+constexpr uint32_t maxReaderSlots = 64;
+
+/** @brief Bumped whenever the layout of the header or of the entries changes
+ * in a way sizeof does not catch. */
+constexpr uint32_t shmemLayoutVersion = 14;
 
 /**
- * @brief Wrapper class which provides functionality of boost shared memory
- * initialization, cleanup and locks around read operation
+ * @brief 64-bit FNV-1a. Unlike std::hash it is stable across processes and
+ * builds, so it can be used for values stored in the segment.
  *
+ * @param[in] str - bytes to hash
+ * @param[in] hash - hash to continue from
+ * @return uint64_t
  */
-class ManagedShmem
+constexpr uint64_t hashString(string_view str,
+                              uint64_t hash = 14695981039346656037ULL)
 {
-  public:
-    ManagedShmem(const string& nameSpace, const int opts, size_t maxSize);
-    ManagedShmem(const string& nameSpace, const int opts);
-    virtual ~ManagedShmem() = default;
-    /**
-     * @brief Read lock implementation to read values from shared memory.
-     *
-     */
-    void TryReadLock();
+    for (char c : str)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
 
-  protected:
-    unique_ptr<boost::interprocess::managed_shared_memory> memory;
-    unique_ptr<void_allocator_t> voidAllocator;
-    unique_ptr<boost::interprocess::named_upgradable_mutex> memLock;
-    const int opts;
-    string nameSpace;
+/**
+ * @brief Mix an integer into an FNV-1a hash byte by byte.
+ */
+constexpr uint64_t hashCombine(uint64_t hash, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        hash ^= (value >> (8 * i)) & 0xFFU;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief What a producer expects to find in a segment it warm attaches to.
+ * Filled by Map from the types it stores.
+ */
+struct SegmentLayout
+{
+    uint64_t layoutHash;
+    uint32_t entrySize;
+};
+
+/**
+ * @brief Control block constructed in every namespace segment next to the map.
+ *
+ * sequence is odd while a structural writer (insert/erase/clear) is changing
+ * the tree. Structural writers wait for the readers registered in
+ * ReaderCounters to leave before modifying the tree so that nobody follows a
+ * node that is being freed. Values inside the entries are protected by their
+ * own version counter, see readVersioned.
+ *
+ * In snapshot mode readers only ever look at map frontBuffer. The producer
+ * flips frontBuffer and waits for the readers of the old front to leave before
+ * writing to it.
+ *
+ * generation is incremented by every write and stamped on the written entry,
+ * removalGeneration is the generation of the last removal of an entry. In
+ * snapshot mode publishedGeneration is the generation readers can see.
+ * instance identifies the segment, it is kept by a warm restart.
+ *
+ * remapGeneration is incremented by the producer each time it grows the
+ * segment. Readers compare it to the generation they mapped after they
+ * registered and remap before walking the map, the producer only grows the
+ * segment while the sequence is odd.
+ *
+ * The layout fields are validated by a producer before it warm attaches to a
+ * segment left behind by its previous instance.
+ */
+struct ShmemHeader
+{
+    atomic<uint32_t> sequence{0};
+    PublishMode publishMode{PublishMode::live};
+    atomic<uint32_t> frontBuffer{0};
+    atomic<uint64_t> generation{0};
+    atomic<uint64_t> removalGeneration{0};
+    atomic<uint64_t> publishedGeneration{0};
+    atomic<uint64_t> remapGeneration{0};
+    uint64_t instance{0};
+    uint32_t layoutVersion{0};
+    uint32_t entrySize{0};
+    uint64_t layoutHash{0};
+    uint64_t configHash{0};
 };
 
+/**
+ * @brief Tag of a live process for ReaderSlot::owner: its pid, and its start
+ * time so that a pid reused by another process does not match.
+ *
+ * @param[in] pid - process id
+ * @return uint64_t - never 0
+ */
+uint64_t readerSlotOwner(pid_t pid);
+
+/**
+ * @brief Registrations of one reader or producer instance. owner is set with
+ * readerSlotOwner when the instance claims the slot and reset to 0 when it
+ * goes away. A process killed while registered leaves its slot owned by a
+ * dead process, the producer then drops its registrations.
+ *
+ * activeReaders counts the threads of the instance currently walking the
+ * map, as readers or value writers. snapshotReaders counts those reading
+ * each buffer of a snapshot mode map.
+ */
+struct alignas(64) ReaderSlot
+{
+    atomic<uint64_t> owner{0};
+    atomic<uint32_t> activeReaders{0};
+    atomic<uint32_t> snapshotReaders[2]{0, 0};
+};
+
+/**
+ * @brief The only state written by readers. It lives in the small
+ * <namespace>readers shared memory object rather than in the segment, so that
+ * readers map the segment read only.
+ *
+ * Readers and value writers currently walking the map are registered in the
+ * slot of their instance, see activeReaders. In snapshot mode readers
+ * register for the front buffer instead, see snapshotReaders.
+ *
+ * changeSequence is the futex word readers block on in waitForChange.
+ * changeWaiters counts the readers in waitForChange, the producer only
+ * increments changeSequence and wakes them when it is not 0, so that value
+ * updates without waiters do not write the shared cache line.
+ *
+ * lock is the namespace lock. Structural writers hold it, readers only take
+ * it briefly to register when the sequence stays odd. It lives here rather
+ * than in the segment because readers must be able to write it.
+ */
+struct ReaderCounters
+{
+    /** @brief Readers registered in all the slots */
+    uint32_t activeReaders() const
+    {
+        uint32_t count = 0;
+        for (const auto& slot : slots)
+        {
+            count += slot.activeReaders.load(memory_order_seq_cst);
+        }
+        return count;
+    }
+
+    /** @brief Readers of a snapshot buffer registered in all the slots */
+    uint32_t snapshotReaders(uint32_t buffer) const
+    {
+        uint32_t count = 0;
+        for (const auto& slot : slots)
+        {
+            count += slot.snapshotReaders[buffer].load(memory_order_seq_cst);
+        }
+        return count;
+    }
+
+    ReaderSlot slots[maxReaderSlots];
+    atomic<uint32_t> changeSequence{0};
+    atomic<uint32_t> changeWaiters{0};
+    RobustMutex lock;
+};
+
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t) &&
+                  atomic<uint32_t>::is_always_lock_free,
+              "changeSequence is used as a futex word");
+
 struct LockAcquisitionException : public runtime_error
 {
     LockAcquisitionException() :
@@ -81,5 +253,541 @@ struct PermissionErrorException : public runtime_error
     PermissionErrorException() : runtime_error("Permission denied") {}
 };
 
+/**
+ * @brief Per-entry seqcount read: run copy until the version was even and
+ * unchanged around it. After maxEntryReadSpins attempts the read keeps
+ * retrying for readerDrainTimeout.
+ *
+ * @param[in] version - version counter of the entry
+ * @param[in] copy - callable copying the entry fields, may be run repeatedly
+ * @throws LockAcquisitionException if the entry stayed locked by a writer
+ * for readerDrainTimeout
+ */
+template <typename CopyFunc>
+void readVersioned(const atomic<uint32_t>& version, CopyFunc&& copy)
+{
+    chrono::steady_clock::time_point deadline{};
+    for (int spin = 0;; spin++)
+    {
+        uint32_t v = version.load(memory_order_acquire);
+        if (!(v & 1U))
+        {
+            copy();
+            atomic_thread_fence(memory_order_acquire);
+            if (version.load(memory_order_relaxed) == v)
+            {
+                return;
+            }
+        }
+        if (spin == maxEntryReadSpins)
+        {
+            deadline = chrono::steady_clock::now() + readerDrainTimeout;
+        }
+        else if (spin > maxEntryReadSpins &&
+                 chrono::steady_clock::now() > deadline)
+        {
+            throw LockAcquisitionException();
+        }
+        this_thread::yield();
+    }
+}
+
+/**
+ * @brief RAII writer side of the per-entry seqcount. Makes the version odd
+ * for its lifetime, which also excludes other writers of the same entry.
+ * Waits for the current writer however long it takes: only the producer
+ * writes entries and a warm restart drops those its previous instance left
+ * locked.
+ */
+class VersionWriteGuard
+{
+  public:
+    explicit VersionWriteGuard(atomic<uint32_t>& version) : version(version)
+    {
+        current = version.load(memory_order_relaxed);
+        while ((current & 1U) ||
+               !version.compare_exchange_weak(current, current + 1,
+                                              memory_order_acquire,
+                                              memory_order_relaxed))
+        {
+            this_thread::yield();
+            current = version.load(memory_order_relaxed);
+        }
+    }
+
+    ~VersionWriteGuard()
+    {
+        version.store(current + 2, memory_order_release);
+    }
+
+    VersionWriteGuard(const VersionWriteGuard&) = delete;
+    VersionWriteGuard& operator=(const VersionWriteGuard&) = delete;
+
+  private:
+    atomic<uint32_t>& version;
+    uint32_t current;
+};
+
+class SharedSegment;
+
+/**
+ * @brief Wrapper class which provides functionality of boost shared memory
+ * initialization, cleanup and locks around read operation
+ *
+ */
+class ManagedShmem
+{
+  public:
+    /** @brief Producer ctor. Creates the segment, or with
+     * options.warmRestart reuses the one left by the previous instance when
+     * its header matches layout and options.
+     *  @param[in] nameSpace - Unique name of the segment
+     *  @param[in] opts - Read/Write permissions
+     *  @param[in] maxSize - size of the segment
+     *  @param[in] options - namespace options
+     *  @param[in] layout - layout of the objects stored in the segment
+     */
+    ManagedShmem(const string& nameSpace, const int opts, size_t maxSize,
+                 const NamespaceOptions& options, const SegmentLayout& layout);
+    /** @brief Reader ctor
+     *  @param[in] nameSpace - Unique name of the namespace
+     *  @param[in] opts - Read permissions
+     *  @param[in] segmentName - shared segment hosting the namespace, the
+     * namespace has a segment of its own when empty
+     */
+    ManagedShmem(const string& nameSpace, const int opts,
+                 const string& segmentName = {});
+    /** @brief Dtor, release the reader slot */
+    virtual ~ManagedShmem();
+    /**
+     * @brief Read lock implementation to read values from shared memory.
+     *
+     * @return shmem_read_lock_t - namespace lock, held until it goes out of
+     * scope
+     * @throws LockAcquisitionException if the lock is not acquired within one
+     * second
+     * @throws BadMapException if a producer died in the middle of a
+     * structural change, for every reader until the producer restarts
+     */
+    shmem_read_lock_t TryReadLock();
+
+    /** @brief Acquisition, contention and owner death counters of the
+     * namespace lock, shared by the producer and all the readers */
+    LockStats getLockStats() const
+    {
+        return memLock->stats();
+    }
+
+    /**
+     * @brief Generation of the last change readers can see: the last write in
+     * live mode, the last publish in snapshot mode.
+     */
+    uint64_t visibleGeneration() const
+    {
+        shared_lock mapping(mappingLock);
+        return (publishMode == PublishMode::snapshot)
+                   ? header->publishedGeneration.load(memory_order_acquire)
+                   : header->generation.load(memory_order_acquire);
+    }
+
+    /**
+     * @brief Block until the visible generation differs from lastGeneration
+     * or timeout expires. Waits on a futex, the producer only makes a system
+     * call when readers are waiting.
+     *
+     * @param[in] lastGeneration - generation the caller has seen
+     * @param[in] timeout - longest time to wait
+     * @return uint64_t - visible generation, lastGeneration on timeout
+     */
+    uint64_t waitForChange(uint64_t lastGeneration,
+                           chrono::milliseconds timeout);
+
+  protected:
+    /**
+     * @brief RAII registration in one of the reader counts.
+     */
+    class ReaderRegistration
+    {
+      public:
+        explicit ReaderRegistration(atomic<uint32_t>& count) : count(count)
+        {
+            count.fetch_add(1, memory_order_seq_cst);
+        }
+        ~ReaderRegistration()
+        {
+            count.fetch_sub(1, memory_order_release);
+        }
+        ReaderRegistration(const ReaderRegistration&) = delete;
+        ReaderRegistration& operator=(const ReaderRegistration&) = delete;
+
+      private:
+        atomic<uint32_t>& count;
+    };
+
+    /**
+     * @brief RAII structural writer. Holds the named write lock, keeps the
+     * sequence odd for its lifetime and waits for registered readers to leave
+     * the map before the tree is modified.
+     */
+    class SequenceWriteGuard
+    {
+      public:
+        /** @brief Wait for the registered readers however long they take */
+        explicit SequenceWriteGuard(ManagedShmem& shmem);
+        /** @brief Give up if the registered readers do not leave within
+         * drainTimeout. The sequence is even and the lock released again
+         * then, see owns. */
+        SequenceWriteGuard(ManagedShmem& shmem,
+                           chrono::steady_clock::duration drainTimeout);
+        ~SequenceWriteGuard();
+        SequenceWriteGuard(const SequenceWriteGuard&) = delete;
+        SequenceWriteGuard& operator=(const SequenceWriteGuard&) = delete;
+
+        /** @brief False if the readers did not leave, nothing may be
+         * modified then */
+        bool owns() const
+        {
+            return lock.owns_lock();
+        }
+
+      private:
+        shmem_write_lock_t lock;
+        /** The header is read through shmem, growing the segment remaps it
+         */
+        ManagedShmem& shmem;
+        ReaderCounters& readers;
+    };
+
+    /**
+     * @brief Run func while registered as a reader of the map structure.
+     * Structural writers wait for registered readers to leave, so func may
+     * walk the tree freely. Values still change underneath and must be read
+     * through readVersioned. If a structural writer keeps the sequence odd for
+     * maxOptimisticReads attempts the reader waits for the named lock and
+     * registers while holding it, so that it is not starved, but releases it
+     * before func runs. The mapping lock is held shared, never while waiting
+     * for the named lock.
+     *
+     * @param[in] func - callable walking the map
+     */
+    template <typename Func>
+    void withReaderRegistered(Func&& func)
+    {
+        for (int attempt = 0; attempt < maxOptimisticReads; attempt++)
+        {
+            shared_lock mapping(mappingLock);
+            uint32_t seq = header->sequence.load(memory_order_acquire);
+            if (seq & 1U)
+            {
+                mapping.unlock();
+                this_thread::yield();
+                continue;
+            }
+            ReaderRegistration registration(readerSlot->activeReaders);
+            if (header->sequence.load(memory_order_seq_cst) != seq)
+            {
+                continue;
+            }
+            remapIfGrown(mapping);
+            func();
+            return;
+        }
+        // Structural writers hold the lock while the sequence is odd, once it
+        // is released they wait for this registration like for any other
+        auto lock = TryReadLock();
+        ReaderRegistration registration(readerSlot->activeReaders);
+        lock.unlock();
+        shared_lock mapping(mappingLock);
+        remapIfGrown(mapping);
+        func();
+    }
+
+    /**
+     * @brief Run func as a structural writer, unless readers are walking the
+     * map: defer runs instead then, so that a long scan does not block the
+     * producer. The writer waits structuralDrainTimeout for the readers, or
+     * only checks them once when changes are already deferred. The
+     * registrations of dead readers are looked for at most once every
+     * readerDrainTimeout while changes are deferred.
+     *
+     * @param[in] deferring - true if changes are already deferred
+     * @param[in] func - callable modifying the map, it must apply the
+     * deferred changes first and be safe to run again
+     * @param[in] defer - callable deferring the change
+     * @return true if func ran
+     */
+    template <typename Func, typename DeferFunc>
+    bool writeOrDefer(bool deferring, Func&& func, DeferFunc&& defer)
+    {
+        bool written = withGrowth([&]() {
+            if (deferring && readers->activeReaders() != 0 &&
+                !readerReclaimDue())
+            {
+                return false;
+            }
+            SequenceWriteGuard guard(*this, deferring
+                                                ? chrono::milliseconds(0)
+                                                : structuralDrainTimeout);
+            if (!guard.owns())
+            {
+                return false;
+            }
+            func();
+            return true;
+        });
+        if (!written)
+        {
+            defer();
+        }
+        return written;
+    }
+
+    /**
+     * @brief Run func while registered as a reader of the front buffer of a
+     * snapshot mode segment. The producer never writes to the front buffer
+     * and waits for its readers before reusing it as back buffer. The
+     * mapping lock is held shared, so that a producer growing the segment
+     * also waits for its own snapshot readers.
+     *
+     * @param[in] func - callable taking the index of the front buffer
+     */
+    template <typename Func>
+    void withFrontRegistered(Func&& func)
+    {
+        shared_lock mapping(mappingLock);
+        while (true)
+        {
+            uint32_t front = header->frontBuffer.load(memory_order_acquire);
+            ReaderRegistration registration(
+                readerSlot->snapshotReaders[front]);
+            if (header->frontBuffer.load(memory_order_seq_cst) == front)
+            {
+                remapIfGrown(mapping);
+                func(front);
+                return;
+            }
+            // Published while registering, retry on the new front.
+        }
+    }
+
+    /**
+     * @brief Make the back buffer the front buffer and wait for the readers of
+     * the previous front to leave, however long they take. The registrations
+     * of readers that died are dropped. Must be called by the producer with
+     * the named write lock held.
+     *
+     * @return uint32_t - index of the new back buffer
+     */
+    uint32_t flipFrontBuffer();
+
+    /**
+     * @brief Wake the readers blocked in waitForChange. Called by the
+     * producer once a change is visible. Structural writers of a live mode
+     * segment call it when they release the sequence.
+     */
+    void notifyChange();
+
+    /**
+     * @brief Remap the segment of a reader when the producer grew it since it
+     * was mapped. Must be called while registered as a reader, so that the
+     * segment does not grow again in between.
+     *
+     * @param[in] mapping - shared mapping lock of the caller, traded for the
+     * exclusive one while the other threads of the process leave the old
+     * mapping
+     */
+    void remapIfGrown(shared_lock<shared_mutex>& mapping)
+    {
+        if (!(opts & O_CREAT) &&
+            header->remapGeneration.load(memory_order_acquire) !=
+                mappedRemapGeneration)
+        {
+            mapping.unlock();
+            {
+                unique_lock exclusive(mappingLock);
+                // Another thread may have remapped it meanwhile
+                if (header->remapGeneration.load(memory_order_acquire) !=
+                    mappedRemapGeneration)
+                {
+                    remap();
+                }
+            }
+            mapping.lock();
+        }
+    }
+
+    /**
+     * @brief Called once the segment was mapped again at another address.
+     * Derived maps look up the pointers they keep into the segment again.
+     */
+    virtual void remapped() {}
+
+    /**
+     * @brief Grow the segment of a producer that ran out of memory and remap
+     * it. Takes the structural write guard, readers are drained and keep out
+     * until the remap generation is visible.
+     *
+     * @return true if the segment grew, false if it reached maxSizeInBytes
+     * or is shared
+     */
+    bool growSegment();
+
+    /**
+     * @brief growSegment for a producer already holding the structural write
+     * guard.
+     */
+    bool growSegmentLocked();
+
+    /**
+     * @brief Raise the object capacity of a producer whose map is full.
+     * Derived maps with a bounded capacity grow it along with the segment.
+     *
+     * @return true if the capacity grew
+     */
+    virtual bool growEntries()
+    {
+        return false;
+    }
+
+    /**
+     * @brief Run func, growing the segment or the object capacity and running
+     * func again each time it runs out of either. func must not hold the
+     * structural write guard when it throws and must be safe to run again.
+     *
+     * @param[in] func - callable writing to the segment
+     * @return what func returns
+     * @throws boost::interprocess::bad_alloc if the segment can not grow
+     * @throws MapFullException if the capacity can not grow
+     */
+    template <typename Func>
+    decltype(auto) withGrowth(Func&& func)
+    {
+        while (true)
+        {
+            try
+            {
+                return func();
+            }
+            catch (const boost::interprocess::bad_alloc&)
+            {
+                if (!growSegment())
+                {
+                    throw;
+                }
+            }
+            catch (const MapFullException&)
+            {
+                if (!growEntries())
+                {
+                    throw;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Check that a range read from the segment lies inside the mapping.
+     * Used by readers to avoid following a torn pointer or size.
+     */
+    bool inSegment(const void* ptr, size_t size) const
+    {
+        const auto* begin = static_cast<const char*>(memory->get_address());
+        const auto* p = static_cast<const char*>(ptr);
+        return p >= begin && size <= memory->get_size() &&
+               static_cast<size_t>(p - begin) <= memory->get_size() - size;
+    }
+
+    /**
+     * @brief Hold the lock of the index of named objects while constructing,
+     * destroying or looking them up. Only a shared segment needs it, the
+     * producer creates the other namespaces in it while readers use it.
+     *
+     * @return shmem_write_lock_t - directory lock of a shared segment, not
+     * associated with a mutex otherwise
+     * @throws LockAcquisitionException if a reader does not get the lock
+     * within one second
+     */
+    shmem_write_lock_t lockNamedObjects();
+
+    shared_ptr<boost::interprocess::managed_shared_memory> memory;
+    /** @brief Segment shared with the other namespaces of the producer */
+    shared_ptr<SharedSegment> segment;
+    unique_ptr<void_allocator_t> voidAllocator;
+    /** @brief Namespace lock, in the reader counters */
+    RobustMutex* memLock = nullptr;
+    unique_ptr<boost::interprocess::mapped_region> readerRegion;
+    ShmemHeader* header = nullptr;
+    ReaderCounters* readers = nullptr;
+    /** @brief Slot of this instance in the reader counters */
+    ReaderSlot* readerSlot = nullptr;
+    /** @brief Time of the last reclaimDeadReaders, steady clock ticks */
+    atomic<chrono::steady_clock::rep> lastReaderReclaim{0};
+    const int opts;
+    string nameSpace;
+    /** @brief True when the producer reused the previous segment */
+    bool warmAttached = false;
+    /** @brief Size the producer may grow the segment to */
+    size_t maxSegmentSize = 0;
+    /** @brief Remap generation of the segment when it was mapped */
+    uint64_t mappedRemapGeneration = 0;
+    /** @brief Publish mode of the header, fixed for the life of the segment
+     * and read without going through the mapping */
+    PublishMode publishMode = PublishMode::live;
+    /** @brief Held shared by the threads of this process using the mapping,
+     * exclusively to map the segment again. Unlike the reader counters it
+     * also keeps out the snapshot readers of the process. */
+    mutable shared_mutex mappingLock;
+
+  private:
+    /**
+     * @brief Map the segment again, with its current size, and refresh the
+     * pointers into it.
+     */
+    void remap();
+
+    /**
+     * @brief Open the segment of a previous producer instance and validate
+     * its header.
+     *
+     * @return true if the segment can be reused, memory and header are set
+     */
+    bool tryWarmAttach(size_t maxSize, const NamespaceOptions& options,
+                       const SegmentLayout& layout);
+
+    /**
+     * @brief Map the reader counters of the namespace. A producer creates
+     * them, or keeps the ones of its previous instance on a warm attach so
+     * that readers which already mapped them stay registered. The
+     * registrations of readers that died meanwhile are dropped.
+     */
+    void mapReaderCounters();
+
+    /**
+     * @brief Claim a free slot of the reader counters for this instance,
+     * reclaiming the slots of dead readers if there is none.
+     *
+     * @throws LockAcquisitionException if all the slots are owned by live
+     * instances, or the namespace lock is not acquired within one second
+     */
+    void claimReaderSlot();
+
+    /**
+     * @brief Drop the registrations of the readers that died while
+     * registered and free their slots. Must be called with the namespace
+     * lock held.
+     *
+     * @return size_t - number of slots reclaimed
+     */
+    size_t reclaimDeadReaders();
+
+    /** @brief True if reclaimDeadReaders last ran readerDrainTimeout ago */
+    bool readerReclaimDue() const
+    {
+        chrono::steady_clock::time_point last(chrono::steady_clock::duration(
+            lastReaderReclaim.load(memory_order_relaxed)));
+        return chrono::steady_clock::now() - last >= readerDrainTimeout;
+    }
+};
+
 } // namespace shmem
 } // namespace nv
@@ -0,0 +1,84 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/**
+ * @brief How a producer makes its updates visible to readers.
+ *
+ * live: every update is visible as soon as it is written.
+ * snapshot: the segment holds two maps. The producer writes into the back map
+ * and publishes a complete poll cycle with a single flip of the front index.
+ */
+enum class PublishMode : uint32_t
+{
+    live,
+    snapshot
+};
+
+/**
+ * @brief Producer side options of a namespace, read from shm_mapping.json.
+ */
+struct NamespaceOptions
+{
+    PublishMode publishMode = PublishMode::live;
+    /** Reuse the segment left behind by a previous instance of the producer
+     * instead of recreating it. */
+    bool warmRestart = false;
+    /** Hash of the namespace configuration. A warm restart is refused when it
+     * changed. */
+    uint64_t configHash = 0;
+    /** Number of entries a fixed capacity map type must hold. Derived from
+     * the segment size when 0. */
+    size_t maxEntries = 0;
+    /** Keep an index from the metric property URI to the objects, see
+     * MetricPropertyIndex. */
+    bool indexMetricProperty = false;
+    /** Number of recent numeric samples kept per object, no history when 0.
+     * See SampleHistory. */
+    uint32_t historySamples = 0;
+    /** Window of the minimum, maximum, average and rate kept per object, no
+     * aggregates when 0. See WindowAggregates. */
+    uint32_t aggregationWindowSeconds = 0;
+    /** Number of changes kept in the journal tailed by streaming readers, no
+     * journal when 0. See ChangeJournal. */
+    uint32_t journalRecords = 0;
+    /** Name of the segment shared by all the namespaces of the producer, the
+     * namespace has a segment of its own when empty. See SharedSegment. */
+    string segment{};
+    /** Size of the shared segment, used by the first namespace that creates
+     * it. */
+    size_t segmentSize = 0;
+    /** Size the segment may grow to when it runs out of memory, the segment
+     * keeps its initial size when 0. Not supported for shared segments. */
+    size_t maxSizeInBytes = 0;
+};
+
+} // namespace shmem
+} // namespace nv
@@ -0,0 +1,112 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/** @brief Counters of a RobustMutex, see RobustMutex::stats */
+struct LockStats
+{
+    /** Number of times the lock was taken */
+    uint64_t acquisitions;
+    /** Number of acquisitions that found the lock held */
+    uint64_t contentions;
+    /** Number of times the lock was recovered from a dead holder */
+    uint64_t ownerDeaths;
+};
+
+/**
+ * @brief Process shared mutex placed in shared memory, for the namespace
+ * lock.
+ *
+ * @details A pthread mutex with PTHREAD_PRIO_INHERIT, so that a low priority
+ * reader holding it is boosted while a real time producer waits, and
+ * PTHREAD_MUTEX_ROBUST, so that the lock of a holder that died is handed to
+ * the next locker with EOWNERDEAD instead of being held forever. The next
+ * locker marks it consistent and ownerDied() tells it that the data the dead
+ * holder protected may be half written. Lockers that find the lock held are
+ * counted in the contention counters.
+ *
+ * Meets the Lockable and TimedLockable requirements, so it is used with
+ * unique_lock.
+ */
+class RobustMutex
+{
+  public:
+    RobustMutex();
+    ~RobustMutex();
+
+    RobustMutex(const RobustMutex&) = delete;
+    RobustMutex& operator=(const RobustMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    /** @brief Lock unless it stays held for timeout */
+    template <class Rep, class Period>
+    bool try_lock_for(const chrono::duration<Rep, Period>& timeout)
+    {
+        return tryLockFor(chrono::duration_cast<chrono::nanoseconds>(timeout));
+    }
+
+    /** @brief True if the last lock was recovered from a holder that died.
+     * Only meaningful to the holder. */
+    bool ownerDied() const
+    {
+        return recovered;
+    }
+
+    /** @brief Snapshot of the counters */
+    LockStats stats() const
+    {
+        return {acquisitions.load(memory_order_relaxed),
+                contentions.load(memory_order_relaxed),
+                ownerDeaths.load(memory_order_relaxed)};
+    }
+
+  private:
+    bool tryLockFor(chrono::nanoseconds timeout);
+
+    /** @brief Account for a successful pthread lock call
+     *  @param[in] result - 0 or EOWNERDEAD
+     */
+    void acquired(int result);
+
+    pthread_mutex_t mutex;
+    /** Set by the holder, see ownerDied */
+    bool recovered = false;
+    atomic<uint64_t> acquisitions{0};
+    atomic<uint64_t> contentions{0};
+    atomic<uint64_t> ownerDeaths{0};
+};
+
+} // namespace shmem
+} // namespace nv
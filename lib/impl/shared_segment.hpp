@@ -0,0 +1,158 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "managed_shmem.hpp"
+
+#include <shm_common.h>
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/offset_ptr.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/** @brief Number of namespaces a shared segment can host */
+constexpr uint32_t maxSegmentNamespaces = 32;
+
+/** @brief Longest namespace name a shared segment can host, including the
+ * terminating zero */
+constexpr size_t segmentNameBytes = 128;
+
+/**
+ * @brief Header directory of a shared segment, the first object the producer
+ * constructs in it. Readers find the header of a namespace here instead of
+ * looking its name up in the segment index, which the producer changes while
+ * it creates the other namespaces.
+ *
+ * Entry i is published by storing count i + 1, its reader counters are slot i
+ * of SegmentReaders. retired is set by a producer that is about to replace
+ * the segment, clients drop their cached mapping when they see it.
+ */
+struct SegmentDirectory
+{
+    struct Entry
+    {
+        char nameSpace[segmentNameBytes];
+        boost::interprocess::offset_ptr<ShmemHeader> header;
+    };
+
+    uint64_t instance{0};
+    atomic<uint32_t> retired{0};
+    atomic<uint32_t> count{0};
+    Entry entries[maxSegmentNamespaces];
+};
+
+/**
+ * @brief Reader writable state of a shared segment, in the <segment>readers
+ * shared memory object: the reader counters and namespace lock of every
+ * hosted namespace, and the directory lock. The producer holds the directory
+ * lock while it constructs or destroys named objects, readers while they look
+ * them up.
+ */
+struct SegmentReaders
+{
+    RobustMutex directoryLock;
+    ReaderCounters namespaces[maxSegmentNamespaces];
+};
+
+/**
+ * @brief One mapping of a segment shared by all the namespaces of a producer.
+ *
+ * @details The namespaces keep their objects under their own names and share
+ * the free space of the segment. A process maps a shared segment once: the
+ * producer for as long as one of its namespaces exists, a client until the
+ * producer replaces or removes the segment. A shared segment has a single
+ * producer process, which registers its namespaces in the SegmentDirectory.
+ */
+class SharedSegment
+{
+  public:
+    /** @brief Producer side. Join the segment already mapped by this process
+     * or replace any previous segment with an empty one.
+     *  @param[in] name - name of the segment
+     *  @param[in] size - size of the segment
+     *  @return shared_ptr<SharedSegment>
+     */
+    static shared_ptr<SharedSegment> create(const string& name, size_t size);
+
+    /** @brief Dtor. The producer removes the segment and its reader state
+     * once its last namespace is gone, clients drop their mapping when they
+     * see it retired. */
+    ~SharedSegment();
+
+    /** @brief Client side. Reuse the mapping of an earlier call unless the
+     * producer retired it.
+     *  @param[in] name - name of the segment
+     *  @return shared_ptr<SharedSegment>
+     *  @throws BadMapException if the segment has no directory
+     */
+    static shared_ptr<SharedSegment> open(const string& name);
+
+    /** @brief Take the directory lock. The producer blocks, a client gives up
+     * after one second.
+     *  @throws LockAcquisitionException on a client timeout
+     */
+    shmem_write_lock_t lockDirectory();
+
+    /** @brief Register a namespace, or find it when it was created before.
+     * Must be called by the producer with the directory lock held.
+     *  @param[in] nameSpace - name of the namespace
+     *  @param[in] header - header of the namespace in the segment
+     *  @return ReaderCounters& - reader counters of the namespace
+     *  @throws BadMapException if the directory is full or the name too long
+     */
+    ReaderCounters& addNamespace(const string& nameSpace, ShmemHeader* header);
+
+    /** @brief Find a registered namespace. Must be called with the directory
+     * lock held.
+     *  @param[in] nameSpace - name of the namespace
+     *  @param[out] counters - reader counters of the namespace
+     *  @return ShmemHeader* - header of the namespace, nullptr if not found
+     */
+    ShmemHeader* findNamespace(const string& nameSpace,
+                               ReaderCounters*& counters) const;
+
+    shared_ptr<boost::interprocess::managed_shared_memory> memory;
+
+  private:
+    SharedSegment(const string& name, bool producer);
+
+    /** @brief Mark a previous segment retired, so that clients stop using
+     * it, and remove it with its reader state */
+    static void retire(const string& name);
+
+    string name;
+    bool producer;
+    unique_ptr<boost::interprocess::mapped_region> readerRegion;
+    SegmentDirectory* directory = nullptr;
+    SegmentReaders* readers = nullptr;
+};
+
+} // namespace shmem
+} // namespace nv
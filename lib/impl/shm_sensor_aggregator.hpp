@@ -47,6 +47,11 @@ struct NameSpaceFields
     DeviceName deviceName;
     SubDeviceName subDeviceName;
     size_t arraySize;
+    /** Shared memory namespace holding the object */
+    string shmNamespace = {};
+    /** Handle to the object of a simple data type, read and written under
+     * nameSpaceMapLock */
+    shmem::EntryHandle handle = {};
 };
 using NameSpaceMap = unordered_map<string, NameSpaceFields>;
 using ConfigKeyLookup = unordered_map<string, string>;
@@ -124,6 +129,41 @@ class SHMSensorAggregator
      */
     bool createShmemNamespace();
 
+    /**
+     * @brief Publish the updates of a completed poll cycle to readers of
+     * snapshot mode namespaces, and apply the inserts and erases deferred in
+     * live mode namespaces.
+     *
+     * @return bool
+     */
+    bool publishShmemNamespaces()
+    {
+        bool flushed = sensorMapIntf.flushDeferred();
+        return sensorMapIntf.publish() && flushed;
+    }
+
+    /**
+     * @brief Apply the inserts and erases deferred while clients were
+     * reading the namespaces.
+     *
+     * @return bool
+     */
+    bool flushShmemNamespaces()
+    {
+        return sensorMapIntf.flushDeferred();
+    }
+
+    /**
+     * @brief Remove objects restored by a warm restart which the producer did
+     * not update since it started.
+     *
+     * @return bool
+     */
+    bool purgeStaleObjects()
+    {
+        return sensorMapIntf.eraseStale();
+    }
+
   private:
     string producerName;
     mutex nameSpaceMapLock;
@@ -25,12 +25,14 @@
 
 #include <iomanip>
 #include <memory>
+#include <span>
 #include <unordered_map>
 
 using namespace std;
 using namespace nv::shmem;
 using sensor_map_type =
-    nv::shmem::Map<nv::shmem::SensorMap, nv::shmem::SensorValue>;
+    nv::shmem::Map<nv::shmem::SensorMapType, nv::shmem::SensorValue>;
+using SensorBatchOp = nv::shmem::BatchOp<nv::shmem::SensorValue>;
 namespace nv
 {
 namespace shmem
@@ -64,14 +66,16 @@ class ShmSensorMapIntf
      *
      * @param[in] nameSpace - shared memory namespace name
      * @param[in] shmSize - shared memory size in bytes
+     * @param[in] options - publish mode and warm restart options
      */
-    bool createNamespace(const string& nameSpace, const size_t shmSize)
+    bool createNamespace(const string& nameSpace, const size_t shmSize,
+                         const NamespaceOptions& options = {})
     {
         try
         {
             sensor_map.insert(std::make_pair(
-                nameSpace,
-                make_unique<sensor_map_type>(nameSpace, O_CREAT, shmSize)));
+                nameSpace, make_unique<sensor_map_type>(nameSpace, O_CREAT,
+                                                        shmSize, options)));
         }
         catch (const exception& e)
         {
@@ -89,18 +93,33 @@ class ShmSensorMapIntf
      * @param[in] mrdNamespace - mrd namespace
      * @param[in] key - shared memory key
      * @param[in] value - shared memory value
+     * @param[out] handle - optional, handle for later updates of the object
+     * @param[out] deferred - optional, true if the insert was deferred
+     * because readers were walking the namespace. The object becomes visible
+     * with the next structural change or flushDeferred, the handle is empty.
      * @return true
      * @return false
      */
     bool insert(const string& mrdNamespace, const string& key,
-                const SensorValue& value)
+                const SensorValue& value, EntryHandle* handle = nullptr,
+                bool* deferred = nullptr)
     {
         try
         {
             auto itr = sensor_map.find(mrdNamespace);
             if (itr != sensor_map.end())
             {
-                (*itr).second->insert(key, value);
+                bool isDeferred = false;
+                auto entryHandle = (*itr).second->insert(key, value,
+                                                         isDeferred);
+                if (handle != nullptr)
+                {
+                    *handle = entryHandle;
+                }
+                if (deferred != nullptr)
+                {
+                    *deferred = isDeferred;
+                }
                 return true;
             }
             else
@@ -259,6 +278,79 @@ class ShmSensorMapIntf
         }
     }
 
+    /**
+     * @brief update value and timestamp in shared memory with the raw reading,
+     * rendered to strings only when a client reads it
+     *
+     * @param[in] mrdNamespace - shared memory namespace
+     * @param[in] key - shared memory key
+     * @param[in] value - reading in its D-Bus type
+     * @param[in] timestamp - timestamp in epoch.
+     * @param[in] timestampEpochMs - time of the reading in ms since epoch
+     * @return true
+     * @return false
+     */
+    bool updateMetricValue(const string& mrdNamespace, const string& key,
+                           const MetricValue& value, const uint64_t timestamp,
+                           const uint64_t timestampEpochMs)
+    {
+        EntryHandle handle;
+        return updateMetricValue(mrdNamespace, handle, key, value, timestamp,
+                                 timestampEpochMs);
+    }
+
+    /**
+     * @brief update value and timestamp of the object referenced by handle
+     * with the raw reading. The object is only searched by key when the
+     * handle no longer resolves, handle is then refreshed.
+     *
+     * @param[in] mrdNamespace - shared memory namespace
+     * @param[in,out] handle - handle returned by insert
+     * @param[in] key - shared memory key
+     * @param[in] value - reading in its D-Bus type
+     * @param[in] timestamp - timestamp in epoch.
+     * @param[in] timestampEpochMs - time of the reading in ms since epoch
+     * @return true
+     * @return false
+     */
+    bool updateMetricValue(const string& mrdNamespace, EntryHandle& handle,
+                           const string& key, const MetricValue& value,
+                           const uint64_t timestamp,
+                           const uint64_t timestampEpochMs)
+    {
+        try
+        {
+            auto itr = sensor_map.find(mrdNamespace);
+            if (itr != sensor_map.end())
+            {
+                if (!((*itr).second->updateMetricValue(
+                        handle, key, value, timestamp, timestampEpochMs)))
+                {
+                    string errorMessage =
+                        "SHMEMDEBUG: Invalid shared memory key: " + key;
+                    LOG_ERROR(errorMessage);
+                    return false;
+                }
+                return true;
+            }
+            else
+            {
+                string errorMessage =
+                    "SHMEMDEBUG: ShmSensorMapIntf updateMetricValue unknown name space: " +
+                    mrdNamespace;
+                LOG_ERROR(errorMessage);
+                return false;
+            }
+        }
+        catch (const exception& e)
+        {
+            lg2::error("SHMEMDEBUG: ShmSensorMapIntf updateMetricValue "
+                       "Exception: {SHM_EXCEPTION}",
+                       "SHM_EXCEPTION", e.what());
+            return false;
+        }
+    }
+
     /**
      * @brief erase key in shared memory
      *
@@ -295,6 +387,134 @@ class ShmSensorMapIntf
         }
     }
 
+    /**
+     * @brief Apply inserts, updates and erases to a namespace in a single
+     * lock hold. Readers see either none or all of them.
+     *
+     * @param[in] mrdNamespace - shared memory namespace
+     * @param[in,out] ops - operations, applied is set on each of them
+     * @return true
+     * @return false
+     */
+    bool applyBatch(const string& mrdNamespace, span<SensorBatchOp> ops)
+    {
+        try
+        {
+            auto itr = sensor_map.find(mrdNamespace);
+            if (itr != sensor_map.end())
+            {
+                (*itr).second->applyBatch(ops);
+                return true;
+            }
+            else
+            {
+                string errorMessage =
+                    "SHMEMDEBUG: ShmSensorMapIntf applyBatch unknown name space: " +
+                    mrdNamespace;
+                LOG_ERROR(errorMessage);
+                return false;
+            }
+        }
+        catch (const exception& e)
+        {
+            lg2::error("SHMEMDEBUG: ShmSensorMapIntf applyBatch Exception: "
+                       "{SHM_EXCEPTION}",
+                       "SHM_EXCEPTION", e.what());
+            return false;
+        }
+    }
+
+    /**
+     * @brief Publish pending updates of all snapshot mode namespaces. Live
+     * namespaces are skipped.
+     *
+     * @return true
+     * @return false
+     */
+    bool publish()
+    {
+        bool status = true;
+        for (auto& [nameSpace, map] : sensor_map)
+        {
+            try
+            {
+                map->publish();
+            }
+            catch (const exception& e)
+            {
+                lg2::error("SHMEMDEBUG: ShmSensorMapIntf publish Exception for "
+                           "{SHM_NAMESPACE}: {SHM_EXCEPTION}",
+                           "SHM_NAMESPACE", nameSpace, "SHM_EXCEPTION",
+                           e.what());
+                status = false;
+            }
+        }
+        return status;
+    }
+
+    /**
+     * @brief Apply the structural changes deferred while readers were walking
+     * the namespaces, so that inserted objects become visible. Waits for the
+     * readers however long they take.
+     *
+     * @return true
+     * @return false
+     */
+    bool flushDeferred()
+    {
+        bool status = true;
+        for (auto& [nameSpace, map] : sensor_map)
+        {
+            try
+            {
+                map->flushDeferred();
+            }
+            catch (const exception& e)
+            {
+                lg2::error("SHMEMDEBUG: ShmSensorMapIntf flushDeferred "
+                           "Exception for {SHM_NAMESPACE}: {SHM_EXCEPTION}",
+                           "SHM_NAMESPACE", nameSpace, "SHM_EXCEPTION",
+                           e.what());
+                status = false;
+            }
+        }
+        return status;
+    }
+
+    /**
+     * @brief Remove the objects restored by a warm restart that were not
+     * updated since, from all namespaces.
+     *
+     * @return true
+     * @return false
+     */
+    bool eraseStale()
+    {
+        bool status = true;
+        for (auto& [nameSpace, map] : sensor_map)
+        {
+            try
+            {
+                size_t erased = map->eraseStale();
+                if (erased > 0)
+                {
+                    lg2::info("SHMEMDEBUG: Removed {COUNT} stale objects from "
+                              "{SHM_NAMESPACE}",
+                              "COUNT", erased, "SHM_NAMESPACE", nameSpace);
+                }
+            }
+            catch (const exception& e)
+            {
+                lg2::error("SHMEMDEBUG: ShmSensorMapIntf eraseStale Exception "
+                           "for {SHM_NAMESPACE}: {SHM_EXCEPTION}",
+                           "SHM_NAMESPACE", nameSpace, "SHM_EXCEPTION",
+                           e.what());
+                status = false;
+            }
+        }
+        return status;
+    }
+
   private:
     unordered_map<string, unique_ptr<sensor_map_type>> sensor_map;
 };
@@ -0,0 +1,177 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "shmem_string_table.hpp"
+
+#include <shm_common.h>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/map.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/** @brief Number of buckets a window is divided into. The window slides by
+ * one bucket, so it covers between aggregateBuckets - 1 and aggregateBuckets
+ * buckets worth of time. */
+constexpr uint32_t aggregateBuckets = 8;
+
+/**
+ * @brief Minimum, maximum, average and rate of the numeric samples of one
+ * entry over a sliding time window.
+ *
+ * @details The window is divided into aggregateBuckets buckets by sample
+ * timestamp. A sample only updates the bucket of its timestamp, resetting it
+ * when it last held an older period, so an update is O(1) and a read folds
+ * the buckets of the window. The rate treats the samples as a counter: a
+ * decrease is taken as a counter reset, like Redfish counters of a device that
+ * restarted. Readers copy the struct under version with readVersioned.
+ */
+class WindowAggregates
+{
+  public:
+    /** @brief Ctor
+     *  @param[in] windowMs - length of the window
+     */
+    explicit WindowAggregates(uint64_t windowMs) :
+        bucketMs(max<uint64_t>(windowMs / aggregateBuckets, 1))
+    {}
+
+    /** @brief Version of the read protocol, held by the writer of add */
+    atomic<uint32_t> version{0};
+
+    /** @brief Add a sample. Must be called with version held. */
+    void add(uint64_t timestampMs, double value)
+    {
+        uint64_t start = timestampMs - timestampMs % bucketMs;
+        auto& bucket = buckets[(timestampMs / bucketMs) % aggregateBuckets];
+        if (bucket.count != 0 && bucket.startMs > start)
+        {
+            // Older than the window, the slot was reused since
+            return;
+        }
+        double increase = 0;
+        uint64_t previousMs = timestampMs;
+        if (hasLast && timestampMs > lastMs)
+        {
+            increase = (value >= lastValue) ? value - lastValue : value;
+            previousMs = lastMs;
+        }
+        if (bucket.count == 0 || bucket.startMs != start)
+        {
+            bucket = {start, value, value, 0, 0, 0, previousMs};
+        }
+        bucket.min = min(bucket.min, value);
+        bucket.max = max(bucket.max, value);
+        bucket.sum += value;
+        bucket.count++;
+        bucket.increase += increase;
+        if (!hasLast || timestampMs >= lastMs)
+        {
+            lastMs = timestampMs;
+            lastValue = value;
+            hasLast = true;
+        }
+    }
+
+    /** @brief Fold the buckets of the window ending at the last sample
+     *  @return aggregates, samples is 0 when there is none
+     */
+    MetricAggregates aggregate() const
+    {
+        MetricAggregates result{};
+        result.windowMs = bucketMs * aggregateBuckets;
+        if (!hasLast)
+        {
+            return result;
+        }
+        uint64_t lastStart = lastMs - lastMs % bucketMs;
+        uint64_t windowStart =
+            (lastStart >= result.windowMs - bucketMs)
+                ? lastStart - (result.windowMs - bucketMs)
+                : 0;
+        double sum = 0;
+        double increase = 0;
+        uint64_t firstMs = lastMs;
+        for (const auto& bucket : buckets)
+        {
+            if (bucket.count == 0 || bucket.startMs < windowStart ||
+                bucket.startMs > lastStart)
+            {
+                continue;
+            }
+            result.minimum = result.samples ? min(result.minimum, bucket.min)
+                                            : bucket.min;
+            result.maximum = result.samples ? max(result.maximum, bucket.max)
+                                            : bucket.max;
+            result.samples += bucket.count;
+            sum += bucket.sum;
+            increase += bucket.increase;
+            firstMs = min(firstMs, bucket.previousMs);
+        }
+        if (result.samples != 0)
+        {
+            result.average = sum / result.samples;
+        }
+        if (lastMs > firstMs)
+        {
+            result.ratePerSecond = increase * 1000.0 / (lastMs - firstMs);
+        }
+        return result;
+    }
+
+  private:
+    struct Bucket
+    {
+        uint64_t startMs;
+        double min;
+        double max;
+        double sum;
+        uint32_t count;
+        /** Counter increase since the sample before each sample */
+        double increase;
+        /** Timestamp of the sample before the first sample of the bucket */
+        uint64_t previousMs;
+    };
+
+    uint64_t bucketMs;
+    uint64_t lastMs = 0;
+    double lastValue = 0;
+    bool hasLast = false;
+    array<Bucket, aggregateBuckets> buckets{};
+};
+
+/** @brief Window aggregates of the entries of a namespace by key */
+using SensorAggregateMap = boost::interprocess::map<
+    char_string_t, WindowAggregates, StringViewLess,
+    boost::interprocess::allocator<pair<const char_string_t, WindowAggregates>,
+                                   segment_manager_t>>;
+
+} // namespace shmem
+} // namespace nv
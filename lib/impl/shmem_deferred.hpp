@@ -0,0 +1,153 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/**
+ * @brief Structural changes a producer deferred because readers were walking
+ * the map, applied in order by the next structural writer.
+ *
+ * @details Process local, the readers never see it. Op is a change with a
+ * key member. The last change of each key can be looked up, so that a value
+ * update of a key with a deferred change is folded into it instead of being
+ * applied to the map before it. A deferred clear drops the changes queued
+ * before it.
+ */
+template <class Op>
+class DeferredChanges
+{
+  public:
+    /** @brief True if nothing is deferred. Lock free, for the hot path. */
+    bool empty() const
+    {
+        return !pending.load(memory_order_acquire);
+    }
+
+    /** @brief Defer a change after the ones already queued
+     *  @param[in] op - change
+     */
+    void push(Op op)
+    {
+        scoped_lock lock(changesLock);
+        last[op.key] = ops.size();
+        ops.push_back(std::move(op));
+        pending.store(true, memory_order_release);
+    }
+
+    /** @brief Defer changes that are applied together, in the same call of
+     * apply
+     *  @param[in] batch - changes, in order
+     */
+    void push(span<Op> batch)
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+        scoped_lock lock(changesLock);
+        for (auto& op : batch)
+        {
+            last[op.key] = ops.size();
+            ops.push_back(std::move(op));
+        }
+        pending.store(true, memory_order_release);
+    }
+
+    /** @brief Defer the removal of everything */
+    void pushClear()
+    {
+        scoped_lock lock(changesLock);
+        ops.clear();
+        last.clear();
+        cleared = true;
+        pending.store(true, memory_order_release);
+    }
+
+    /** @brief Call func with the last deferred change of key, under the lock
+     * of the queue. func gets nullptr when the key was removed by a deferred
+     * clear.
+     *  @param[in] key - key of the change
+     *  @param[in] func - callable taking an Op*
+     *  @return False if no deferred change touches key, func is not called
+     */
+    template <typename Func>
+    bool visitLast(const string& key, Func&& func)
+    {
+        scoped_lock lock(changesLock);
+        auto itr = last.find(key);
+        if (itr != last.end())
+        {
+            func(&ops[itr->second]);
+            return true;
+        }
+        if (cleared)
+        {
+            func(static_cast<Op*>(nullptr));
+            return true;
+        }
+        return false;
+    }
+
+    /** @brief Hand the deferred changes to func and empty the queue once it
+     * returns. If func throws the changes stay queued, func must be safe to
+     * run again on them. Must be called by a structural writer.
+     *  @param[in] func - callable taking whether to clear first and the
+     * changes in order
+     */
+    template <typename Func>
+    void apply(Func&& func)
+    {
+        scoped_lock lock(changesLock);
+        if (!pending.load(memory_order_relaxed))
+        {
+            return;
+        }
+        func(cleared, span<Op>(ops));
+        ops.clear();
+        last.clear();
+        cleared = false;
+        pending.store(false, memory_order_release);
+    }
+
+  private:
+    mutex changesLock;
+    vector<Op> ops;
+    /** Index in ops of the last change of each key */
+    unordered_map<string, size_t> last;
+    bool cleared = false;
+    atomic<bool> pending{false};
+};
+
+} // namespace shmem
+} // namespace nv
@@ -0,0 +1,711 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <shm_common.h>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/offset_ptr.hpp>
+
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+struct MapFullException : public runtime_error
+{
+    MapFullException() : runtime_error("Map has reached its capacity") {}
+};
+
+/**
+ * @brief Bounded capacity hash map living in a shared memory segment.
+ *
+ * @details Open addressing with linear probing over an array of slots. A slot
+ * holds the full 64-bit hash of its key next to an offset pointer to the
+ * entry, so a probe compares hashes within the slot array and only follows the
+ * pointer of a matching slot. Deletion shifts the following entries of the
+ * probe run back, there are no tombstones and probe runs never degrade. The
+ * home slot of a key comes from the high bits of its hash, so doubling the
+ * slot count splits every home slot in two adjacent ones.
+ *
+ * The slot array is sized to keep the load factor at or below 3/4 when
+ * maxEntries entries are stored, inserting more throws MapFullException until
+ * grow raises the capacity. The class provides the subset of the map
+ * interface used by Map, it does no locking of its own.
+ *
+ * By default every entry is allocated on its own and iteration follows the
+ * slots. With DenseEntries the entries are taken from one array of maxEntries
+ * entries allocated with the map and iteration walks that array in address
+ * order, so a scan of the whole map reads the entries as one linear stream
+ * instead of jumping across the segment. Key and string data stay out of line.
+ *
+ *  Key: key type, stored in the segment
+ *  T: mapped type, stored in the segment
+ *  Hash: callable returning a uint64_t hash of a Key, must give the same value
+ *  in every process
+ *  KeyEqual: compares stored keys with the keys passed to find
+ *  DenseEntries: allocate the entries from one contiguous array
+ */
+template <class Key, class T, class Hash, class KeyEqual = equal_to<Key>,
+          bool DenseEntries = false>
+class ShmemHashMap
+{
+  public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = pair<const Key, T>;
+    using size_type = size_t;
+
+  private:
+    struct Slot
+    {
+        uint64_t hash;
+        boost::interprocess::offset_ptr<value_type> entry;
+    };
+    /** @brief Entry of the dense array, free ones are chained by next */
+    struct DenseEntry
+    {
+        alignas(value_type) unsigned char storage[sizeof(value_type)];
+        uint32_t next;
+        bool used;
+    };
+    using slot_allocator_t =
+        boost::interprocess::allocator<Slot, segment_manager_t>;
+    using entry_allocator_t =
+        boost::interprocess::allocator<value_type, segment_manager_t>;
+    using dense_allocator_t =
+        boost::interprocess::allocator<DenseEntry, segment_manager_t>;
+    static constexpr uint32_t noEntry = UINT32_MAX;
+
+    /** @brief Iterates the slots, or the dense array with DenseEntries */
+    template <bool IsConst>
+    class Iterator
+    {
+      public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = ShmemHashMap::value_type;
+        using difference_type = ptrdiff_t;
+        using pointer = conditional_t<IsConst, const value_type*, value_type*>;
+        using reference =
+            conditional_t<IsConst, const value_type&, value_type&>;
+        using map_pointer =
+            conditional_t<IsConst, const ShmemHashMap*, ShmemHashMap*>;
+
+        Iterator() = default;
+        Iterator(map_pointer map, size_type index) : map(map), index(index)
+        {
+            skipEmpty();
+        }
+        // iterator converts to const_iterator
+        template <bool OtherConst,
+                  typename = enable_if_t<IsConst && !OtherConst>>
+        Iterator(const Iterator<OtherConst>& other) :
+            map(other.map), index(other.index)
+        {}
+
+        reference operator*() const
+        {
+            return *map->entryAt(index);
+        }
+        pointer operator->() const
+        {
+            return map->entryAt(index);
+        }
+        Iterator& operator++()
+        {
+            ++index;
+            skipEmpty();
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator previous = *this;
+            ++(*this);
+            return previous;
+        }
+        bool operator==(const Iterator& other) const
+        {
+            return index == other.index;
+        }
+
+      private:
+        friend class ShmemHashMap;
+        friend class Iterator<!IsConst>;
+
+        void skipEmpty()
+        {
+            size_type last = map->positions();
+            while (index != last && map->entryAt(index) == nullptr)
+            {
+                ++index;
+            }
+        }
+
+        map_pointer map = nullptr;
+        size_type index = 0;
+    };
+
+  public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    /** @brief Ctor
+     *  @param[in] maxEntries - number of entries the map must be able to hold
+     *  @param[in] alloc - allocator of the segment
+     */
+    ShmemHashMap(size_type maxEntries, const void_allocator_t& alloc) :
+        slotCount(slotsFor(maxEntries)), maxEntries(maxEntries), entryCount(0),
+        allocator(alloc)
+    {
+        slot_allocator_t slotAllocator(allocator);
+        slots = slotAllocator.allocate(slotCount);
+        for (size_type i = 0; i < slotCount; i++)
+        {
+            new (&slots[i]) Slot{0, nullptr};
+        }
+        if constexpr (DenseEntries)
+        {
+            dense_allocator_t denseAllocator(allocator);
+            try
+            {
+                denseEntries = denseAllocator.allocate(maxEntries);
+            }
+            catch (...)
+            {
+                slotAllocator.deallocate(slots, slotCount);
+                throw;
+            }
+            for (size_type i = 0; i < maxEntries; i++)
+            {
+                denseEntries[i].next = (i + 1 < maxEntries)
+                                           ? static_cast<uint32_t>(i + 1)
+                                           : noEntry;
+                denseEntries[i].used = false;
+            }
+            freeEntry = maxEntries ? 0U : noEntry;
+        }
+    }
+
+    ~ShmemHashMap()
+    {
+        clear();
+        slot_allocator_t slotAllocator(allocator);
+        slotAllocator.deallocate(slots, slotCount);
+        if constexpr (DenseEntries)
+        {
+            dense_allocator_t denseAllocator(allocator);
+            denseAllocator.deallocate(denseEntries, maxEntries);
+        }
+    }
+
+    ShmemHashMap(const ShmemHashMap&) = delete;
+    ShmemHashMap& operator=(const ShmemHashMap&) = delete;
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+    iterator end()
+    {
+        return iterator(this, positions());
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(this, positions());
+    }
+
+    size_type size() const
+    {
+        return entryCount;
+    }
+    bool empty() const
+    {
+        return entryCount == 0;
+    }
+    /** @brief Number of entries the map can hold */
+    size_type capacity() const
+    {
+        return maxEntries;
+    }
+
+    /** @brief Number of home slots, the end of a visitBuckets scan */
+    size_type bucketCount() const
+    {
+        return slotCount;
+    }
+
+    /**
+     * @brief Home slot at which to resume a visitBuckets scan stopped at
+     * bucket while the map had buckets home slots. Growing splits every home
+     * slot in order, so the scan goes on without visiting an entry twice.
+     */
+    size_type rescaleBucket(size_type bucket, size_type buckets) const
+    {
+        return (buckets <= slotCount) ? bucket * (slotCount / buckets)
+                                      : bucket / (buckets / slotCount);
+    }
+
+    /**
+     * @brief Visit the entries whose home slot is firstBucket or after, a
+     * range of home slots holding about entries entries. Used to scan the map
+     * in chunks between which entries are inserted and erased.
+     *
+     * @details An entry never moves before its home slot and stays in the
+     * probe run that starts there, so the entries of a range of home slots
+     * are all found between its first slot and the first free slot after it.
+     * A scan resumed at the returned bucket visits every entry present for
+     * its whole duration exactly once, whatever erase shifted meanwhile.
+     *
+     * @param[in] firstBucket - first home slot, 0 to start
+     * @param[in] entries - approximate number of entries to visit
+     * @param[in] visit - callable taking a const value_type&
+     * @return first home slot of the next range, bucketCount() when done
+     */
+    template <class Visitor>
+    size_type visitBuckets(size_type firstBucket, size_type entries,
+                           Visitor&& visit) const
+    {
+        if (firstBucket >= slotCount)
+        {
+            return slotCount;
+        }
+        // Home slots are uniform, size the range for the entries wanted
+        size_type range = max<size_type>(
+            entries * slotCount / max<size_type>(entryCount, 1), 1);
+        size_type lastBucket = (range >= slotCount - firstBucket)
+                                   ? slotCount
+                                   : firstBucket + range;
+        for (size_type step = 0; step < slotCount; step++)
+        {
+            size_type index = (firstBucket + step) & mask();
+            const auto& slot = slots[index];
+            if (slot.entry == nullptr)
+            {
+                if (firstBucket + step >= lastBucket)
+                {
+                    break;
+                }
+                continue;
+            }
+            size_type home = homeSlot(slot.hash, slotCount);
+            if (home >= firstBucket && home < lastBucket)
+            {
+                visit(static_cast<const value_type&>(*slot.entry));
+            }
+        }
+        return lastBucket;
+    }
+
+    /** @brief Look up any key type accepted by Hash and KeyEqual, e.g. a
+     * string_view for a string Key, without constructing a Key
+     */
+    template <class K>
+    iterator find(const K& key)
+    {
+        size_type index = findSlot(key, Hash{}(key));
+        return (slots[index].entry == nullptr) ? end() : iteratorAt(index);
+    }
+    template <class K>
+    const_iterator find(const K& key) const
+    {
+        size_type index = findSlot(key, Hash{}(key));
+        return (slots[index].entry == nullptr) ? end() : iteratorAt(index);
+    }
+
+    /** @brief Insert a copy of value unless its key is already present
+     *  @return iterator to the entry with the key and true if it was inserted
+     *  @throws MapFullException if maxEntries entries are stored
+     */
+    pair<iterator, bool> insert(const value_type& value)
+    {
+        uint64_t hash = Hash{}(value.first);
+        size_type index = findSlot(value.first, hash);
+        if (slots[index].entry != nullptr)
+        {
+            return {iteratorAt(index), false};
+        }
+        if (entryCount >= maxEntries)
+        {
+            throw MapFullException();
+        }
+        slots[index].entry = constructEntry(value);
+        slots[index].hash = hash;
+        entryCount++;
+        return {iteratorAt(index), true};
+    }
+
+    template <class InputIt>
+    void insert(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+        {
+            insert(*first);
+        }
+    }
+
+    /** @brief Remove the entry at pos
+     *  @return iterator to continue a scan from. Without DenseEntries an
+     * entry shifted back across the end of the slot array may be visited a
+     * second time.
+     */
+    iterator erase(const_iterator pos)
+    {
+        size_type index = pos.index;
+        if constexpr (DenseEntries)
+        {
+            index = findSlot(pos->first, Hash{}(pos->first));
+        }
+        destroyEntry(slots[index]);
+        size_type hole = index;
+        for (size_type next = (hole + 1) & mask();
+             slots[next].entry != nullptr; next = (next + 1) & mask())
+        {
+            size_type home = homeSlot(slots[next].hash, slotCount);
+            // An entry whose home slot lies cyclically in (hole, next] is
+            // still reachable and stays, any other moves into the hole.
+            bool reachable = (hole <= next) ? (hole < home && home <= next)
+                                            : (hole < home || home <= next);
+            if (!reachable)
+            {
+                slots[hole] = slots[next];
+                slots[next].entry = nullptr;
+                hole = next;
+            }
+        }
+        entryCount--;
+        // Dense entries never move, the scan continues after the freed one
+        return iterator(this, DenseEntries ? pos.index : index);
+    }
+
+    size_type erase(const Key& key)
+    {
+        auto itr = find(key);
+        if (itr == end())
+        {
+            return 0;
+        }
+        erase(itr);
+        return 1;
+    }
+
+    void clear()
+    {
+        for (size_type i = 0; i < slotCount; i++)
+        {
+            if (slots[i].entry != nullptr)
+            {
+                destroyEntry(slots[i]);
+            }
+        }
+        entryCount = 0;
+    }
+
+    /**
+     * @brief Raise the capacity to newMaxEntries. Must not run next to
+     * readers of the map. Entries allocated on their own keep their address.
+     * Dense entries are copied to a larger array, moved is called with every
+     * old entry and its copy before the old one is destroyed.
+     *
+     * @param[in] newMaxEntries - number of entries the map must be able to
+     * hold, nothing is done if it does not exceed the capacity
+     * @param[in] moved - callable taking the old and the new value_type&
+     * @throws boost::interprocess::bad_alloc if the segment runs out of
+     * memory, the map is left unchanged
+     */
+    template <class Moved>
+    void grow(size_type newMaxEntries, Moved&& moved)
+    {
+        if (newMaxEntries <= maxEntries)
+        {
+            return;
+        }
+        size_type newSlotCount = slotsFor(newMaxEntries);
+        slot_allocator_t slotAllocator(allocator);
+        auto newSlots = slotAllocator.allocate(newSlotCount);
+        for (size_type i = 0; i < newSlotCount; i++)
+        {
+            new (&newSlots[i]) Slot{0, nullptr};
+        }
+        boost::interprocess::offset_ptr<DenseEntry> newDenseEntries;
+        if constexpr (DenseEntries)
+        {
+            try
+            {
+                newDenseEntries = copyDenseEntries(newMaxEntries);
+            }
+            catch (...)
+            {
+                slotAllocator.deallocate(newSlots, newSlotCount);
+                throw;
+            }
+        }
+        // Nothing allocates from here on
+        for (size_type i = 0; i < slotCount; i++)
+        {
+            const auto& slot = slots[i];
+            if (slot.entry == nullptr)
+            {
+                continue;
+            }
+            auto entry = slot.entry;
+            if constexpr (DenseEntries)
+            {
+                entry = reinterpret_cast<value_type*>(
+                    newDenseEntries[denseIndex(slot.entry.get())].storage);
+                moved(static_cast<const value_type&>(*slot.entry), *entry);
+            }
+            size_type index = homeSlot(slot.hash, newSlotCount);
+            while (newSlots[index].entry != nullptr)
+            {
+                index = (index + 1) & (newSlotCount - 1);
+            }
+            newSlots[index] = Slot{slot.hash, entry};
+        }
+        if constexpr (DenseEntries)
+        {
+            for (size_type i = 0; i < maxEntries; i++)
+            {
+                if (denseEntries[i].used)
+                {
+                    reinterpret_cast<value_type*>(denseEntries[i].storage)
+                        ->~value_type();
+                }
+            }
+            dense_allocator_t denseAllocator(allocator);
+            denseAllocator.deallocate(denseEntries, maxEntries);
+            denseEntries = newDenseEntries;
+            // The added entries are chained in front of the free ones
+            freeEntry = static_cast<uint32_t>(maxEntries);
+        }
+        slotAllocator.deallocate(slots, slotCount);
+        slots = newSlots;
+        slotCount = newSlotCount;
+        maxEntries = newMaxEntries;
+    }
+
+  private:
+    /** @brief Slot count keeping the load factor at or below 3/4 */
+    static size_type slotsFor(size_type entries)
+    {
+        return bit_ceil(entries + entries / 3 + 1);
+    }
+
+    /** @brief Home slot of hash among count slots: the high bits of its
+     * Fibonacci product, so that the home slot h of a doubled slot count is
+     * 2h or 2h + 1 */
+    static size_type homeSlot(uint64_t hash, size_type count)
+    {
+        // Shifted twice, a single slot would shift by 64
+        return static_cast<size_type>(
+            ((hash * 0x9E3779B97F4A7C15ULL) >> (63 - countr_zero(count))) >>
+            1);
+    }
+
+    size_type mask() const
+    {
+        return slotCount - 1;
+    }
+
+    /** @brief Copy the dense entries to a new array of newMaxEntries
+     * entries. The entries past the current ones are free and chained to the
+     * current free entries.
+     *  @throws boost::interprocess::bad_alloc, nothing is left allocated
+     */
+    boost::interprocess::offset_ptr<DenseEntry>
+        copyDenseEntries(size_type newMaxEntries)
+    {
+        dense_allocator_t denseAllocator(allocator);
+        auto copy = denseAllocator.allocate(newMaxEntries);
+        size_type copied = 0;
+        try
+        {
+            for (; copied < maxEntries; copied++)
+            {
+                const auto& from = denseEntries[copied];
+                auto& to = copy[copied];
+                to.next = from.next;
+                to.used = from.used;
+                if (from.used)
+                {
+                    new (to.storage) value_type(
+                        *reinterpret_cast<const value_type*>(from.storage));
+                }
+            }
+        }
+        catch (...)
+        {
+            for (size_type i = 0; i < copied; i++)
+            {
+                if (copy[i].used)
+                {
+                    reinterpret_cast<value_type*>(copy[i].storage)
+                        ->~value_type();
+                }
+            }
+            denseAllocator.deallocate(copy, newMaxEntries);
+            throw;
+        }
+        for (size_type i = maxEntries; i < newMaxEntries; i++)
+        {
+            copy[i].next =
+                (i + 1 < newMaxEntries) ? static_cast<uint32_t>(i + 1)
+                                        : freeEntry;
+            copy[i].used = false;
+        }
+        return copy;
+    }
+
+    /** @brief Number of positions an iterator walks */
+    size_type positions() const
+    {
+        return DenseEntries ? maxEntries : slotCount;
+    }
+
+    /** @brief Entry at an iterator position, nullptr if it is empty */
+    value_type* entryAt(size_type index)
+    {
+        if constexpr (DenseEntries)
+        {
+            auto& dense = denseEntries[index];
+            return dense.used ? reinterpret_cast<value_type*>(dense.storage)
+                              : nullptr;
+        }
+        else
+        {
+            return slots[index].entry.get();
+        }
+    }
+    const value_type* entryAt(size_type index) const
+    {
+        return const_cast<ShmemHashMap*>(this)->entryAt(index);
+    }
+
+    /** @brief Iterator to the entry of a slot */
+    iterator iteratorAt(size_type slot)
+    {
+        if constexpr (DenseEntries)
+        {
+            return iterator(this, denseIndex(slots[slot].entry.get()));
+        }
+        else
+        {
+            return iterator(this, slot);
+        }
+    }
+    const_iterator iteratorAt(size_type slot) const
+    {
+        return const_cast<ShmemHashMap*>(this)->iteratorAt(slot);
+    }
+
+    size_type denseIndex(const value_type* entry) const
+    {
+        return static_cast<size_type>(
+            reinterpret_cast<const DenseEntry*>(entry) - denseEntries.get());
+    }
+
+    /** @brief Probe for key. The load factor limit guarantees a free slot.
+     *  @return index of the slot holding key, or of the free slot ending the
+     * probe run
+     */
+    template <class K>
+    size_type findSlot(const K& key, uint64_t hash) const
+    {
+        size_type index = homeSlot(hash, slotCount);
+        while (slots[index].entry != nullptr &&
+               (slots[index].hash != hash ||
+                !KeyEqual{}(slots[index].entry->first, key)))
+        {
+            index = (index + 1) & mask();
+        }
+        return index;
+    }
+
+    boost::interprocess::offset_ptr<value_type>
+        constructEntry(const value_type& value)
+    {
+        if constexpr (DenseEntries)
+        {
+            // The entry count check guarantees a free entry
+            auto& dense = denseEntries[freeEntry];
+            auto* entry = new (dense.storage) value_type(value);
+            freeEntry = dense.next;
+            dense.used = true;
+            return entry;
+        }
+        else
+        {
+            entry_allocator_t entryAllocator(allocator);
+            auto entry = entryAllocator.allocate(1);
+            try
+            {
+                new (entry.get()) value_type(value);
+            }
+            catch (...)
+            {
+                entryAllocator.deallocate(entry, 1);
+                throw;
+            }
+            return entry;
+        }
+    }
+
+    void destroyEntry(Slot& slot)
+    {
+        slot.entry->~value_type();
+        if constexpr (DenseEntries)
+        {
+            size_type index = denseIndex(slot.entry.get());
+            denseEntries[index].used = false;
+            denseEntries[index].next = freeEntry;
+            freeEntry = static_cast<uint32_t>(index);
+        }
+        else
+        {
+            entry_allocator_t entryAllocator(allocator);
+            entryAllocator.deallocate(slot.entry, 1);
+        }
+        slot.entry = nullptr;
+    }
+
+    size_type slotCount;
+    size_type maxEntries;
+    size_type entryCount;
+    void_allocator_t allocator;
+    boost::interprocess::offset_ptr<Slot> slots;
+    /** @brief Entries with DenseEntries, free ones chained from freeEntry */
+    boost::interprocess::offset_ptr<DenseEntry> denseEntries;
+    uint32_t freeEntry = noEntry;
+};
+
+} // namespace shmem
+} // namespace nv
@@ -0,0 +1,164 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "gorilla_codec.hpp"
+#include "shmem_string_table.hpp"
+
+#include <shm_common.h>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/map.hpp>
+#include <boost/interprocess/containers/vector.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/** @brief Number of blocks of a SampleHistory. When the newest block is full
+ * the oldest one is reused, the others keep the requested samples. */
+constexpr uint32_t historyBlocks = 4;
+
+/** @brief Encoded bytes budgeted per sample. A block that runs out of bytes
+ * before it holds its share of samples is closed early. */
+constexpr uint32_t historyBytesPerSample = 3;
+
+/**
+ * @brief Recent numeric samples of one entry, Gorilla compressed.
+ *
+ * @details The samples are appended to a ring of historyBlocks blocks. A block
+ * holds up to samplesPerBlock samples, so that the other blocks together keep
+ * at least the requested number of samples as long as they compress to
+ * historyBytesPerSample bytes. Readers copy the blocks under version, with
+ * readVersioned, and decode their copy.
+ */
+class SampleHistory
+{
+  public:
+    using byte_allocator_t =
+        boost::interprocess::allocator<uint8_t, segment_manager_t>;
+
+    /** @brief Ctor
+     *  @param[in] samples - number of samples to keep
+     *  @param[in] alloc - segment allocator
+     */
+    SampleHistory(uint32_t samples, const void_allocator_t& alloc) :
+        samplesPerBlock(max<uint32_t>(
+            (samples + historyBlocks - 2) / (historyBlocks - 1), 1U)),
+        blockBytes(16U + samplesPerBlock * historyBytesPerSample),
+        data(historyBlocks * blockBytes, 0, alloc)
+    {}
+
+    /** @brief Version of the read protocol, held by the writer of append */
+    atomic<uint32_t> version{0};
+
+    /** @brief Append a sample, dropping the oldest block if needed. Must be
+     * called with version held. */
+    void append(uint64_t timestampMs, double value)
+    {
+        if (states[head].count < samplesPerBlock &&
+            gorillaAppend(states[head], block(head), timestampMs, value))
+        {
+            return;
+        }
+        head = (head + 1) % historyBlocks;
+        states[head] = {};
+        gorillaAppend(states[head], block(head), timestampMs, value);
+    }
+
+    /** @brief Copy of the blocks taken by a reader */
+    struct Copy
+    {
+        uint32_t head;
+        uint32_t blockBytes;
+        array<GorillaState, historyBlocks> states;
+        std::vector<uint8_t> data;
+    };
+
+    /** @brief Copy the blocks out of the segment. Must be run by
+     * readVersioned, a torn copy is detected by decode. */
+    void copy(Copy& dst) const
+    {
+        dst.head = head;
+        dst.blockBytes = blockBytes;
+        dst.states = states;
+        dst.data.assign(data.begin(), data.end());
+    }
+
+    /** @brief Decode the samples of a copy newer than sinceMs, oldest first
+     *  @param[in] src - consistent copy
+     *  @param[in] sinceMs - timestamp of the last sample already known
+     *  @param[out] samples - decoded samples
+     */
+    static void decode(const Copy& src, uint64_t sinceMs,
+                       std::vector<HistorySample>& samples)
+    {
+        for (uint32_t i = 1; i <= historyBlocks; i++)
+        {
+            uint32_t index = (src.head + i) % historyBlocks;
+            const auto& state = src.states[index];
+            if (state.count == 0 || state.lastTimestamp <= sinceMs ||
+                src.data.size() < (index + 1) * src.blockBytes)
+            {
+                continue;
+            }
+            span<const uint8_t> encoded(src.data.data() +
+                                            index * src.blockBytes,
+                                        src.blockBytes);
+            gorillaDecode(encoded, state,
+                          [&](uint64_t timestamp, double value) {
+                              if (timestamp > sinceMs)
+                              {
+                                  samples.push_back({timestamp, value});
+                              }
+                          });
+        }
+    }
+
+  private:
+    span<uint8_t> block(uint32_t index)
+    {
+        return span<uint8_t>(data.data() + index * blockBytes, blockBytes);
+    }
+
+    uint32_t samplesPerBlock;
+    uint32_t blockBytes;
+    /** Block appended to */
+    uint32_t head = 0;
+    array<GorillaState, historyBlocks> states{};
+    boost::interprocess::vector<uint8_t, byte_allocator_t> data;
+};
+
+/** @brief Histories of the entries of a namespace by key */
+using SensorHistoryMap = boost::interprocess::map<
+    char_string_t, SampleHistory, StringViewLess,
+    boost::interprocess::allocator<pair<const char_string_t, SampleHistory>,
+                                   segment_manager_t>>;
+
+} // namespace shmem
+} // namespace nv
@@ -0,0 +1,417 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "shmem_string_table.hpp"
+
+#include <shm_common.h>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/set.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/offset_ptr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/** @brief Key of the records of a ChangeJournal. The live entry of the key
+ * holds it, so value updates record it without a lookup. A key no entry
+ * holds is dropped once the ring overwrote its last record. */
+struct JournalKey
+{
+    JournalKey(string_view str, const void_allocator_t& alloc) :
+        key(str.data(), str.size(), alloc)
+    {}
+
+    char_string_t key;
+    /* Entries holding the key, changed by structural writers only */
+    mutable uint32_t holders = 0;
+    /* Position of the last record of the key */
+    mutable atomic<uint64_t> lastPosition{0};
+    /* Neighbours in the list of the keys no entry holds */
+    mutable boost::interprocess::offset_ptr<const JournalKey> prev;
+    mutable boost::interprocess::offset_ptr<const JournalKey> next;
+};
+
+using journal_key_ptr_t = boost::interprocess::offset_ptr<const JournalKey>;
+
+/** @brief Orders journal keys and allows lookups by string_view */
+struct JournalKeyLess
+{
+    using is_transparent = void;
+
+    static string_view view(const JournalKey& key)
+    {
+        return StringViewLess::view(key.key);
+    }
+    static string_view view(string_view str)
+    {
+        return str;
+    }
+
+    template <class L, class R>
+    bool operator()(const L& lhs, const R& rhs) const
+    {
+        return view(lhs) < view(rhs);
+    }
+};
+
+/** @brief Slot of a ChangeJournal. sequence is 2 * position + 1 while the
+ * record of position is written and 2 * position + 2 once it is complete. */
+struct JournalSlot
+{
+    atomic<uint64_t> sequence{0};
+    uint64_t generation = 0;
+    uint64_t timestampMs = 0;
+    ChangeKind kind = ChangeKind::reset;
+    /* In the key table of the journal, null for a reset */
+    journal_key_ptr_t key;
+};
+
+/**
+ * @brief Bounded ring of the changes of a namespace, appended by the
+ * producer and tailed by any number of readers.
+ *
+ * @details Producer threads claim a position by incrementing head and write
+ * the record in the slot of the position under its sequence, so appends take
+ * no lock. Readers keep their own position: a slot whose sequence is below
+ * the expected one is not written yet, a slot whose sequence is above it was
+ * overwritten by a later lap and the reader must resync.
+ *
+ * Records point to their key in a key table of the journal rather than
+ * holding a copy, so keys of any length fit a record. Keys that no entry
+ * holds are kept in a list in the order they were last recorded, structural
+ * writers drop them from its front once the ring overwrote their last
+ * record. Readers copy keys registered, so no key is dropped meanwhile.
+ */
+class ChangeJournal
+{
+  public:
+    using slot_allocator_t =
+        boost::interprocess::allocator<JournalSlot, segment_manager_t>;
+
+    /** @brief Ctor
+     *  @param[in] capacity - number of records kept
+     *  @param[in] alloc - segment allocator
+     */
+    ChangeJournal(uint32_t capacity, const void_allocator_t& alloc) :
+        capacity(max<uint32_t>(capacity, 1)), allocator(alloc),
+        keys(JournalKeyLess(), alloc)
+    {
+        slot_allocator_t slotAllocator(allocator);
+        slots = slotAllocator.allocate(this->capacity);
+        for (uint32_t i = 0; i < this->capacity; i++)
+        {
+            new (&slots[i]) JournalSlot();
+        }
+    }
+
+    ~ChangeJournal()
+    {
+        slot_allocator_t slotAllocator(allocator);
+        slotAllocator.deallocate(slots, capacity);
+    }
+
+    ChangeJournal(const ChangeJournal&) = delete;
+    ChangeJournal& operator=(const ChangeJournal&) = delete;
+
+    /** @brief Append a record, overwriting the oldest one. Adds key to the
+     * key table, so must be called by a structural writer.
+     *  @param[in] kind - kind of the change
+     *  @param[in] key - key of the changed object, empty for a reset
+     *  @param[in] generation - generation of the change
+     *  @param[in] timestampMs - time of the change
+     */
+    void append(ChangeKind kind, string_view key, uint64_t generation,
+                uint64_t timestampMs)
+    {
+        const JournalKey* storedKey = nullptr;
+        if (!key.empty())
+        {
+            try
+            {
+                storedKey = findOrAddKey(key);
+            }
+            catch (const boost::interprocess::bad_alloc&)
+            {
+                // Readers can not name the object, they rescan instead
+                kind = ChangeKind::reset;
+            }
+        }
+        appendRecord(kind, storedKey, generation, timestampMs);
+        if (storedKey != nullptr && storedKey->holders == 0)
+        {
+            // Now the last unused key to be overwritten
+            unlinkUnused(*storedKey);
+            linkUnused(*storedKey);
+        }
+        dropOverwrittenKeys();
+    }
+
+    /** @brief Append the record of a value update, which may run next to
+     * other value updates and so does not touch the key table.
+     *  @param[in] key - key held by the updated entry, null if it has none
+     *  @param[in] generation - generation of the change
+     *  @param[in] timestampMs - time of the change
+     */
+    void appendUpdate(journal_key_ptr_t key, uint64_t generation,
+                      uint64_t timestampMs)
+    {
+        appendRecord(key ? ChangeKind::upsert : ChangeKind::reset, key.get(),
+                     generation, timestampMs);
+    }
+
+    /** @brief Get the key of an entry, held until releaseKey. Must be called
+     * by a structural writer.
+     *  @param[in] key - key of the entry
+     *  @return key in the key table, null if the segment is full
+     */
+    journal_key_ptr_t acquireKey(string_view key)
+    {
+        try
+        {
+            const JournalKey* storedKey = findOrAddKey(key);
+            if (storedKey->holders++ == 0)
+            {
+                unlinkUnused(*storedKey);
+            }
+            return storedKey;
+        }
+        catch (const boost::interprocess::bad_alloc&)
+        {
+            // The updates of the entry are recorded as resets
+            return nullptr;
+        }
+    }
+
+    /** @brief Release the key of a removed entry. It is dropped once the
+     * ring overwrote its records. Must be called by a structural writer.
+     *  @param[in] key - key returned by acquireKey
+     */
+    void releaseKey(journal_key_ptr_t key)
+    {
+        if (--key->holders == 0)
+        {
+            linkUnused(*key);
+        }
+    }
+
+    /** @brief Drop every record and key, e.g. when the entries holding the
+     * keys were dropped. Must be called by a structural writer. */
+    void clear()
+    {
+        skip();
+        for (uint32_t i = 0; i < capacity; i++)
+        {
+            slots[i].key = nullptr;
+        }
+        unusedFront = nullptr;
+        unusedBack = nullptr;
+        keys.clear();
+    }
+
+    /** @brief Skip every record a reader may still expect, e.g. after a
+     * producer left a record half written. Readers behind resync. */
+    void skip()
+    {
+        head.fetch_add(capacity, memory_order_acq_rel);
+    }
+
+    /** @brief Position of the next record */
+    uint64_t end() const
+    {
+        return head.load(memory_order_acquire);
+    }
+
+    /** @brief Number of keys in the key table */
+    size_t keyCount() const
+    {
+        return keys.size();
+    }
+
+    /** @brief Read the records from position on. Must be called registered
+     * as a reader, so that the keys are not dropped while they are copied.
+     *  @param[in,out] position - position of the next record to read
+     *  @param[in] maxRecords - most records returned, 0 for no limit
+     *  @param[out] records - records read
+     *  @return False if the reader fell behind or read a reset, it must then
+     * resync and restart from end()
+     */
+    bool read(uint64_t& position, size_t maxRecords,
+              vector<ChangeRecord>& records) const
+    {
+        uint64_t last = end();
+        if (position > last || last - position > capacity)
+        {
+            return false;
+        }
+        for (; position < last; position++)
+        {
+            if (maxRecords != 0 && records.size() >= maxRecords)
+            {
+                break;
+            }
+            const auto& slot = slots[position % capacity];
+            uint64_t expected = 2 * position + 2;
+            uint64_t sequence = slot.sequence.load(memory_order_acquire);
+            if (sequence < expected)
+            {
+                // Claimed but not written yet
+                break;
+            }
+            journal_key_ptr_t key = slot.key;
+            ChangeRecord record{{}, slot.kind, slot.generation,
+                                slot.timestampMs};
+            atomic_thread_fence(memory_order_acquire);
+            if (sequence != expected ||
+                slot.sequence.load(memory_order_relaxed) != expected ||
+                record.kind == ChangeKind::reset || key == nullptr)
+            {
+                return false;
+            }
+            // Keys never change, only the pointer needed the check
+            record.key.assign(key->key.data(), key->key.size());
+            records.emplace_back(std::move(record));
+        }
+        return true;
+    }
+
+  private:
+    /** @brief Claim the next position and write a record to its slot */
+    void appendRecord(ChangeKind kind, const JournalKey* key,
+                      uint64_t generation, uint64_t timestampMs)
+    {
+        uint64_t position = head.fetch_add(1, memory_order_acq_rel);
+        auto& slot = slots[position % capacity];
+        slot.sequence.store(2 * position + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        slot.generation = generation;
+        slot.timestampMs = timestampMs;
+        slot.kind = kind;
+        slot.key = key;
+        slot.sequence.store(2 * position + 2, memory_order_release);
+        if (key != nullptr)
+        {
+            // Updates of the key may record it next to each other
+            uint64_t last = key->lastPosition.load(memory_order_relaxed);
+            while (last < position &&
+                   !key->lastPosition.compare_exchange_weak(
+                       last, position, memory_order_relaxed))
+            {}
+        }
+    }
+
+    /** @brief Find key in the key table, adding it unused if it is missing
+     */
+    const JournalKey* findOrAddKey(string_view key)
+    {
+        auto itr = keys.find(key);
+        if (itr == keys.end())
+        {
+            itr = keys.emplace(key, allocator).first;
+            linkUnused(*itr);
+        }
+        return &*itr;
+    }
+
+    /** @brief Add key to the back of the unused keys */
+    void linkUnused(const JournalKey& key)
+    {
+        key.prev = unusedBack;
+        key.next = nullptr;
+        if (unusedBack != nullptr)
+        {
+            unusedBack->next = &key;
+        }
+        else
+        {
+            unusedFront = &key;
+        }
+        unusedBack = &key;
+    }
+
+    /** @brief Remove key from the unused keys */
+    void unlinkUnused(const JournalKey& key)
+    {
+        if (key.prev != nullptr)
+        {
+            key.prev->next = key.next;
+        }
+        else
+        {
+            unusedFront = key.next;
+        }
+        if (key.next != nullptr)
+        {
+            key.next->prev = key.prev;
+        }
+        else
+        {
+            unusedBack = key.prev;
+        }
+        key.prev = nullptr;
+        key.next = nullptr;
+    }
+
+    /** @brief Drop the unused keys whose last record was overwritten. Keys
+     * are linked after their last record was appended, so stopping at the
+     * first key still recorded keeps the others for at most one more lap.
+     */
+    void dropOverwrittenKeys()
+    {
+        uint64_t last = end();
+        while (unusedFront != nullptr &&
+               unusedFront->lastPosition.load(memory_order_relaxed) +
+                       capacity <
+                   last)
+        {
+            const JournalKey& key = *unusedFront;
+            unlinkUnused(key);
+            keys.erase(keys.find(JournalKeyLess::view(key)));
+        }
+    }
+
+    using key_allocator_t =
+        boost::interprocess::allocator<JournalKey, segment_manager_t>;
+
+    atomic<uint64_t> head{0};
+    uint32_t capacity;
+    void_allocator_t allocator;
+    boost::interprocess::offset_ptr<JournalSlot> slots;
+    /** Keys of the records, written by structural writers only */
+    boost::interprocess::set<JournalKey, JournalKeyLess, key_allocator_t>
+        keys;
+    /** Keys no entry holds, in the order their last record was appended */
+    journal_key_ptr_t unusedFront;
+    journal_key_ptr_t unusedBack;
+};
+
+} // namespace shmem
+} // namespace nv
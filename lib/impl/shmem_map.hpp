@@ -16,13 +16,30 @@
  */
 
 #pragma once
+#include "error_logger.hpp"
 #include "managed_shmem.hpp"
+#include "shmem_aggregates.hpp"
+#include "shmem_deferred.hpp"
+#include "shmem_hash_map.hpp"
+#include "shmem_history.hpp"
+#include "shmem_journal.hpp"
+#include "shmem_string_table.hpp"
 
 #include <shm_common.h>
 
 #include <boost/interprocess/containers/map.hpp>
+#include <boost/unordered_map.hpp>
+#include <utils/time_utils.hpp>
 
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
 using namespace std;
@@ -37,9 +54,243 @@ using map_value_type_t = pair<const char_string_t, SensorMapValue>;
 using map_value_type_allocator_t =
     boost::interprocess::allocator<map_value_type_t, segment_manager_t>;
 using SensorMap =
-    boost::interprocess::map<char_string_t, SensorMapValue, less<char_string_t>,
+    boost::interprocess::map<char_string_t, SensorMapValue, StringViewLess,
                              map_value_type_allocator_t>;
 
+/** @brief Process independent hash of a key stored in the segment, or of a
+ * string_view looked up in it */
+struct CharStringHash
+{
+    uint64_t operator()(const char_string_t& key) const
+    {
+        return hashString(string_view(key.data(), key.size()));
+    }
+    uint64_t operator()(string_view key) const
+    {
+        return hashString(key);
+    }
+};
+
+using SensorHashMap = ShmemHashMap<char_string_t, SensorMapValue,
+                                   CharStringHash, StringViewEqual>;
+
+/** @brief Process independent hash of a metric property URI, the same for
+ * the whole URI and for the interned parts it was split into */
+struct MetricPropertyHash
+{
+    uint64_t operator()(const metric_property_parts_t& parts) const
+    {
+        return hash(MetricPropertyEqual::view(parts));
+    }
+    uint64_t operator()(string_view uri) const
+    {
+        return hash(splitMetricProperty(uri));
+    }
+
+  private:
+    static uint64_t hash(pair<string_view, string_view> parts)
+    {
+        return hashString(parts.second, hashString(parts.first));
+    }
+};
+
+/**
+ * @brief Secondary index from the metric property URI of the entries of a map
+ * to the entries. Several entries may share a URI.
+ *
+ * @details Hashed on the interned URI parts, a lookup is one probe and
+ * follows the pointer straight to the entry. Entries only move when the
+ * capacity of a dense map grows, the index entries are then pointed to the
+ * copies. The index belongs to one map buffer and is modified together with it
+ * by structural writers, readers look it up under the same protection as the
+ * map.
+ */
+using MetricPropertyIndex = boost::unordered_multimap<
+    metric_property_parts_t,
+    boost::interprocess::offset_ptr<const map_value_type_t>,
+    MetricPropertyHash, MetricPropertyEqual,
+    boost::interprocess::allocator<
+        pair<const metric_property_parts_t,
+             boost::interprocess::offset_ptr<const map_value_type_t>>,
+        segment_manager_t>>;
+
+/** @brief Hash map keeping its entries in one contiguous array, so full
+ * namespace scans stream through memory */
+using SensorDenseMap = ShmemHashMap<char_string_t, SensorMapValue,
+                                    CharStringHash, StringViewEqual, true>;
+
+/** @brief Map type used by producers and readers of the sensor namespaces.
+ * Selected at build time with the shmem-hash-map and shmem-dense-entries
+ * options, both sides must agree. */
+#if defined(SHMEM_HASH_MAP) && defined(SHMEM_DENSE_ENTRIES)
+using SensorMapType = SensorDenseMap;
+#elif defined(SHMEM_HASH_MAP)
+using SensorMapType = SensorHashMap;
+#else
+using SensorMapType = SensorMap;
+#endif
+
+/** @brief Segment footprint of an entry assumed when sizing a hash map from
+ * the segment size: the node, its key and strings and the allocator overhead.
+ */
+constexpr size_t hashMapBytesPerEntry = 256;
+
+/** @brief Segment footprint of an entry assumed when sizing a dense hash map.
+ * Its entry array is reserved up front for every buffer, so more room is left
+ * for the keys and strings allocated next to it. */
+constexpr size_t denseMapBytesPerEntry = 512;
+
+/** @brief Objects copied per registered read by Map::visitValues */
+constexpr size_t visitChunkEntries = 64;
+
+/** @brief How Map constructs and identifies each MapType */
+template <class MapType>
+struct MapTypeTraits;
+
+template <>
+struct MapTypeTraits<SensorMap>
+{
+    static constexpr string_view name = "SensorMap";
+    static size_t defaultMaxEntries(size_t /*maxSize*/, size_t /*buffers*/)
+    {
+        return 0;
+    }
+    static SensorMap*
+        construct(boost::interprocess::managed_shared_memory& memory,
+                  const char* mapName, size_t /*maxEntries*/,
+                  const void_allocator_t& allocator)
+    {
+        return memory.construct<SensorMap>(mapName)(StringViewLess(),
+                                                    allocator);
+    }
+};
+
+template <>
+struct MapTypeTraits<SensorHashMap>
+{
+    static constexpr string_view name = "SensorHashMap";
+    static size_t defaultMaxEntries(size_t maxSize, size_t /*buffers*/)
+    {
+        return maxSize / hashMapBytesPerEntry;
+    }
+    static SensorHashMap*
+        construct(boost::interprocess::managed_shared_memory& memory,
+                  const char* mapName, size_t maxEntries,
+                  const void_allocator_t& allocator)
+    {
+        return memory.construct<SensorHashMap>(mapName)(maxEntries, allocator);
+    }
+};
+
+template <>
+struct MapTypeTraits<SensorDenseMap>
+{
+    static constexpr string_view name = "SensorDenseMap";
+    static size_t defaultMaxEntries(size_t maxSize, size_t buffers)
+    {
+        return maxSize / (buffers * denseMapBytesPerEntry);
+    }
+    static SensorDenseMap*
+        construct(boost::interprocess::managed_shared_memory& memory,
+                  const char* mapName, size_t maxEntries,
+                  const void_allocator_t& allocator)
+    {
+        return memory.construct<SensorDenseMap>(mapName)(maxEntries,
+                                                         allocator);
+    }
+};
+
+/**
+ * @brief Reference to an entry of a producer's map, returned by Map::insert
+ * and kept by the producer to update the entry without looking up its key.
+ *
+ * @details offset is the position of the entry in the segment, per buffer of
+ * a snapshot mode map, 0 while it is not known. Entries only move when the
+ * capacity of a dense map grows, which counts as a removal, so the offset
+ * stays valid as long as no entry of that buffer is removed: generation is
+ * the removal count of the buffer when the offset was taken. Once an entry
+ * was removed the memory may hold another object, the handle is then
+ * resolved again by key. A handle is only meaningful to the Map that
+ * returned it.
+ */
+struct EntryHandle
+{
+    size_t offset[2] = {0, 0};
+    uint64_t generation[2] = {0, 0};
+
+    bool operator==(const EntryHandle&) const = default;
+};
+
+/**
+ * @brief One operation of Map::applyBatch.
+ */
+template <class ValueType>
+struct BatchOp
+{
+    enum class Type
+    {
+        /** Insert value, or update the object if the key is present */
+        insert,
+        /** Update sensorValue, timestamp and timestampStr of the object */
+        update,
+        /** Remove the object, a missing key is not an error */
+        erase
+    };
+
+    Type type;
+    string key;
+    ValueType value = {};
+    /** Set by applyBatch. False if the key of an update was not found. */
+    bool applied = false;
+};
+
+/** @brief Numeric value of a reading for its history
+ *  @param[in] value - reading of any kind but text
+ *  @return double
+ */
+inline double metricValueToDouble(const MetricValue& value)
+{
+    switch (value.kind)
+    {
+        case MetricValueKind::floatingPoint:
+            return bit_cast<double>(value.raw);
+        case MetricValueKind::signedInteger:
+            return static_cast<double>(static_cast<int64_t>(value.raw));
+        case MetricValueKind::boolean:
+            return value.raw ? 1.0 : 0.0;
+        default:
+            return static_cast<double>(value.raw);
+    }
+}
+
+/** @brief Render a raw reading to the string producers used to store
+ *  @param[in] kind - type of the reading
+ *  @param[in] raw - bit pattern of the reading
+ *  @return string
+ */
+inline string renderMetricValue(MetricValueKind kind, uint64_t raw)
+{
+    using namespace nv::sensor_aggregation::metricUtils;
+    switch (kind)
+    {
+        case MetricValueKind::floatingPoint:
+            return to_string(bit_cast<double>(raw));
+        case MetricValueKind::signedInteger:
+            return to_string(static_cast<int64_t>(raw));
+        case MetricValueKind::unsignedInteger:
+            return to_string(raw);
+        case MetricValueKind::boolean:
+            return raw ? "true" : "false";
+        case MetricValueKind::durationNs:
+            return toDurationStringFromNano(raw).value_or("");
+        case MetricValueKind::durationMs:
+            return toDurationStringFromUint(raw).value_or("");
+        case MetricValueKind::text:
+            break;
+    }
+    return {};
+}
+
 /** @class Map
  *  @brief Shared Memory Implementation for object type Map. ManagedShmem
  * inherited for shared memory initialization functionality and read lock.
@@ -47,6 +298,12 @@ using SensorMap =
  * memory. Requires two template parameters
  *  MapType: Specifies the internal layout and allocator for the map creation
  *  ValueType: Specifies the value type for the object insertion and retrieval
+ *
+ *  Structural changes (inserting a key, changing its metric property,
+ * erasing, clearing) are deferred rather than waiting for readers still
+ * walking the map. They are applied in order by the next write of the
+ * producer, or by flushDeferred, and are not visible until then. Value
+ * updates of a key with a deferred change are folded into the change.
  */
 template <class MapType, class ValueType>
 class Map : public ManagedShmem
@@ -56,22 +313,168 @@ class Map : public ManagedShmem
      *  @param[in] nameSpace - Unique name of the map
      *  @param[in] opts - Read/Write permissions
      *  @param[in] maxSize - memory size allocation for the map
+     *  @param[in] options - publish mode and warm restart options
      */
-    Map(const string& nameSpace, const int opts, size_t maxSize);
+    Map(const string& nameSpace, const int opts, size_t maxSize,
+        const NamespaceOptions& options = {});
     /** @brief Ctor
      *  @param[in] nameSpace - Unique name of the map
      *  @param[in] opts - Read permissions
+     *  @param[in] segmentName - shared segment hosting the map, empty when
+     * the map has a segment of its own
      */
-    Map(const string& nameSpace, const int opts);
-    /** @brief Dtor, remove the shared map object
+    Map(const string& nameSpace, const int opts,
+        const string& segmentName = {});
+    /** @brief Dtor, remove the shared map object. Kept for the next instance
+     * of a producer with warm restart enabled.
      */
     ~Map();
 
     /** @brief Get all the objects present in the map
      *  @return vector of objects
+     *  @throws LockAcquisitionException if an object stayed locked by a
+     * writer, rather than leaving it out
      */
     vector<ValueType> getAllValues();
 
+    /** @brief Get the next chunk of about chunkEntries objects of a scan and
+     * move the cursor forward. The read is registered for one chunk only, so
+     * structural writers wait for at most one chunk instead of a whole scan.
+     * Objects present for the whole scan are returned exactly once, objects
+     * inserted or erased meanwhile may or may not be. Each chunk reads the
+     * current front buffer in snapshot mode, so a scan may span publishes.
+     *  @param[in,out] cursor - position of the scan, done is set at the end
+     *  @param[in] chunkEntries - objects per chunk
+     *  @return vector of objects, may be empty before the scan is done
+     */
+    vector<ValueType> getValuesChunk(ScanCursor& cursor, size_t chunkEntries);
+
+    /** @brief Get all the objects present in the map with a chunked scan,
+     * see getValuesChunk
+     *  @param[in] chunkEntries - objects per chunk
+     *  @return vector of objects
+     */
+    vector<ValueType> getAllValuesChunked(size_t chunkEntries);
+
+    /** @brief Get the object whose metric property URI is uri. Looked up in
+     * the metric property index of the namespace, or found by a scan when the
+     * producer keeps no index. If several objects share the URI any of them
+     * is returned.
+     *  @param[in] uri - metric property
+     *  @param[out] val - object
+     *  @return False if no object has the URI
+     */
+    bool getValueByMetricProperty(string_view uri, ValueType& val);
+
+    /** @brief Get the objects whose metric property URI is one of uris, e.g.
+     * the MetricProperties of a MetricReportDefinition. One object is
+     * returned per distinct URI, URIs without object are skipped, the
+     * metricProperty of the returned objects tells which URI they match.
+     *  @param[in] uris - metric properties
+     *  @return vector of objects
+     */
+    vector<ValueType> getValuesByMetricProperties(const vector<string>& uris);
+
+    /** @brief Get the recent samples of an object, kept when the namespace
+     * is configured with HistorySamples. Only numeric readings written with
+     * updateMetricValue are recorded. The history is not double buffered, in
+     * snapshot mode it includes unpublished samples.
+     *  @param[in] key - key of the object
+     *  @param[in] sinceMs - only samples with a later timestamp are returned
+     *  @return samples, oldest first. Empty without history.
+     */
+    vector<HistorySample> getHistory(string_view key, uint64_t sinceMs = 0);
+
+    /** @brief Get the minimum, maximum, average and rate of an object over
+     * the window configured with AggregationWindowSeconds, ending at its last
+     * sample. Only numeric readings written with updateMetricValue are
+     * aggregated.
+     *  @param[in] key - key of the object
+     *  @param[out] aggregates - aggregates of the object
+     *  @return False if the namespace keeps no aggregates, the key is not
+     * found or it has no sample
+     */
+    bool getAggregates(string_view key, MetricAggregates& aggregates);
+
+    /** @brief Get the objects whose key starts with prefix, such as the
+     * objects of one device when prefix is its D-Bus path followed by '/'.
+     * Ordered maps only visit the matching range, hash maps filter a full
+     * scan.
+     *  @param[in] prefix - key prefix
+     *  @return vector of objects
+     */
+    vector<ValueType> getValuesByPrefix(string_view prefix);
+
+    /** @brief Get the objects written since the position of cursor and move
+     * cursor to the current position. All the objects are returned, with full
+     * set, for a default cursor, when objects were removed since the cursor
+     * position or when the namespace was recreated. The caller then replaces
+     * what it read before.
+     *  @param[in,out] cursor - position of the previous call
+     *  @param[out] full - true if all the objects are returned
+     *  @return vector of objects
+     */
+    vector<ValueType> getValuesChangedSince(ChangeCursor& cursor, bool& full);
+
+    /** @brief Get the changes recorded in the journal since the previous
+     * call with the same cursor, oldest first, and move the cursor forward.
+     * In snapshot mode the changes are recorded by publish. resync is set,
+     * with no change returned, when the reader fell behind the journal, the
+     * namespace was recreated or keeps no journal, and for a default cursor:
+     * the caller then reads all the objects again and tails from there.
+     *  @param[in,out] cursor - position of the previous call
+     *  @param[out] resync - true if the caller must read all the objects
+     *  @param[in] maxRecords - most changes returned, 0 for no limit
+     *  @return vector of changes
+     */
+    vector<ChangeRecord> getChangesSince(JournalCursor& cursor, bool& resync,
+                                         size_t maxRecords = 0);
+
+    /** @brief Call visitor on a view of every object present in the map,
+     * without building a ValueType per object. The objects are copied into
+     * buffers reused for all the chunks of a scan, see getValuesChunk, and
+     * the visitor runs once the read of its chunk is no longer registered,
+     * so a slow visitor does not hold structural writers back. The views
+     * must not be kept after the visitor returns.
+     *  @param[in] visitor - callable taking a const SensorValueView&
+     *  @return number of objects visited
+     */
+    template <typename Visitor>
+    size_t visitValues(Visitor&& visitor)
+    {
+        size_t visited = 0;
+        vector<pair<string, ValueType>> chunk(visitChunkEntries);
+        ScanCursor cursor;
+        while (!cursor.done)
+        {
+            size_t read = 0;
+            scanChunk(cursor, visitChunkEntries, [&](const auto& entry) {
+                const auto& key = entry.first;
+                if (!inSegment(key.data(), key.size()))
+                {
+                    return;
+                }
+                if (read == chunk.size())
+                {
+                    // A hash map chunk holds whole probe runs
+                    chunk.emplace_back();
+                }
+                auto& [chunkKey, value] = chunk[read++];
+                chunkKey.assign(StringViewLess::view(key));
+                readEntry(entry.second, value);
+            });
+            for (size_t i = 0; i < read; i++)
+            {
+                const auto& [key, value] = chunk[i];
+                visitor(SensorValueView{key, value.sensorValue,
+                                        value.metricProperty, value.timestamp,
+                                        value.timestampStr, value.stale});
+            }
+            visited += read;
+        }
+        return visited;
+    }
+
     /** @brief Get all the objects present in the map as key value pair
      *  @return vector of key-value pairs
      */
@@ -83,15 +486,34 @@ class Map : public ManagedShmem
      * copied
      *  @return True if object with matching key is found. False if the key is
      * not found
+     *  @throws LockAcquisitionException if the object stayed locked by a
+     * writer
      */
     bool getValue(const string& key, ValueType& val);
 
     /** @brief Insert object in the map, if the key is already present then
-     * object would be updated
+     * object would be updated in place
+     *  @param[in] key - key of the object to be created
+     *  @param[in] val - object to be inserted
+     *  @return handle to update the object with, empty when the insert is
+     * deferred
+     */
+    EntryHandle insert(const string& key, const ValueType& val)
+    {
+        bool isDeferred = false;
+        return insert(key, val, isDeferred);
+    }
+
+    /** @brief Insert object in the map, see above
      *  @param[in] key - key of the object to be created
      *  @param[in] val - object to be inserted
+     *  @param[out] isDeferred - true if the insert was deferred: the object is
+     * not visible until the deferred changes are applied, see flushDeferred,
+     * and the returned handle is empty
+     *  @return handle to update the object with
      */
-    void insert(const string& key, const ValueType& val);
+    EntryHandle insert(const string& key, const ValueType& val,
+                       bool& isDeferred);
 
     /** @brief Remove object from the map
      *  @param[in] key - key of the object to be removed
@@ -100,8 +522,14 @@ class Map : public ManagedShmem
     {
         if (opts & O_CREAT)
         {
-            shmem_write_lock_t lock(*memLock);
-            mapImpl->erase(getMapKey(key));
+            BatchOp<ValueType> op{BatchOp<ValueType>::Type::erase, key};
+            writeOrDefer(
+                !deferred.empty(),
+                [&]() {
+                    applyDeferredLocked();
+                    applyBatchLocked(span(&op, 1));
+                },
+                [&]() { deferred.push(std::move(op)); });
         }
         else
         {
@@ -109,14 +537,30 @@ class Map : public ManagedShmem
         }
     }
 
+    /** @brief Apply inserts, updates and erases while holding the namespace
+     * lock once. Readers see either none or all of the operations. If an
+     * operation throws, e.g. because the map is full, the operations before
+     * it stay applied. A deferred batch stays atomic, its updates are counted
+     * as applied if their key is present after the changes deferred before.
+     *  @param[in,out] ops - operations, applied in order, applied is set on
+     * each of them
+     *  @return number of operations applied
+     */
+    size_t applyBatch(span<BatchOp<ValueType>> ops);
+
     /** @brief Remove all objects from the map
      */
     void clear(void)
     {
         if (opts & O_CREAT)
         {
-            shmem_write_lock_t lock(*memLock);
-            mapImpl->clear();
+            writeOrDefer(
+                !deferred.empty(),
+                [&]() {
+                    applyDeferredLocked();
+                    clearLocked();
+                },
+                [&]() { deferred.pushClear(); });
         }
         else
         {
@@ -124,13 +568,40 @@ class Map : public ManagedShmem
         }
     }
 
-    /** @brief Returns number of elements in the map
+    /** @brief Apply the structural changes deferred while readers were
+     * walking the map, waiting for the readers however long they take. Any
+     * later write of the producer applies them as well, a producer calls it
+     * when it stops writing for a while.
+     */
+    void flushDeferred();
+
+    /** @brief Remove the objects restored by a warm restart which were not
+     * written again by the producer since.
+     *  @return number of objects removed
+     */
+    size_t eraseStale();
+
+    /** @brief Returns number of elements in the map. In snapshot mode a
+     * producer gets the size of the back buffer it is writing, readers the
+     * size of the published front buffer.
      */
     auto size(void)
     {
+        shared_lock mapping(mappingLock);
+        if (publishMode == PublishMode::snapshot && !(opts & O_CREAT))
+        {
+            return snapshotMaps[header->frontBuffer.load()]->size();
+        }
         return mapImpl->size();
     }
 
+    /** @brief Publish everything written since the last call to readers of a
+     * snapshot mode map with one flip of the front buffer. The previous front
+     * buffer is then brought up to date and becomes the new back buffer. No-op
+     * for live maps.
+     */
+    void publish();
+
     /** @brief Update value property of the object
      *  @param[in] key - key of the map object
      *  @param[in] val - value property of the object
@@ -160,6 +631,37 @@ class Map : public ManagedShmem
     bool updateValueAndTimeStamp(const string& key, const string& val,
                                  const uint64_t timestamp,
                                  const string& timestampStr);
+
+    /** @brief Update value and timestamp of the object with the raw reading.
+     * Rendering the value and the timestamp to strings is left to the readers.
+     *  @param[in] key - key of the map object
+     *  @param[in] value - reading in its D-Bus type
+     *  @param[in] timestamp - timestamp property of the object
+     *  @param[in] timestampEpochMs - time of the reading in ms since epoch,
+     * rendered as the datetime of the object
+     *  @return True if the object is updated successfully. False if the key
+     * is not found
+     */
+    bool updateMetricValue(const string& key, const MetricValue& value,
+                           const uint64_t timestamp,
+                           const uint64_t timestampEpochMs);
+
+    /** @brief Update value and timestamp of the object referenced by handle
+     * with the raw reading. The object is only looked up by key when an
+     * object was removed since the handle was taken, the handle is then
+     * refreshed.
+     *  @param[in,out] handle - handle returned by insert
+     *  @param[in] key - key of the map object
+     *  @param[in] value - reading in its D-Bus type
+     *  @param[in] timestamp - timestamp property of the object
+     *  @param[in] timestampEpochMs - time of the reading in ms since epoch,
+     * rendered as the datetime of the object
+     *  @return True if the object is updated successfully. False if the key
+     * is not found
+     */
+    bool updateMetricValue(EntryHandle& handle, const string& key,
+                           const MetricValue& value, const uint64_t timestamp,
+                           const uint64_t timestampEpochMs);
     /**
      * @brief Method to get free memory available in the namespace.
      *
@@ -167,12 +669,197 @@ class Map : public ManagedShmem
      */
     size_t getFreeSize()
     {
+        shared_lock mapping(mappingLock);
         size_t freeSize = memory->get_free_memory();
         return freeSize;
     }
 
   private:
-    /** @brief Get the key in shared mem allocator format
+    /** @brief Layout of the objects stored by this map, checked on a warm
+     * restart.
+     */
+    static SegmentLayout segmentLayout();
+
+    /** @brief Insert or rewrite an object. Must be called by a structural
+     * writer.
+     *  @param[in] key - key of the object
+     *  @param[in] val - object to be inserted
+     *  @return handle to the object
+     */
+    EntryHandle insertLocked(const string& key, const ValueType& val);
+
+    /** @brief Apply a batch, see applyBatch. Must be called by a structural
+     * writer.
+     *  @param[in,out] ops - operations
+     *  @return number of operations applied
+     */
+    size_t applyBatchLocked(span<BatchOp<ValueType>> ops);
+
+    /** @brief Defer a batch, setting applied as if the changes deferred
+     * before it were applied
+     *  @param[in,out] ops - operations
+     *  @return number of operations applied
+     */
+    size_t deferBatch(span<BatchOp<ValueType>> ops);
+
+    /** @brief Remove all objects. Must be called by a structural writer. */
+    void clearLocked();
+
+    /** @brief Apply the deferred changes. Must be called by a structural
+     * writer, before its own change.
+     */
+    void applyDeferredLocked()
+    {
+        deferred.apply([this](bool cleared, span<BatchOp<ValueType>> ops) {
+            if (cleared)
+            {
+                clearLocked();
+            }
+            applyBatchLocked(ops);
+        });
+    }
+
+    /** @brief Prepare the maps of a reused segment: drop the entries the
+     * previous instance left half written and mark every other entry stale.
+     */
+    void restoreWarmMaps();
+
+    /** @brief Check that an entry left by the previous instance of the
+     * producer can be trusted: it was not left locked and its key and strings
+     * lie inside the segment with lengths that fit their buffers.
+     *  @param[in] entry - entry of the reused segment
+     */
+    bool entryIntact(const map_value_type_t& entry) const
+    {
+        const auto& key = entry.first;
+        const auto& value = entry.second;
+        return !(value.version.load(memory_order_acquire) & 1U) &&
+               inSegment(key.data(), key.size()) &&
+               stringIntact(value.sensorValue) &&
+               stringIntact(value.timestampStr) &&
+               value.valueKind <= MetricValueKind::durationMs;
+    }
+
+    /** @brief Check that the length of an inline string matches the buffer
+     * holding it, see entryIntact */
+    template <size_t Capacity>
+    bool stringIntact(const InlineString<Capacity>& str) const
+    {
+        return str.isInline() ||
+               (str.overflow.size() == str.length &&
+                inSegment(str.overflow.data(), str.overflow.size()));
+    }
+
+    /** @brief Look up the named objects of the namespace in the current
+     * mapping. Objects the namespace does not keep are set to nullptr.
+     */
+    void findObjects();
+
+    /** @brief Refresh the pointers into the segment after a remap */
+    void remapped() override;
+
+    /** @brief True for map types with a bounded capacity */
+    static constexpr bool hasCapacity = requires(const MapType& map) {
+        map.capacity();
+    };
+
+    /** @brief Double the capacity of the map the producer writes to when the
+     * namespace may grow, growing the segment as needed. */
+    bool growEntries() override;
+
+    /** @brief Raise the capacity of a buffer to at least capacity. Must be
+     * called by a structural writer. Dense entries move, their handles are
+     * invalidated and their index entries follow them.
+     *  @throws boost::interprocess::bad_alloc, the buffer is left unchanged
+     */
+    void growBuffer(uint32_t buffer, size_t capacity);
+
+    /** @brief Run func on the map readers should see: the live map, or the
+     * front buffer in snapshot mode.
+     *  @param[in] func - callable taking a const reference to the map
+     */
+    template <typename Func>
+    void withReadableMap(Func&& func)
+    {
+        if (publishMode == PublishMode::snapshot)
+        {
+            withFrontRegistered(
+                [&](uint32_t front) { func(*snapshotMaps[front]); });
+        }
+        else
+        {
+            withReaderRegistered([&]() { func(*mapImpl); });
+        }
+    }
+
+    /** @brief Read the next chunk of a scan and move the cursor forward, see
+     * getValuesChunk.
+     *  @param[in,out] cursor - position of the scan
+     *  @param[in] chunkEntries - objects per chunk
+     *  @param[in] readObject - callable taking a map entry, run while the
+     * read is registered
+     */
+    template <typename ReadFunc>
+    void scanChunk(ScanCursor& cursor, size_t chunkEntries,
+                   ReadFunc&& readObject)
+    {
+        chunkEntries = max<size_t>(chunkEntries, 1);
+        withReadableMap([this, &cursor, &readObject,
+                         chunkEntries](const MapType& map) {
+            if constexpr (requires { map.upper_bound(string_view()); })
+            {
+                auto itr = cursor.started
+                               ? map.upper_bound(string_view(cursor.lastKey))
+                               : map.begin();
+                for (size_t visited = 0;
+                     itr != map.end() && visited < chunkEntries; visited++)
+                {
+                    readObject(*itr);
+                    copyString((*itr).first, cursor.lastKey);
+                    itr++;
+                }
+                cursor.done = itr == map.end();
+            }
+            else
+            {
+                if (cursor.buckets != 0 &&
+                    cursor.buckets != map.bucketCount())
+                {
+                    // The map grew since the previous chunk
+                    cursor.bucket = map.rescaleBucket(cursor.bucket,
+                                                      cursor.buckets);
+                }
+                cursor.bucket =
+                    map.visitBuckets(cursor.bucket, chunkEntries, readObject);
+                cursor.buckets = map.bucketCount();
+                cursor.done = cursor.bucket >= map.bucketCount();
+            }
+        });
+        cursor.started = true;
+    }
+
+    /** @brief Remember a key written to the back buffer so that publish can
+     * replay it onto the other buffer.
+     *  @param[in] key - key of the modified object
+     */
+    void markDirty(const string& key)
+    {
+        if (publishMode == PublishMode::snapshot)
+        {
+            scoped_lock lock(dirtyKeysLock);
+            dirtyKeys.emplace(key);
+        }
+    }
+
+    /** @brief Replay the keys modified since the last publish from the new
+     * front buffer onto the new back buffer.
+     *  @param[in] front - buffer that was just published
+     *  @param[in] back - buffer to bring up to date
+     */
+    void syncBackBuffer(const MapType& front, MapType& back);
+
+    /** @brief Get the key in shared mem allocator format. Only needed to
+     * insert a new object, lookups take the key as a string_view.
      *  @param[in] key - key in string format
      */
     char_string_t getMapKey(const string& key)
@@ -182,8 +869,585 @@ class Map : public ManagedShmem
         return mapKey;
     }
 
-    /** @brief Boost Internal implementation reference */
+    /** @brief Copy a string out of the segment. A string whose buffer does not
+     * lie inside the mapping was torn by a concurrent writer, it is left empty
+     * and the read is retried by readVersioned.
+     *  @param[in] src - string in shared memory
+     *  @param[out] dst - destination string
+     */
+    void copyString(const char_string_t& src, string& dst)
+    {
+        const char* data = src.data();
+        size_t length = src.size();
+        if (inSegment(data, length))
+        {
+            dst.assign(data, length);
+        }
+        else
+        {
+            dst.clear();
+        }
+    }
+
+    /** @brief Copy an inline string out of the segment. The length is loaded
+     * once and a torn length is clamped to the inline buffer, the read is
+     * retried by readVersioned.
+     *  @param[in] src - string in shared memory
+     *  @param[out] dst - destination string
+     */
+    template <size_t Capacity>
+    void copyString(const InlineString<Capacity>& src, string& dst)
+    {
+        size_t length = src.length;
+        if (length <= Capacity)
+        {
+            dst.assign(src.inlineData, min(length, Capacity));
+        }
+        else
+        {
+            copyString(src.overflow, dst);
+        }
+    }
+
+    /** @brief Rebuild the metric property URI of an entry from its interned
+     * parts
+     *  @param[in] src - value in shared memory
+     *  @param[out] dst - destination string
+     */
+    void copyMetricProperty(const SensorMapValue& src, string& dst)
+    {
+        dst.clear();
+        for (const auto& part : {src.metricPropertyBase.get(),
+                                 src.metricPropertySuffix.get()})
+        {
+            if (part != nullptr && inSegment(part, sizeof(char_string_t)) &&
+                inSegment(part->data(), part->size()))
+            {
+                dst.append(part->data(), part->size());
+            }
+        }
+    }
+
+    /** @brief Check whether an entry already points to the parts of uri
+     *  @param[in] mapValue - value in shared memory
+     *  @param[in] uri - metric property
+     */
+    bool hasMetricProperty(const SensorMapValue& mapValue, string_view uri)
+    {
+        auto [base, suffix] = splitMetricProperty(uri);
+        return mapValue.metricPropertyBase != nullptr &&
+               mapValue.metricPropertySuffix != nullptr &&
+               StringViewLess::view(*mapValue.metricPropertyBase) == base &&
+               StringViewLess::view(*mapValue.metricPropertySuffix) == suffix;
+    }
+
+    /** @brief Point an entry to the interned parts of uri. Must be called by
+     * a structural writer.
+     *  @param[out] mapValue - value in shared memory
+     *  @param[in] uri - metric property
+     */
+    void setMetricProperty(SensorMapValue& mapValue, string_view uri)
+    {
+        auto [base, suffix] = splitMetricProperty(uri);
+        mapValue.metricPropertyBase = uriTable->intern(base);
+        mapValue.metricPropertySuffix = uriTable->intern(suffix);
+    }
+
+    /** @brief Fields of an entry that are rendered once the copy is known to
+     * be consistent */
+    struct RawReading
+    {
+        MetricValueKind kind = MetricValueKind::text;
+        uint64_t value = 0;
+        uint64_t timestampEpochMs = 0;
+    };
+
+    /** @brief Copy a map value out of the segment under the read protocol
+     *  @param[in] src - value in shared memory
+     *  @param[out] dst - destination object
+     *  @param[out] raw - raw fields to render into dst
+     */
+    void copyValue(const SensorMapValue& src, ValueType& dst, RawReading& raw)
+    {
+        raw = {src.valueKind, src.rawValue, src.timestampEpochMs};
+        if (raw.kind == MetricValueKind::text)
+        {
+            copyString(src.sensorValue, dst.sensorValue);
+        }
+        if (raw.timestampEpochMs == 0)
+        {
+            copyString(src.timestampStr, dst.timestampStr);
+        }
+        copyMetricProperty(src, dst.metricProperty);
+        dst.timestamp = src.timestamp;
+        dst.stale = src.stale;
+    }
+
+    /** @brief Render the raw fields of a copied entry
+     *  @param[in] raw - raw fields taken by copyValue
+     *  @param[out] value - rendered value, untouched for text values
+     *  @param[out] timestampStr - rendered datetime, untouched when the
+     * entry holds a datetime string
+     */
+    static void renderReading(const RawReading& raw, string& value,
+                              string* timestampStr)
+    {
+        if (raw.kind != MetricValueKind::text)
+        {
+            value = renderMetricValue(raw.kind, raw.value);
+        }
+        if (timestampStr != nullptr && raw.timestampEpochMs != 0)
+        {
+            *timestampStr =
+                nv::sensor_aggregation::metricUtils::getDateTimeUintMs(
+                    raw.timestampEpochMs);
+        }
+    }
+
+    /** @brief Take a consistent copy of an entry under its version counter
+     *  @param[in] src - value in shared memory
+     *  @param[out] dst - destination object
+     *  @throws LockAcquisitionException if the entry stayed locked by a
+     * writer
+     */
+    void readEntry(const SensorMapValue& src, ValueType& dst)
+    {
+        RawReading raw;
+        readVersioned(src.version, [&]() { copyValue(src, dst, raw); });
+        renderReading(raw, dst.sensorValue, &dst.timestampStr);
+    }
+
+    /** @brief Next generation to stamp a written entry with. Must be called
+     * with the entry's version held.
+     */
+    uint64_t nextGeneration()
+    {
+        return header->generation.fetch_add(1, memory_order_acq_rel) + 1;
+    }
+
+    /** @brief Record the removal of entries for getValuesChangedSince. Must
+     * be called by a structural writer.
+     */
+    void markRemoval()
+    {
+        header->removalGeneration.store(nextGeneration(),
+                                        memory_order_release);
+    }
+
+    /** @brief Record a change in the journal. In snapshot mode changes are
+     * recorded by publish instead, when readers can see them.
+     *  @param[in] kind - kind of the change
+     *  @param[in] key - key of the changed object
+     *  @param[in] generation - generation of the change, the current one if
+     * 0
+     */
+    void journalChange(ChangeKind kind, string_view key,
+                       uint64_t generation = 0)
+    {
+        if (journal != nullptr && publishMode == PublishMode::live)
+        {
+            appendJournal(kind, key, generation);
+        }
+    }
+
+    /** @brief Record a value update in the journal. Unlike journalChange
+     * it records the key held by the entry and does not touch the key table,
+     * so it may run next to other value writers.
+     *  @param[in] key - journal key of the updated entry
+     *  @param[in] generation - generation of the change
+     */
+    void journalUpdate(journal_key_ptr_t key, uint64_t generation)
+    {
+        if (journal != nullptr && publishMode == PublishMode::live)
+        {
+            journal->appendUpdate(key, generation, journalNowMs());
+        }
+    }
+
+    /** @brief Append a record to the journal. Must be called by a structural
+     * writer. */
+    void appendJournal(ChangeKind kind, string_view key, uint64_t generation)
+    {
+        journal->append(kind, key,
+                        generation
+                            ? generation
+                            : header->generation.load(memory_order_acquire),
+                        journalNowMs());
+    }
+
+    /** @brief Time of a journal record */
+    static uint64_t journalNowMs()
+    {
+        return chrono::duration_cast<chrono::milliseconds>(
+                   chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    /** @brief Record the changes of a publish, dirtyKeys against the new
+     * front. Must be called by publish.
+     */
+    void journalPublished(const MapType& front);
+
+    /** @brief Index of map in snapshotMaps */
+    uint32_t bufferIndex(const MapType& map) const
+    {
+        return (&map == snapshotMaps[1].get()) ? 1U : 0U;
+    }
+
+    /** @brief Metric property index of map, nullptr if the namespace has
+     * none */
+    MetricPropertyIndex* propertyIndex(const MapType& map) const
+    {
+        return propertyIndexes[bufferIndex(map)].get();
+    }
+
+    /** @brief Add an entry of map to its metric property index. Must be
+     * called by a structural writer.
+     */
+    void indexEntry(const MapType& map, const map_value_type_t& entry)
+    {
+        auto* index = propertyIndex(map);
+        const auto& value = entry.second;
+        if (index != nullptr && value.metricPropertyBase != nullptr &&
+            value.metricPropertySuffix != nullptr)
+        {
+            index->emplace(metric_property_parts_t(value.metricPropertyBase,
+                                                   value.metricPropertySuffix),
+                           &entry);
+        }
+    }
+
+    /** @brief Remove an entry of map from its metric property index, before
+     * the entry or its URI is changed. Must be called by a structural writer.
+     */
+    void unindexEntry(const MapType& map, const map_value_type_t& entry)
+    {
+        auto* index = propertyIndex(map);
+        const auto& value = entry.second;
+        if (index == nullptr || value.metricPropertyBase == nullptr ||
+            value.metricPropertySuffix == nullptr)
+        {
+            return;
+        }
+        auto [itr, last] = index->equal_range(metric_property_parts_t(
+            value.metricPropertyBase, value.metricPropertySuffix));
+        for (; itr != last; itr++)
+        {
+            if (itr->second.get() == &entry)
+            {
+                index->erase(itr);
+                return;
+            }
+        }
+    }
+
+    /** @brief Point the index entry of an entry of map to its copy, when the
+     * map moved its entries. Must be called by a structural writer.
+     */
+    void reindexEntry(const MapType& map, const map_value_type_t& from,
+                      const map_value_type_t& to)
+    {
+        auto* index = propertyIndex(map);
+        const auto& value = from.second;
+        if (index == nullptr || value.metricPropertyBase == nullptr ||
+            value.metricPropertySuffix == nullptr)
+        {
+            return;
+        }
+        auto [itr, last] = index->equal_range(metric_property_parts_t(
+            value.metricPropertyBase, value.metricPropertySuffix));
+        for (; itr != last; itr++)
+        {
+            if (itr->second.get() == &from)
+            {
+                itr->second = &to;
+                return;
+            }
+        }
+    }
+
+    /** @brief Find the record of key in records, creating it from args if
+     * it is missing. Must be called by a structural writer.
+     */
+    template <class RecordMap, typename... Args>
+    auto* findOrCreateRecord(RecordMap& records, string_view key,
+                             Args&&... args)
+    {
+        auto itr = records.find(key);
+        if (itr == records.end())
+        {
+            char_string_t recordKey(*voidAllocator);
+            recordKey.assign(key.data(), key.size());
+            itr = records
+                      .try_emplace(std::move(recordKey),
+                                   std::forward<Args>(args)...)
+                      .first;
+        }
+        return &itr->second;
+    }
+
+    /** @brief Point an entry to the history and aggregates of key, creating
+     * them if the namespace keeps them. Must be called by a structural
+     * writer.
+     */
+    void attachEntryRecords(string_view key, SensorMapValue& mapValue)
+    {
+        mapValue.history =
+            historyMap ? findOrCreateRecord(*historyMap, key, historySamples,
+                                            *voidAllocator)
+                       : nullptr;
+        mapValue.aggregates =
+            aggregateMap
+                ? findOrCreateRecord(*aggregateMap, key, aggregationWindowMs)
+                : nullptr;
+    }
+
+    /** @brief Point a live entry to its key in the journal, so that value
+     * updates record it without a lookup. Must be called by a structural
+     * writer.
+     */
+    void attachJournalKey(string_view key, SensorMapValue& mapValue)
+    {
+        if (journal != nullptr && publishMode == PublishMode::live &&
+            mapValue.journalKey == nullptr)
+        {
+            mapValue.journalKey = journal->acquireKey(key);
+        }
+    }
+
+    /** @brief Release the journal key of a removed live entry. Must be
+     * called by a structural writer.
+     */
+    void releaseJournalKey(SensorMapValue& mapValue)
+    {
+        if (journal != nullptr && mapValue.journalKey != nullptr)
+        {
+            journal->releaseKey(mapValue.journalKey);
+            mapValue.journalKey = nullptr;
+        }
+    }
+
+    /** @brief Drop the history, aggregates and journal key of a removed
+     * entry. Must be called by a structural writer. In snapshot mode the
+     * entry of the front buffer still points to them, publish drops them
+     * once no buffer does.
+     */
+    void eraseEntryRecords(map_value_type_t& entry)
+    {
+        if (publishMode == PublishMode::live)
+        {
+            dropEntryRecords(StringViewLess::view(entry.first));
+            releaseJournalKey(entry.second);
+        }
+    }
+
+    /** @brief Drop the history and aggregates of key */
+    void dropEntryRecords(string_view key)
+    {
+        if (historyMap != nullptr)
+        {
+            auto itr = historyMap->find(key);
+            if (itr != historyMap->end())
+            {
+                historyMap->erase(itr);
+            }
+        }
+        if (aggregateMap != nullptr)
+        {
+            auto itr = aggregateMap->find(key);
+            if (itr != aggregateMap->end())
+            {
+                aggregateMap->erase(itr);
+            }
+        }
+    }
+
+    /** @brief Drop the history and aggregates of the keys removed since the
+     * last publish. Must be called by publish once both buffers are synced,
+     * so that no entry points to them anymore.
+     */
+    void dropUnpublishedRecords(const MapType& front);
+
+    /** @brief Invalidate the handles to entries of map after entries were
+     * removed from it. Called by structural writers.
+     */
+    void entryRemoved(const MapType& map)
+    {
+        removalGenerations[bufferIndex(map)].fetch_add(1,
+                                                       memory_order_relaxed);
+    }
+
+    /** @brief Point handle to an entry of the map the producer writes to */
+    void setHandle(EntryHandle& handle, const map_value_type_t& entry)
+    {
+        uint32_t buffer = bufferIndex(*mapImpl);
+        handle.offset[buffer] = static_cast<size_t>(
+            reinterpret_cast<const char*>(&entry) -
+            static_cast<const char*>(memory->get_address()));
+        handle.generation[buffer] =
+            removalGenerations[buffer].load(memory_order_relaxed);
+    }
+
+    /** @brief Get the entry of key in the map the producer writes to, through
+     * handle while it is valid or else by looking up key and refreshing
+     * handle. Must be called registered as a reader or by a structural
+     * writer, so that no entry is removed meanwhile.
+     *  @param[in,out] handle - handle to the entry
+     *  @param[in] key - key of the map object
+     *  @return entry, nullptr if the key is not found
+     */
+    map_value_type_t* resolveHandle(EntryHandle& handle, const string& key)
+    {
+        uint32_t buffer = bufferIndex(*mapImpl);
+        if (handle.offset[buffer] != 0 &&
+            handle.generation[buffer] ==
+                removalGenerations[buffer].load(memory_order_relaxed))
+        {
+            return reinterpret_cast<map_value_type_t*>(
+                static_cast<char*>(memory->get_address()) +
+                handle.offset[buffer]);
+        }
+        auto itr = mapImpl->find(string_view(key));
+        if (itr == mapImpl->end())
+        {
+            return nullptr;
+        }
+        setHandle(handle, *itr);
+        return &*itr;
+    }
+
+    /** @brief Rewrite the fields of an existing entry in place. Only the
+     * entry's version is locked, the namespace lock is not taken so readers
+     * of other entries are never blocked.
+     *  @param[in] key - key of the map object
+     *  @param[in] update - callable modifying the entry, returning false to
+     * leave it as it was without marking it written
+     *  @param[in] updateDeferred - callable modifying the object of a
+     * deferred insert or update of the key instead, returning false if it
+     * can not
+     *  @return False if the key is not found or update returned false
+     */
+    template <typename UpdateFunc, typename DeferredFunc>
+    bool updateEntry(const string& key, UpdateFunc&& update,
+                     DeferredFunc&& updateDeferred)
+    {
+        EntryHandle handle;
+        return updateEntry(handle, key, std::forward<UpdateFunc>(update),
+                           std::forward<DeferredFunc>(updateDeferred));
+    }
+
+    /** @brief Rewrite the fields of the entry referenced by handle in place
+     *  @param[in,out] handle - handle to the entry, refreshed if it no longer
+     * resolves
+     *  @param[in] key - key of the map object
+     *  @param[in] update - see above
+     *  @param[in] updateDeferred - see above
+     *  @return False if the key is not found or update returned false
+     */
+    template <typename UpdateFunc, typename DeferredFunc>
+    bool updateEntry(EntryHandle& handle, const string& key,
+                     UpdateFunc&& update, DeferredFunc&& updateDeferred)
+    {
+        if (!(opts & O_CREAT))
+        {
+            throw PermissionErrorException();
+        }
+        if (!deferred.empty())
+        {
+            // Apply them before they pile up, without waiting for readers
+            writeOrDefer(
+                true, [this]() { applyDeferredLocked(); }, []() {});
+            bool folded = false;
+            if (deferred.visitLast(key, [&](BatchOp<ValueType>* op) {
+                    folded = op != nullptr &&
+                             op->type != BatchOp<ValueType>::Type::erase &&
+                             updateDeferred(op->value);
+                }))
+            {
+                // Written after the deferred change, not before it
+                return folded;
+            }
+        }
+        bool found = false;
+        // A longer value may need to allocate
+        withGrowth([&]() {
+            withReaderRegistered([&]() {
+                auto* entry = resolveHandle(handle, key);
+                if (entry != nullptr)
+                {
+                    uint64_t generation = 0;
+                    {
+                        VersionWriteGuard guard(entry->second.version);
+                        if (!update(entry->second))
+                        {
+                            return;
+                        }
+                        entry->second.stale = false;
+                        generation = nextGeneration();
+                        entry->second.generation = generation;
+                    }
+                    // Still registered, so publish cannot run in between
+                    markDirty(key);
+                    journalUpdate(entry->second.journalKey, generation);
+                    found = true;
+                }
+            });
+        });
+        if (found && publishMode == PublishMode::live)
+        {
+            notifyChange();
+        }
+        return found;
+    }
+
+    /** @brief Boost Internal implementation reference. In snapshot mode the
+     * back buffer the producer writes to. */
     boost::interprocess::offset_ptr<MapType> mapImpl;
+
+    /** @brief Metric property URI parts shared by the entries, producer only
+     */
+    boost::interprocess::offset_ptr<ShmemStringTable> uriTable;
+
+    /** @brief Both buffers of a snapshot mode map */
+    boost::interprocess::offset_ptr<MapType> snapshotMaps[2];
+
+    /** @brief Metric property index of each buffer, nullptr if the
+     * namespace is not indexed */
+    boost::interprocess::offset_ptr<MetricPropertyIndex> propertyIndexes[2];
+
+    /** @brief Number of times entries were removed from each buffer, see
+     * EntryHandle. Producer only. */
+    atomic<uint64_t> removalGenerations[2]{0, 0};
+
+    /** @brief Histories of the objects, nullptr if the namespace keeps none
+     */
+    boost::interprocess::offset_ptr<SensorHistoryMap> historyMap;
+
+    /** @brief Samples kept per object, producer only */
+    uint32_t historySamples = 0;
+
+    /** @brief Window aggregates of the objects, nullptr if the namespace
+     * keeps none */
+    boost::interprocess::offset_ptr<SensorAggregateMap> aggregateMap;
+
+    /** @brief Aggregation window, producer only */
+    uint64_t aggregationWindowMs = 0;
+
+    /** @brief Changes of the objects, nullptr if the namespace keeps no
+     * journal */
+    boost::interprocess::offset_ptr<ChangeJournal> journal;
+
+    /** @brief Keep the segment for the next instance of the producer */
+    bool keepSegment = false;
+
+    /** @brief Structural changes deferred while readers were walking the
+     * map, producer only */
+    DeferredChanges<BatchOp<ValueType>> deferred;
+
+    /** @brief Keys written to the back buffer since the last publish */
+    mutex dirtyKeysLock;
+    unordered_set<string> dirtyKeys;
+    bool dirtyAll = false;
 };
 
 } // namespace shmem
@@ -0,0 +1,168 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <shm_common.h>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/map.hpp>
+#include <boost/interprocess/containers/set.hpp>
+
+#include <string_view>
+#include <utility>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/** @brief Orders segment strings and allows lookups by string_view without
+ * building a char_string_t first. */
+struct StringViewLess
+{
+    using is_transparent = void;
+
+    static string_view view(const char_string_t& str)
+    {
+        return string_view(str.data(), str.size());
+    }
+    static string_view view(string_view str)
+    {
+        return str;
+    }
+
+    template <class L, class R>
+    bool operator()(const L& lhs, const R& rhs) const
+    {
+        return view(lhs) < view(rhs);
+    }
+};
+
+/** @brief Compares segment strings with each other or with a string_view, so
+ * lookups need no copy of the key in the segment. */
+struct StringViewEqual
+{
+    using is_transparent = void;
+
+    template <class L, class R>
+    bool operator()(const L& lhs, const R& rhs) const
+    {
+        return StringViewLess::view(lhs) == StringViewLess::view(rhs);
+    }
+};
+
+/**
+ * @brief Set of strings in the segment that entries point to instead of
+ * keeping their own copy.
+ *
+ * @details A string is stored once and lives as long as the table. Entries
+ * keep an offset pointer to it, set nodes never move so the pointer stays
+ * valid. Interning modifies the set and must be done by a structural writer,
+ * readers only follow the pointers of the entries.
+ */
+class ShmemStringTable
+{
+  public:
+    explicit ShmemStringTable(const void_allocator_t& alloc) :
+        strings(StringViewLess(), alloc)
+    {}
+
+    /** @brief Get the stored copy of str, adding it if it is not present yet
+     */
+    interned_string_ptr_t intern(string_view str)
+    {
+        auto itr = strings.find(str);
+        if (itr == strings.end())
+        {
+            char_string_t value(strings.get_allocator());
+            value.assign(str.data(), str.size());
+            itr = strings.insert(std::move(value)).first;
+        }
+        return interned_string_ptr_t(&*itr);
+    }
+
+    /** @brief Number of distinct strings stored */
+    size_t size() const
+    {
+        return strings.size();
+    }
+
+  private:
+    using string_allocator_t =
+        boost::interprocess::allocator<char_string_t, segment_manager_t>;
+    boost::interprocess::set<char_string_t, StringViewLess, string_allocator_t>
+        strings;
+};
+
+/**
+ * @brief Split a Redfish metric property URI into the part shared by all the
+ * metrics of a device and the part shared by the same metric of all devices.
+ * The split is at the fragment marker when the URI has one:
+ *   /redfish/v1/Fabrics/HGX_NVLinkFabric_0/Switches/NVSwitch_0/Ports/NVLink_0
+ *   /Metrics# + /Oem/Nvidia/RXNoProtocolBytes
+ * otherwise after the last '/':
+ *   /redfish/v1/Chassis/HGX_GPU_SXM_1/Sensors/ + HGX_GPU_SXM_1_Power_0
+ *
+ * @param[in] uri - metric property
+ * @return base and suffix, concatenated they give back uri
+ */
+inline pair<string_view, string_view> splitMetricProperty(string_view uri)
+{
+    size_t split = uri.find('#');
+    if (split == string_view::npos)
+    {
+        split = uri.rfind('/');
+    }
+    split = (split == string_view::npos) ? 0 : split + 1;
+    return {uri.substr(0, split), uri.substr(split)};
+}
+
+/** @brief Interned base and suffix of a metric property URI */
+using metric_property_parts_t =
+    pair<interned_string_ptr_t, interned_string_ptr_t>;
+
+/** @brief Compares interned URI parts by their content with each other or
+ * with a whole URI, split the same way they were, so a lookup needs neither
+ * the string table nor a copy of the URI. */
+struct MetricPropertyEqual
+{
+    using is_transparent = void;
+
+    static pair<string_view, string_view>
+        view(const metric_property_parts_t& parts)
+    {
+        return {StringViewLess::view(*parts.first),
+                StringViewLess::view(*parts.second)};
+    }
+    static pair<string_view, string_view> view(string_view uri)
+    {
+        return splitMetricProperty(uri);
+    }
+
+    template <class L, class R>
+    bool operator()(const L& lhs, const R& rhs) const
+    {
+        return view(lhs) == view(rhs);
+    }
+};
+
+} // namespace shmem
+} // namespace nv
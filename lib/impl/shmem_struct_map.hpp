@@ -0,0 +1,499 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "shmem_deferred.hpp"
+#include "shmem_map.hpp"
+
+#include <boost/interprocess/containers/map.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace nv
+{
+
+namespace shmem
+{
+
+/** @brief Entry of a StructMap: the struct and the version counter of the
+ * read protocol */
+template <class T>
+struct StructMapValue
+{
+    atomic<uint32_t> version{0};
+    T value;
+
+    StructMapValue(const T& value) : value(value) {}
+};
+
+/** @brief Structural change of a StructMap deferred while readers were
+ * walking it: an insert, or an erase when value is empty */
+template <class T>
+struct DeferredStruct
+{
+    string key;
+    optional<T> value;
+};
+
+/**
+ * @brief Map type storing fixed layout structs by key. Map<StructMap<T>, T>
+ * stores the structs as they are, so readers copy them out without
+ * deserializing.
+ *
+ * @details T is copied byte for byte between processes. It must not hold
+ * pointers or handles, which static_assert can not detect. Readers check the
+ * size and alignment of T, and T::shmemLayoutVersion if T declares one: bump
+ * it when fields change without changing the size.
+ */
+template <class T>
+class StructMap :
+    public boost::interprocess::map<
+        char_string_t, StructMapValue<T>, StringViewLess,
+        boost::interprocess::allocator<
+            pair<const char_string_t, StructMapValue<T>>, segment_manager_t>>
+{
+    static_assert(is_trivially_copyable_v<T>,
+                  "StructMap values are copied byte for byte");
+    static_assert(is_standard_layout_v<T>,
+                  "StructMap values must have the same layout in every "
+                  "process");
+    static_assert(!is_pointer_v<T> && !is_member_pointer_v<T>,
+                  "pointers are not valid in other processes");
+    static_assert(alignof(T) <= alignof(max_align_t),
+                  "the segment allocator does not over-align");
+
+  public:
+    using boost::interprocess::map<
+        char_string_t, StructMapValue<T>, StringViewLess,
+        boost::interprocess::allocator<pair<const char_string_t,
+                                            StructMapValue<T>>,
+                                       segment_manager_t>>::map;
+};
+
+/** @class Map
+ *  @brief Shared memory map of fixed layout structs. Uses the segment
+ * lifecycle, warm restart and read protocol of the sensor maps: structural
+ * writers take the named lock and drain the readers, updates of an existing
+ * struct only lock its version, readers take no lock. Every write moves the
+ * generation readers wait on with waitForChange. Only the live publish mode
+ * is supported. Structural changes are deferred while readers are walking
+ * the map, like those of the sensor maps.
+ */
+template <class T>
+class Map<StructMap<T>, T> : public ManagedShmem
+{
+  public:
+    /** @brief Producer ctor
+     *  @param[in] nameSpace - Unique name of the map
+     *  @param[in] opts - Read/Write permissions
+     *  @param[in] maxSize - memory size allocation for the map
+     *  @param[in] options - warm restart options
+     */
+    Map(const string& nameSpace, const int opts, size_t maxSize,
+        const NamespaceOptions& options = {}) :
+        ManagedShmem(nameSpace, opts, maxSize, liveOnly(options),
+                     segmentLayout()),
+        keepSegment(options.warmRestart && options.segment.empty())
+    {
+        auto namedObjectsLock = lockNamedObjects();
+        mapImpl = memory->find_or_construct<StructMap<T>>(
+            string(nameSpace + "map").c_str())(StringViewLess(),
+                                               *voidAllocator);
+        if (mapImpl == nullptr)
+        {
+            throw BadMapException();
+        }
+        if (!warmAttached)
+        {
+            mapImpl->clear();
+            return;
+        }
+        if (namedObjectsLock)
+        {
+            namedObjectsLock.unlock();
+        }
+        SequenceWriteGuard guard(*this);
+        size_t dropped = 0;
+        for (auto itr = mapImpl->begin(); itr != mapImpl->end();)
+        {
+            const auto& key = itr->first;
+            if ((itr->second.version.load(memory_order_acquire) & 1U) ||
+                !inSegment(key.data(), key.size()))
+            {
+                // The previous instance died while writing it, the struct
+                // may be torn. Its producer writes it again.
+                itr = mapImpl->erase(itr);
+                dropped++;
+                continue;
+            }
+            itr++;
+        }
+        if (dropped != 0)
+        {
+            header->generation.fetch_add(1, memory_order_acq_rel);
+            lg2::error("SHMEMDEBUG: Dropped {COUNT} structs of "
+                       "{SHM_NAMESPACE} left half written by the previous "
+                       "instance",
+                       "COUNT", dropped, "SHM_NAMESPACE", nameSpace);
+        }
+    }
+
+    /** @brief Reader ctor
+     *  @param[in] nameSpace - Unique name of the map
+     *  @param[in] opts - Read permissions
+     *  @param[in] segmentName - shared segment hosting the map, empty when
+     * the map has a segment of its own
+     */
+    Map(const string& nameSpace, const int opts,
+        const string& segmentName = {}) :
+        ManagedShmem(nameSpace, opts, segmentName)
+    {
+        if (header->layoutHash != segmentLayout().layoutHash)
+        {
+            // Written by a producer built with another definition of T
+            throw BadMapException();
+        }
+        auto namedObjectsLock = lockNamedObjects();
+        mapImpl = memory
+                      ->find_no_lock<StructMap<T>>(
+                          string(nameSpace + "map").c_str())
+                      .first;
+        if (mapImpl == nullptr)
+        {
+            throw BadMapException();
+        }
+    }
+
+    /** @brief Dtor, remove the shared map object. Kept for the next instance
+     * of a producer with warm restart enabled.
+     */
+    ~Map()
+    {
+        if ((opts & O_CREAT) && !keepSegment)
+        {
+            auto namedObjectsLock = lockNamedObjects();
+            memory->destroy<StructMap<T>>(string(nameSpace + "map").c_str());
+        }
+    }
+
+    /** @brief Insert a struct, or overwrite the struct of an existing key
+     *  @param[in] key - key of the struct
+     *  @param[in] value - struct
+     */
+    void insert(const string& key, const T& value)
+    {
+        if (update(key, value))
+        {
+            return;
+        }
+        writeOrDefer(
+            !deferred.empty(),
+            [&]() {
+                applyDeferredLocked();
+                insertLocked(key, value);
+            },
+            [&]() { deferred.push({key, value}); });
+    }
+
+    /** @brief Overwrite the struct of an existing key in place, without the
+     * namespace lock
+     *  @param[in] key - key of the struct
+     *  @param[in] value - struct
+     *  @return False if the key is not found
+     */
+    bool update(const string& key, const T& value)
+    {
+        if (!(opts & O_CREAT))
+        {
+            throw PermissionErrorException();
+        }
+        if (!deferred.empty())
+        {
+            // Apply them before they pile up, without waiting for readers
+            writeOrDefer(
+                true, [this]() { applyDeferredLocked(); }, []() {});
+            bool folded = false;
+            if (deferred.visitLast(key, [&](DeferredStruct<T>* op) {
+                    if (op != nullptr && op->value)
+                    {
+                        op->value = value;
+                        folded = true;
+                    }
+                }))
+            {
+                // Written after the deferred change, not before it
+                return folded;
+            }
+        }
+        bool found = false;
+        withReaderRegistered([&]() {
+            auto itr = mapImpl->find(string_view(key));
+            if (itr != mapImpl->end())
+            {
+                {
+                    VersionWriteGuard versionGuard(itr->second.version);
+                    itr->second.value = value;
+                }
+                // Still registered, the header is not remapped meanwhile
+                header->generation.fetch_add(1, memory_order_acq_rel);
+                found = true;
+            }
+        });
+        if (found)
+        {
+            notifyChange();
+        }
+        return found;
+    }
+
+    /** @brief Remove the struct of key
+     *  @param[in] key - key of the struct
+     */
+    void erase(const string& key)
+    {
+        if (!(opts & O_CREAT))
+        {
+            throw PermissionErrorException();
+        }
+        writeOrDefer(
+            !deferred.empty(),
+            [&]() {
+                applyDeferredLocked();
+                eraseLocked(key);
+            },
+            [&]() { deferred.push({key, nullopt}); });
+    }
+
+    /** @brief Remove all structs from the map */
+    void clear()
+    {
+        if (!(opts & O_CREAT))
+        {
+            throw PermissionErrorException();
+        }
+        writeOrDefer(
+            !deferred.empty(),
+            [&]() {
+                applyDeferredLocked();
+                clearLocked();
+            },
+            [&]() { deferred.pushClear(); });
+    }
+
+    /** @brief Apply the structural changes deferred while readers were
+     * walking the map, waiting for the readers however long they take
+     */
+    void flushDeferred()
+    {
+        if (!(opts & O_CREAT))
+        {
+            throw PermissionErrorException();
+        }
+        if (deferred.empty())
+        {
+            return;
+        }
+        withGrowth([this]() {
+            SequenceWriteGuard guard(*this);
+            applyDeferredLocked();
+        });
+    }
+
+    /** @brief Get the struct of key
+     *  @param[in] key - key of the struct
+     *  @param[out] value - copy of the struct
+     *  @return False if the key is not found
+     *  @throws LockAcquisitionException if the struct stayed locked by a
+     * writer
+     */
+    bool getValue(string_view key, T& value)
+    {
+        bool found = false;
+        withReaderRegistered([&]() {
+            auto itr = mapImpl->find(key);
+            if (itr != mapImpl->end())
+            {
+                readValue(itr->second, value);
+                found = true;
+            }
+        });
+        return found;
+    }
+
+    /** @brief Get all the structs present in the map with their keys
+     *  @return vector of key and struct pairs
+     */
+    vector<pair<string, T>> getAllValues()
+    {
+        vector<pair<string, T>> values;
+        withReaderRegistered([&]() {
+            values.reserve(mapImpl->size());
+            T value;
+            for (const auto& entry : *mapImpl)
+            {
+                const auto& key = entry.first;
+                if (inSegment(key.data(), key.size()))
+                {
+                    readValue(entry.second, value);
+                    values.emplace_back(string(key.data(), key.size()),
+                                        value);
+                }
+            }
+        });
+        return values;
+    }
+
+    /** @brief Returns number of structs in the map */
+    size_t size()
+    {
+        size_t count = 0;
+        withReaderRegistered([&]() { count = mapImpl->size(); });
+        return count;
+    }
+
+  private:
+    /** @brief Insert or overwrite a struct. Must be called by a structural
+     * writer. */
+    void insertLocked(const string& key, const T& value)
+    {
+        auto itr = mapImpl->find(string_view(key));
+        header->generation.fetch_add(1, memory_order_acq_rel);
+        if (itr != mapImpl->end())
+        {
+            VersionWriteGuard versionGuard(itr->second.version);
+            itr->second.value = value;
+            return;
+        }
+        char_string_t mapKey(*voidAllocator);
+        mapKey = key;
+        mapImpl->emplace(std::move(mapKey), value);
+    }
+
+    /** @brief Remove a struct. Must be called by a structural writer. */
+    void eraseLocked(const string& key)
+    {
+        auto itr = mapImpl->find(string_view(key));
+        if (itr != mapImpl->end())
+        {
+            mapImpl->erase(itr);
+            header->generation.fetch_add(1, memory_order_acq_rel);
+        }
+    }
+
+    /** @brief Remove all structs. Must be called by a structural writer. */
+    void clearLocked()
+    {
+        mapImpl->clear();
+        header->generation.fetch_add(1, memory_order_acq_rel);
+    }
+
+    /** @brief Apply the deferred changes. Must be called by a structural
+     * writer, before its own change.
+     */
+    void applyDeferredLocked()
+    {
+        deferred.apply([this](bool cleared, span<DeferredStruct<T>> ops) {
+            if (cleared)
+            {
+                clearLocked();
+            }
+            for (const auto& op : ops)
+            {
+                if (op.value)
+                {
+                    insertLocked(op.key, *op.value);
+                }
+                else
+                {
+                    eraseLocked(op.key);
+                }
+            }
+        });
+    }
+
+    /** @brief Refresh the pointer to the map after a remap */
+    void remapped() override
+    {
+        mapImpl = memory
+                      ->find_no_lock<StructMap<T>>(
+                          string(nameSpace + "map").c_str())
+                      .first;
+    }
+
+    /** @brief Layout of T, checked by readers and on a warm restart */
+    static SegmentLayout segmentLayout()
+    {
+        uint64_t layoutHash = hashString("StructMap");
+        layoutHash = hashCombine(layoutHash, sizeof(T));
+        layoutHash = hashCombine(layoutHash, alignof(T));
+        if constexpr (requires { T::shmemLayoutVersion; })
+        {
+            layoutHash = hashCombine(layoutHash, T::shmemLayoutVersion);
+        }
+        layoutHash = hashCombine(layoutHash, sizeof(StructMap<T>));
+        layoutHash = hashCombine(layoutHash, sizeof(char_string_t));
+        layoutHash = hashCombine(layoutHash, sizeof(void*));
+        layoutHash = hashCombine(layoutHash, BOOST_VERSION);
+        return {layoutHash, sizeof(typename StructMap<T>::value_type)};
+    }
+
+    /** @brief Reject the snapshot publish mode before the segment is created
+     */
+    static const NamespaceOptions& liveOnly(const NamespaceOptions& options)
+    {
+        if (options.publishMode != PublishMode::live)
+        {
+            lg2::error("SHMEMDEBUG: Struct maps only support the live publish "
+                       "mode");
+            throw BadMapException();
+        }
+        return options;
+    }
+
+    /** @brief Copy a struct out of the segment under the read protocol
+     *  @throws LockAcquisitionException if the struct stayed locked by a
+     * writer
+     */
+    static void readValue(const StructMapValue<T>& src, T& dst)
+    {
+        readVersioned(src.version, [&]() {
+            memcpy(static_cast<void*>(&dst), &src.value, sizeof(T));
+        });
+    }
+
+    boost::interprocess::offset_ptr<StructMap<T>> mapImpl;
+
+    /** @brief Keep the segment for the next instance of the producer */
+    bool keepSegment = false;
+
+    /** @brief Structural changes deferred while readers were walking the
+     * map, producer only */
+    DeferredChanges<DeferredStruct<T>> deferred;
+};
+
+} // namespace shmem
+} // namespace nv
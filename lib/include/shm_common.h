@@ -20,9 +20,22 @@
 #include <boost/interprocess/managed_shared_memory.hpp>
 #include <sdbusplus/bus.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+/* Capacity of the inline value and timestamp buffers of an entry. Set by the
+ * inline-value-size and inline-timestamp-size meson options. */
+#ifndef SHMEM_INLINE_VALUE_SIZE
+#define SHMEM_INLINE_VALUE_SIZE 32
+#endif
+#ifndef SHMEM_INLINE_TIMESTAMP_SIZE
+#define SHMEM_INLINE_TIMESTAMP_SIZE 32
+#endif
+
 #ifdef ENABLE_SHM_DEBUG
 #define SHMDEBUG(msg, ...) lg2::info(msg, __VA_ARGS__)
 #else
@@ -70,16 +83,165 @@ using char_allocator_t =
 using char_string_t =
     boost::container::basic_string<char, std::char_traits<char>,
                                    char_allocator_t>;
+/* String stored inside the entry for values up to Capacity bytes, so that
+ * rewriting it is a plain copy with no allocation in the segment. Longer
+ * values go to the overflow string. Its buffer is kept when the value
+ * becomes short again, so a value alternating around Capacity does not
+ * allocate on every update either. */
+template <size_t Capacity>
+struct InlineString
+{
+    uint32_t length;
+    char inlineData[Capacity];
+    char_string_t overflow;
+
+    InlineString(const void_allocator_t& void_alloc) :
+        length(0U), overflow(void_alloc)
+    {}
+
+    InlineString(const InlineString& other) :
+        length(0U), overflow(other.overflow.get_allocator())
+    {
+        assign(other.view());
+    }
+
+    InlineString& operator=(const InlineString& other)
+    {
+        if (this != &other)
+        {
+            assign(other.view());
+        }
+        return *this;
+    }
+
+    InlineString& operator=(std::string_view value)
+    {
+        assign(value);
+        return *this;
+    }
+
+    void assign(std::string_view value)
+    {
+        if (value.size() <= Capacity)
+        {
+            std::memcpy(inlineData, value.data(), value.size());
+        }
+        else
+        {
+            overflow.assign(value.data(), value.size());
+        }
+        length = static_cast<uint32_t>(value.size());
+    }
+
+    bool isInline() const
+    {
+        return length <= Capacity;
+    }
+
+    const char* data() const
+    {
+        return isInline() ? inlineData : overflow.data();
+    }
+
+    size_t size() const
+    {
+        return isInline() ? length : std::min<size_t>(length, overflow.size());
+    }
+
+    std::string_view view() const
+    {
+        return std::string_view(data(), size());
+    }
+};
+
+/* Recent samples of an entry, see SampleHistory in shmem_history.hpp */
+class SampleHistory;
+/* Window aggregates of an entry, see shmem_aggregates.hpp */
+class WindowAggregates;
+/* Key of the change journal records of an entry, see shmem_journal.hpp */
+struct JournalKey;
+
+/* Pointer to a string shared by many entries, see ShmemStringTable */
+using interned_string_ptr_t =
+    boost::interprocess::offset_ptr<const char_string_t>;
+
+using value_string_t = InlineString<SHMEM_INLINE_VALUE_SIZE>;
+using timestamp_string_t = InlineString<SHMEM_INLINE_TIMESTAMP_SIZE>;
+
+/* How the value of an entry is stored. text entries keep the rendered string
+ * in sensorValue. The other kinds keep the raw reading and are rendered to a
+ * string only when a client reads them. */
+enum class MetricValueKind : uint8_t
+{
+    text,
+    floatingPoint,
+    signedInteger,
+    unsignedInteger,
+    boolean,
+    /* Redfish duration, reading in nanoseconds */
+    durationNs,
+    /* Redfish duration, reading in milliseconds */
+    durationMs
+};
+
+/* A reading in its D-Bus type. raw holds the bit pattern of the reading,
+ * text the rendered value of text readings. */
+struct MetricValue
+{
+    MetricValueKind kind = MetricValueKind::text;
+    uint64_t raw = 0;
+    std::string text;
+};
+
+/* version is a per-entry seqcount. It is odd while a producer rewrites the
+ * entry in place, readers copy the fields and retry when it moved. stale is
+ * set on every entry when a restarted producer reattaches to its previous
+ * segment and cleared once the producer writes the entry again. The metric
+ * property URI is the concatenation of two interned strings, the part shared
+ * by the metrics of a device and the part shared by the same metric of all
+ * devices. Values of any other kind than text are kept in rawValue, and a
+ * non zero timestampEpochMs replaces timestampStr, both are rendered when the
+ * entry is read. */
+/* Fields read by every scan come first and share a cache line, the text
+ * buffers follow and the metric property, only needed to render a report,
+ * comes last. */
 struct SensorMapValue
 {
-    char_string_t sensorValue;
-    char_string_t timestampStr;
-    char_string_t metricProperty;
+    std::atomic<uint32_t> version;
+    MetricValueKind valueKind;
+    bool stale;
+    /* Namespace generation of the last write */
+    uint64_t generation;
+    uint64_t rawValue;
     uint64_t timestamp;
+    uint64_t timestampEpochMs;
+    value_string_t sensorValue;
+    timestamp_string_t timestampStr;
+    interned_string_ptr_t metricPropertyBase;
+    interned_string_ptr_t metricPropertySuffix;
+    /* Null unless the namespace keeps history */
+    boost::interprocess::offset_ptr<SampleHistory> history;
+    /* Null unless the namespace keeps window aggregates */
+    boost::interprocess::offset_ptr<WindowAggregates> aggregates;
+    /* Null unless the namespace keeps a journal in live mode */
+    boost::interprocess::offset_ptr<const JournalKey> journalKey;
 
     SensorMapValue(const void_allocator_t& void_alloc) :
-        sensorValue(void_alloc), timestampStr(void_alloc),
-        metricProperty(void_alloc), timestamp(0U)
+        version(0U), valueKind(MetricValueKind::text), stale(false),
+        generation(0U), rawValue(0U), timestamp(0U), timestampEpochMs(0U),
+        sensorValue(void_alloc), timestampStr(void_alloc)
+    {}
+
+    SensorMapValue(const SensorMapValue& other) :
+        version(0U), valueKind(other.valueKind), stale(other.stale),
+        generation(other.generation), rawValue(other.rawValue),
+        timestamp(other.timestamp),
+        timestampEpochMs(other.timestampEpochMs),
+        sensorValue(other.sensorValue), timestampStr(other.timestampStr),
+        metricPropertyBase(other.metricPropertyBase),
+        metricPropertySuffix(other.metricPropertySuffix),
+        history(other.history), aggregates(other.aggregates),
+        journalKey(other.journalKey)
     {}
 };
 
@@ -89,6 +251,9 @@ struct SensorValue
     std::string metricProperty;
     uint64_t timestamp;
     std::string timestampStr;
+    /* Last known value served from before a producer restart, not yet
+     * refreshed by the producer. */
+    bool stale = false;
 
     SensorValue() = default;
 
@@ -99,18 +264,94 @@ struct SensorValue
         metricProperty(metricProperty), timestamp(timestamp),
         timestampStr(timestampStr)
     {}
+};
 
-    SensorValue& operator=(const SensorMapValue& mapValue)
-    {
-        metricProperty = mapValue.metricProperty;
-        timestampStr = mapValue.timestampStr;
-        sensorValue = mapValue.sensorValue;
-        timestamp = mapValue.timestamp;
-        return *this;
-    }
+/* Object passed to the visitor of a namespace scan. The views are only valid
+ * during the visitor call. */
+struct SensorValueView
+{
+    std::string_view key;
+    std::string_view sensorValue;
+    std::string_view metricProperty;
+    uint64_t timestamp;
+    std::string_view timestampStr;
+    bool stale;
 };
 
 using ShmemKeyValuePairs = std::unordered_map<std::string, std::string>;
 
+/* Sample of the history of an object, see getHistory */
+struct HistorySample
+{
+    uint64_t timestampMs;
+    double value;
+};
+
+/* Aggregates of the samples of an object over a time window, see
+ * getAggregates. The rate is the increase per second of a counter. */
+struct MetricAggregates
+{
+    double minimum;
+    double maximum;
+    double average;
+    double ratePerSecond;
+    uint32_t samples;
+    uint64_t windowMs;
+};
+
+/* Position of a reader in the write history of a namespace. Passed to
+ * getValuesChangedSince, which moves it forward. A default cursor reads all
+ * the objects. */
+struct ChangeCursor
+{
+    /* Identifies the segment, a recreated namespace restarts its history */
+    uint64_t instance = 0;
+    uint64_t generation = 0;
+};
+
+/* Position of a chunked scan, see getValuesChunk. A default cursor starts
+ * at the first object. */
+struct ScanCursor
+{
+    /* Key of the last object of the previous chunk, for ordered maps */
+    std::string lastKey;
+    /* First home slot of the next chunk, for hash maps */
+    size_t bucket = 0;
+    /* Home slots of the hash map when bucket was set, it may grow between
+     * chunks */
+    size_t buckets = 0;
+    bool started = false;
+    bool done = false;
+};
+
+/* Kind of a change recorded in the journal of a namespace */
+enum class ChangeKind : uint8_t
+{
+    /* The object was inserted or its value changed */
+    upsert,
+    erase,
+    /* Changes were not recorded, readers read all the objects again */
+    reset
+};
+
+/* Change of an object read from the journal of a namespace, see
+ * getChangesSince */
+struct ChangeRecord
+{
+    std::string key;
+    ChangeKind kind;
+    uint64_t generation;
+    uint64_t timestampMs;
+};
+
+/* Position of a reader in the journal of a namespace. A default cursor
+ * starts with a resync. */
+struct JournalCursor
+{
+    /* Identifies the segment, a recreated namespace restarts its journal */
+    uint64_t instance = 0;
+    uint64_t position = 0;
+};
+
 } // namespace shmem
 } // namespace nv
@@ -36,10 +36,40 @@ Example:
     std::string metricId = "PlatformEnvironmentMetrics";
     const auto& values =
 nv::shmem::sensor_aggregation::getAllMRDValues(metricId);
+
+visitMRDValues
+*******************************************************************************
+This API passes the same values to a callback as views, so that clients can
+serialize them without copying them first.
+
+Example:
+-------------------------------------------------------------------------------
+    nv::shmem::sensor_aggregation::visitMRDValues(
+        metricId, [&](const nv::shmem::SensorValueView& value) {
+            json[std::string(value.metricProperty)] = value.sensorValue;
+        });
+
+getMRDValuesChangedSince
+*******************************************************************************
+This API returns the objects of a MRD namespace written since the previous call
+with the same cursors. Clients polling a MRD keep their last result and apply
+the changes to it, or replace it when full is set.
+
+Example:
+-------------------------------------------------------------------------------
+    std::string metricId = "PlatformEnvironmentMetrics";
+    nv::shmem::sensor_aggregation::MRDChangeCursors cursors;
+    bool full = false;
+    const auto& changes =
+nv::shmem::sensor_aggregation::getMRDValuesChangedSince(metricId, cursors,
+                                                        full);
 */
 #pragma once
 #include <shm_common.h>
 
+#include <chrono>
+#include <functional>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -61,6 +91,132 @@ namespace sensor_aggregation
  */
 std::vector<SensorValue> getAllMRDValues(const std::string& mrdNamespace);
 
+/**
+ * @brief Same as getAllMRDValues, reading the namespaces in chunks of about
+ * chunkEntries values, so that producers inserting or erasing values wait for
+ * one chunk at most instead of the whole read.
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @param[in] chunkEntries - values per chunk, 0 to read each namespace at once
+ * @return values - metric report definitions values. Exceptions are thrown
+ * like for getAllMRDValues.
+ */
+std::vector<SensorValue> getAllMRDValues(const std::string& mrdNamespace,
+                                         size_t chunkEntries);
+
+/**
+ * @brief This API calls visitor on every metric report definition of a given
+ * namespace, without copying them into SensorValue objects. The views passed
+ * to visitor are only valid during the call, clients such as bmcweb serialize
+ * them directly. visitor must not call the APIs of this library. Exceptions
+ * are thrown like for getAllMRDValues.
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @param[in] visitor - callback called once per value
+ * @return number of values visited
+ */
+size_t
+    visitMRDValues(const std::string& mrdNamespace,
+                   const std::function<void(const SensorValueView&)>& visitor);
+
+/**
+ * @brief This API returns the metric report definitions of a given namespace
+ * whose key starts with prefix. Keys are the D-Bus path of the device followed
+ * by '/', the interface and the metric name, so the values of one device are
+ * requested with its path and a trailing '/'.
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @param[in] prefix - key prefix such as a device path
+ * @return values - matching metric report definitions values, may be empty.
+ * Exception is thrown in case of absence of given namespace in MRD lookup.
+ */
+std::vector<SensorValue> getMRDValuesByPrefix(const std::string& mrdNamespace,
+                                              std::string_view prefix);
+
+/**
+ * @brief This API returns the metric report definitions of a given namespace
+ * whose metric property is one of uris, such as the MetricProperties of a
+ * MetricReportDefinition or the single property of a GET. Namespaces with
+ * `MetricPropertyIndex` enabled are not scanned.
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @param[in] uris - Redfish metric property URIs
+ * @return values - matching metric report definitions values, may be empty.
+ * Exception is thrown in case of absence of given namespace in MRD lookup.
+ */
+std::vector<SensorValue>
+    getMRDValuesByMetricProperties(const std::string& mrdNamespace,
+                                   const std::vector<std::string>& uris);
+
+/**
+ * @brief This API returns the recent samples of an object of a given
+ * namespace, kept when the namespace is configured with `HistorySamples`.
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @param[in] key - key of the object
+ * @param[in] sinceMs - only samples with a later timestamp are returned
+ * @return samples - oldest first, may be empty. Exception is thrown in case
+ * of absence of given namespace in MRD lookup.
+ */
+std::vector<HistorySample> getMRDHistory(const std::string& mrdNamespace,
+                                         const std::string& key,
+                                         uint64_t sinceMs = 0);
+
+/**
+ * @brief This API returns the minimum, maximum, average and rate per second
+ * of an object of a given namespace over the window configured with
+ * `AggregationWindowSeconds`, ending at its last sample.
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @param[in] key - key of the object
+ * @param[out] aggregates - aggregates of the object
+ * @return False if no producer keeps aggregates of the object. Exception is
+ * thrown in case of absence of given namespace in MRD lookup.
+ */
+bool getMRDAggregates(const std::string& mrdNamespace, const std::string& key,
+                      MetricAggregates& aggregates);
+
+/** Change cursors of the shared memory namespaces of a MRD */
+using MRDChangeCursors = std::unordered_map<std::string, ChangeCursor>;
+
+/**
+ * @brief This API returns the metric report definitions of a given namespace
+ * written since the previous call with the same cursors, and moves the
+ * cursors forward. All the values are returned, with full set, on the first
+ * call and when values were removed since the previous call, the client then
+ * replaces the values it has.
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @param[in,out] cursors - cursors of the previous call, empty for the first
+ * @param[out] full - true if all the values are returned
+ * @return values - changed metric report definitions values, may be empty.
+ * Exception is thrown in case of absence of given namespace in MRD lookup.
+ */
+std::vector<SensorValue>
+    getMRDValuesChangedSince(const std::string& mrdNamespace,
+                             MRDChangeCursors& cursors, bool& full);
+
+/** Journal cursors of the shared memory namespaces of a MRD */
+using MRDJournalCursors = std::unordered_map<std::string, JournalCursor>;
+
+/**
+ * @brief This API returns the changes of the metric report definitions of a
+ * given namespace recorded since the previous call with the same cursors,
+ * and moves the cursors forward. Used to stream changes, e.g. to SSE
+ * subscribers, without scanning the namespaces. resync is set on the first
+ * call, when a producer was restarted or when the client fell behind a
+ * journal: the client then reads all the values again with getAllMRDValues.
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @param[in,out] cursors - cursors of the previous call, empty for the first
+ * @param[out] resync - true if the client must read all the values again
+ * @return changes - changes of the producers that kept up, may be empty.
+ * Exception is thrown in case of absence of given namespace in MRD lookup.
+ */
+std::vector<ChangeRecord> getMRDChanges(const std::string& mrdNamespace,
+                                        MRDJournalCursors& cursors,
+                                        bool& resync);
+
 std::vector<std::string> getMrdNamespacesValues();
 
 /**
@@ -74,6 +230,22 @@ std::vector<std::string> getMrdNamespacesValues();
  * or absence of given shared memory namespace exception is thrown.
  */
 ShmemKeyValuePairs getAllKeyValuePair(const std::string& mrdNamespace);
+
+/**
+ * @brief This API blocks until the producer of a shared memory namespace
+ * makes a change visible, or timeout expires. Clients call it with the
+ * generation it returned before reading the namespace again, instead of
+ * polling on a timer. Start with 0.
+ *
+ * @param[in] nameSpace - shmem namespace
+ * @param[in] lastGeneration - generation returned by the previous call
+ * @param[in] timeout - longest time to wait
+ * @return generation - current generation, lastGeneration on timeout.
+ * NameSpaceNotFoundException is thrown in case of absence of given shared
+ * memory namespace.
+ */
+uint64_t waitForChange(const std::string& nameSpace, uint64_t lastGeneration,
+                       std::chrono::milliseconds timeout);
 /**
  * @brief This exception should be thrown when name space is not found in shared
  * memory.
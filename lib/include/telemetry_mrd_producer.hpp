@@ -85,6 +85,21 @@ Example: Update timestamp and value
                 << std::endl;
     }
 
+Example: Publish a poll cycle (snapshot mode namespaces)
+-------------------------------------------------------------------------------
+    // after all updateTelemetry calls of the cycle
+    AggregationService::publishUpdates();
+
+Example: Make new objects visible without a publish (live mode namespaces)
+-------------------------------------------------------------------------------
+    // after updateTelemetry calls that may have added objects
+    AggregationService::flushDeferredUpdates();
+
+Example: Drop objects not rediscovered after a warm restart
+-------------------------------------------------------------------------------
+    // after the first complete poll cycle
+    AggregationService::purgeStaleTelemetry();
+
 Example: Update nan
 -------------------------------------------------------------------------------
     if (AggregationService::updateTelemetry(
@@ -156,6 +171,39 @@ struct AggregationService
                                 DbusVariantType& value,
                                 const uint64_t timestamp, int rc,
                                 const std::string associatedEntityPath = {});
+
+    /**
+     * @brief API to publish all updates made since the previous call. Only
+     * namespaces configured with "PublishMode": "Snapshot" are affected,
+     * readers of those see the new values together once this returns. Call it
+     * at the end of every poll cycle. Objects added or removed while clients
+     * were reading a live namespace are applied as well.
+     *
+     * @return true
+     * @return false
+     */
+    static bool publishUpdates();
+
+    /**
+     * @brief API to apply the objects added or removed since the previous
+     * call while clients were reading, which updateTelemetry defers rather
+     * than waiting for the clients. They are applied by the next object
+     * added or removed otherwise. Waits for the clients to finish reading.
+     *
+     * @return true
+     * @return false
+     */
+    static bool flushDeferredUpdates();
+
+    /**
+     * @brief API to remove telemetry objects kept from the previous instance
+     * of the producer by a warm restart ("WarmRestart": true) which were not
+     * updated since. Call it once all devices were polled after startup.
+     *
+     * @return true
+     * @return false
+     */
+    static bool purgeStaleTelemetry();
 };
 } // namespace shmem
 } // namespace nv
@@ -17,69 +17,640 @@
 
 #include "impl/managed_shmem.hpp"
 
-#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "impl/shared_segment.hpp"
 
 #include <boost/interprocess/containers/map.hpp>
 #include <phosphor-logging/lg2.hpp>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <cerrno>
 #include <chrono>
+#include <climits>
+#include <csignal>
+#include <fstream>
+#include <shared_mutex>
+#include <sstream>
 #include <stdexcept>
 
 using namespace std;
 using namespace nv::shmem;
 
+namespace
+{
+
+/** @brief Start time of a process in clock ticks after boot, from
+ * /proc/<pid>/stat
+ *  @param[in] pid - process id
+ *  @param[out] zombie - true if the process exited but was not reaped
+ *  @return uint64_t - 0 if it can not be read
+ */
+uint64_t processStartTime(pid_t pid, bool& zombie)
+{
+    zombie = false;
+    ifstream stat("/proc/" + to_string(pid) + "/stat");
+    string line;
+    if (!getline(stat, line))
+    {
+        return 0;
+    }
+    // The command name may hold spaces, the fields after it start at the
+    // state, field 3. The start time is field 22.
+    auto end = line.rfind(')');
+    if (end == string::npos)
+    {
+        return 0;
+    }
+    istringstream fields(line.substr(end + 1));
+    string state;
+    fields >> state;
+    zombie = state == "Z";
+    string field;
+    for (int i = 4; i <= 22; i++)
+    {
+        if (!(fields >> field))
+        {
+            return 0;
+        }
+    }
+    return strtoull(field.c_str(), nullptr, 10);
+}
+
+/** @brief False if the process tagged by owner, see readerSlotOwner, is gone
+ */
+bool readerAlive(uint64_t owner)
+{
+    auto pid = static_cast<pid_t>(owner & 0xFFFFFFFFU);
+    if (kill(pid, 0) != 0 && errno == ESRCH)
+    {
+        return false;
+    }
+    bool zombie = false;
+    uint64_t startTime = processStartTime(pid, zombie);
+    if (startTime == 0)
+    {
+        // No procfs to tell a reused pid apart
+        return true;
+    }
+    return !zombie && (owner >> 32) == (startTime & 0xFFFFFFFFU);
+}
+
+} // namespace
+
+uint64_t nv::shmem::readerSlotOwner(pid_t pid)
+{
+    bool zombie = false;
+    return (processStartTime(pid, zombie) << 32) |
+           static_cast<uint32_t>(pid);
+}
+
 ManagedShmem::ManagedShmem(const string& nameSpace, const int opts,
-                           size_t maxSize) :
+                           size_t maxSize, const NamespaceOptions& options,
+                           const SegmentLayout& layout) :
+    opts(opts),
+    nameSpace(nameSpace),
+    publishMode(options.publishMode)
+{
+    if (!options.segment.empty())
+    {
+        if (options.warmRestart)
+        {
+            lg2::info("SHMEMDEBUG: {SHM_NAMESPACE} is in shared segment "
+                      "{SHM_SEGMENT}, warm restart is not supported",
+                      "SHM_NAMESPACE", nameSpace, "SHM_SEGMENT",
+                      options.segment);
+        }
+        segment = SharedSegment::create(
+            options.segment,
+            options.segmentSize ? options.segmentSize : maxSize);
+        memory = segment->memory;
+        if (options.maxSizeInBytes != 0)
+        {
+            lg2::info("SHMEMDEBUG: {SHM_NAMESPACE} is in shared segment "
+                      "{SHM_SEGMENT}, it does not grow",
+                      "SHM_NAMESPACE", nameSpace, "SHM_SEGMENT",
+                      options.segment);
+        }
+    }
+    else if (options.warmRestart && tryWarmAttach(maxSize, options, layout))
+    {
+        warmAttached = true;
+    }
+    else
+    {
+        if (!boost::interprocess::shared_memory_object::remove(
+                string(nameSpace).c_str()))
+        {
+            SHMDEBUG(
+                "SHMEMDEBUG: Shared memory namespace {SHM_NAMESPACE} does not exist. "
+                "Remove is skipped.",
+                "SHM_NAMESPACE", nameSpace);
+        }
+        memory = make_shared<boost::interprocess::managed_shared_memory>(
+            boost::interprocess::open_or_create, nameSpace.c_str(), maxSize);
+    }
+
+    voidAllocator =
+        make_unique<void_allocator_t>(memory->get_segment_manager());
+    if (segment == nullptr)
+    {
+        mapReaderCounters();
+        claimReaderSlot();
+        maxSegmentSize = options.maxSizeInBytes;
+    }
+
+    if (warmAttached)
+    {
+        return;
+    }
+    auto namedObjectsLock = lockNamedObjects();
+    header = memory->find_or_construct<ShmemHeader>(
+        string(nameSpace + "header").c_str())();
+    if (header == nullptr)
+    {
+        throw BadMapException();
+    }
+    if (segment != nullptr)
+    {
+        readers = &segment->addNamespace(nameSpace, header);
+        memLock = &readers->lock;
+        claimReaderSlot();
+    }
+    header->publishMode = options.publishMode;
+    header->instance = static_cast<uint64_t>(
+        chrono::system_clock::now().time_since_epoch().count());
+    header->layoutVersion = shmemLayoutVersion;
+    header->layoutHash = layout.layoutHash;
+    header->entrySize = layout.entrySize;
+    header->configHash = options.configHash;
+}
+
+bool ManagedShmem::tryWarmAttach(size_t maxSize,
+                                 const NamespaceOptions& options,
+                                 const SegmentLayout& layout)
+{
+    try
+    {
+        memory = make_shared<boost::interprocess::managed_shared_memory>(
+            boost::interprocess::open_only, nameSpace.c_str());
+    }
+    catch (const boost::interprocess::interprocess_exception& e)
+    {
+        SHMDEBUG("SHMEMDEBUG: No previous segment for {SHM_NAMESPACE} to "
+                 "attach to: {EXCEPTION}",
+                 "SHM_NAMESPACE", nameSpace, "EXCEPTION", e.what());
+        return false;
+    }
+    header =
+        memory->find<ShmemHeader>(string(nameSpace + "header").c_str()).first;
+    string mismatch;
+    if (header == nullptr)
+    {
+        mismatch = "header";
+    }
+    else if (header->layoutVersion != shmemLayoutVersion ||
+             header->layoutHash != layout.layoutHash ||
+             header->entrySize != layout.entrySize)
+    {
+        mismatch = "layout";
+    }
+    else if (header->configHash != options.configHash ||
+             header->publishMode != options.publishMode ||
+             memory->get_size() < maxSize)
+    {
+        mismatch = "configuration";
+    }
+    else if (header->sequence.load() & 1U)
+    {
+        // The previous instance died in the middle of a structural change
+        mismatch = "sequence";
+    }
+    if (!mismatch.empty())
+    {
+        lg2::info("SHMEMDEBUG: Previous segment of {SHM_NAMESPACE} can not be "
+                  "reused, {MISMATCH} differs. Recreating it.",
+                  "SHM_NAMESPACE", nameSpace, "MISMATCH", mismatch);
+        header = nullptr;
+        memory.reset();
+        return false;
+    }
+    lg2::info("SHMEMDEBUG: Warm attached to previous segment of "
+              "{SHM_NAMESPACE}",
+              "SHM_NAMESPACE", nameSpace);
+    return true;
+}
+
+ManagedShmem::ManagedShmem(const string& nameSpace, const int opts,
+                           const string& segmentName) :
     opts(opts),
     nameSpace(nameSpace)
 {
-    if (!boost::interprocess::shared_memory_object::remove(
-            string(nameSpace).c_str()))
+    if (!segmentName.empty())
     {
-        SHMDEBUG(
-            "SHMEMDEBUG: Shared memory namespace {SHM_NAMESPACE} does not exist. "
-            "Remove is skipped.",
-            "SHM_NAMESPACE", nameSpace);
+        // Mapped once per process, shared with the other namespaces
+        segment = SharedSegment::open(segmentName);
+        memory = segment->memory;
+        voidAllocator =
+            make_unique<void_allocator_t>(memory->get_segment_manager());
+        auto directoryLock = lockNamedObjects();
+        header = segment->findNamespace(nameSpace, readers);
+        if (header == nullptr)
+        {
+            throw BadMapException();
+        }
+        memLock = &readers->lock;
+        claimReaderSlot();
+        publishMode = header->publishMode;
+        return;
     }
-    memory = make_unique<boost::interprocess::managed_shared_memory>(
-        boost::interprocess::open_or_create, nameSpace.c_str(), maxSize);
+    // Readers never write to the segment, a stray write faults instead of
+    // corrupting what the producer relies on
+    memory = make_shared<boost::interprocess::managed_shared_memory>(
+        boost::interprocess::open_read_only, nameSpace.c_str());
+    voidAllocator =
+        make_unique<void_allocator_t>(memory->get_segment_manager());
+    mapReaderCounters();
+    claimReaderSlot();
 
-    if (!boost::interprocess::named_upgradable_mutex::remove(
-            string(nameSpace + "lock").c_str()))
+    // The segment mutex can not be taken in a read only mapping. The named
+    // objects are all constructed by the producer before it publishes data.
+    header =
+        memory->find_no_lock<ShmemHeader>(string(nameSpace + "header").c_str())
+            .first;
+    if (header == nullptr)
     {
-        SHMDEBUG(
-            "SHMEMDEBUG: Shared memory namespace lock {SHM_NAMESPACE_LOCK} "
-            "does not "
-            "exist. Remove lock is skipped.",
-            "SHM_NAMESPACE_LOCK", nameSpace + "lock");
+        throw BadMapException();
     }
-    memLock = make_unique<boost::interprocess::named_upgradable_mutex>(
-        boost::interprocess::create_only, string(nameSpace + "lock").c_str());
-    memLock->unlock();
+    mappedRemapGeneration = header->remapGeneration.load(memory_order_acquire);
+    publishMode = header->publishMode;
+}
 
+void ManagedShmem::remap()
+{
+    // Registered, the generation can not move until the walk is over. The
+    // exclusive mapping lock keeps the other threads off the old mapping.
+    uint64_t generation = header->remapGeneration.load(memory_order_acquire);
+    memory = make_shared<boost::interprocess::managed_shared_memory>(
+        boost::interprocess::open_read_only, nameSpace.c_str());
     voidAllocator =
         make_unique<void_allocator_t>(memory->get_segment_manager());
+    header =
+        memory->find_no_lock<ShmemHeader>(string(nameSpace + "header").c_str())
+            .first;
+    if (header == nullptr)
+    {
+        throw BadMapException();
+    }
+    mappedRemapGeneration = generation;
+    remapped();
+    SHMDEBUG("SHMEMDEBUG: Remapped {SHM_NAMESPACE} grown to {SIZE} bytes",
+             "SHM_NAMESPACE", nameSpace, "SIZE", memory->get_size());
+}
+
+bool ManagedShmem::growSegment()
+{
+    SequenceWriteGuard guard(*this);
+    return growSegmentLocked();
 }
 
-ManagedShmem::ManagedShmem(const string& nameSpace, const int opts) :
-    opts(opts), nameSpace(nameSpace)
+bool ManagedShmem::growSegmentLocked()
 {
-    memory = make_unique<boost::interprocess::managed_shared_memory>(
+    size_t size = memory->get_size();
+    if (segment != nullptr || size >= maxSegmentSize)
+    {
+        lg2::error("SHMEMDEBUG: {SHM_NAMESPACE} is out of memory at {SIZE} "
+                   "bytes and can not grow",
+                   "SHM_NAMESPACE", nameSpace, "SIZE", size);
+        return false;
+    }
+    // Doubling keeps the number of remaps logarithmic in the final size
+    size_t extra = min(size, maxSegmentSize - size);
+    // Registered readers are drained by the write guard, the snapshot
+    // readers of this process only leave the front buffer on their own
+    unique_lock exclusive(mappingLock);
+    voidAllocator.reset();
+    memory.reset();
+    bool grown = boost::interprocess::managed_shared_memory::grow(
+        nameSpace.c_str(), extra);
+    memory = make_shared<boost::interprocess::managed_shared_memory>(
         boost::interprocess::open_only, nameSpace.c_str());
-    memLock = make_unique<boost::interprocess::named_upgradable_mutex>(
-        boost::interprocess::open_only, string(nameSpace + "lock").c_str());
     voidAllocator =
         make_unique<void_allocator_t>(memory->get_segment_manager());
+    header =
+        memory->find<ShmemHeader>(string(nameSpace + "header").c_str()).first;
+    if (header == nullptr)
+    {
+        throw BadMapException();
+    }
+    if (grown)
+    {
+        // Readers are drained, they see it once they register again
+        header->remapGeneration.fetch_add(1, memory_order_release);
+        lg2::info("SHMEMDEBUG: Grew {SHM_NAMESPACE} to {SIZE} bytes",
+                  "SHM_NAMESPACE", nameSpace, "SIZE", memory->get_size());
+    }
+    else
+    {
+        lg2::error("SHMEMDEBUG: Growing {SHM_NAMESPACE} by {EXTRA} bytes "
+                   "failed",
+                   "SHM_NAMESPACE", nameSpace, "EXTRA", extra);
+    }
+    remapped();
+    return grown;
+}
+
+void ManagedShmem::mapReaderCounters()
+{
+    string name = nameSpace + "readers";
+    if ((opts & O_CREAT) && !warmAttached)
+    {
+        if (!boost::interprocess::shared_memory_object::remove(name.c_str()))
+        {
+            SHMDEBUG("SHMEMDEBUG: Reader counters {SHM_READERS} do not exist. "
+                     "Remove is skipped.",
+                     "SHM_READERS", name);
+        }
+    }
+    auto object =
+        (opts & O_CREAT)
+            ? boost::interprocess::shared_memory_object(
+                  boost::interprocess::open_or_create, name.c_str(),
+                  boost::interprocess::read_write)
+            : boost::interprocess::shared_memory_object(
+                  boost::interprocess::open_only, name.c_str(),
+                  boost::interprocess::read_write);
+    boost::interprocess::offset_t size = 0;
+    bool created = (opts & O_CREAT) && object.get_size(size) &&
+                   size < static_cast<boost::interprocess::offset_t>(
+                              sizeof(ReaderCounters));
+    if (created)
+    {
+        object.truncate(sizeof(ReaderCounters));
+    }
+    else if (!object.get_size(size) ||
+             size < static_cast<boost::interprocess::offset_t>(
+                        sizeof(ReaderCounters)))
+    {
+        // Left by a producer built with fewer counters, mapping past its end
+        // would fault
+        throw BadMapException();
+    }
+    readerRegion = make_unique<boost::interprocess::mapped_region>(
+        object, boost::interprocess::read_write, 0, sizeof(ReaderCounters));
+    readers = created ? new (readerRegion->get_address()) ReaderCounters()
+                      : static_cast<ReaderCounters*>(
+                            readerRegion->get_address());
+    // A lock held by a process that died is recovered by the next locker
+    memLock = &readers->lock;
+    if ((opts & O_CREAT) && !created)
+    {
+        // Readers killed while registered would hold the new instance back
+        unique_lock lock(*memLock);
+        reclaimDeadReaders();
+        bool owned = false;
+        for (const auto& slot : readers->slots)
+        {
+            owned = owned || slot.owner.load(memory_order_acquire) != 0;
+        }
+        if (!owned)
+        {
+            readers->changeWaiters.store(0, memory_order_relaxed);
+        }
+    }
 }
 
-void ManagedShmem::TryReadLock()
+void ManagedShmem::claimReaderSlot()
 {
-    boost::posix_time::ptime abs_time =
-        boost::posix_time::microsec_clock::universal_time() +
-        boost::posix_time::seconds(1);
-    shmem_read_lock_t lock(*memLock, abs_time);
+    uint64_t owner = readerSlotOwner(getpid());
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        for (auto& slot : readers->slots)
+        {
+            uint64_t expected = 0;
+            if (slot.owner.compare_exchange_strong(expected, owner,
+                                                   memory_order_acq_rel))
+            {
+                readerSlot = &slot;
+                return;
+            }
+        }
+        shmem_write_lock_t lock(*memLock, chrono::seconds(1));
+        if (!lock)
+        {
+            throw LockAcquisitionException();
+        }
+        reclaimDeadReaders();
+    }
+    lg2::error("SHMEMDEBUG: All {COUNT} reader slots of {SHM_NAMESPACE} are "
+               "in use",
+               "COUNT", maxReaderSlots, "SHM_NAMESPACE", nameSpace);
+    throw LockAcquisitionException();
+}
+
+size_t ManagedShmem::reclaimDeadReaders()
+{
+    lastReaderReclaim.store(
+        chrono::steady_clock::now().time_since_epoch().count(),
+        memory_order_relaxed);
+    size_t reclaimed = 0;
+    for (auto& slot : readers->slots)
+    {
+        uint64_t owner = slot.owner.load(memory_order_acquire);
+        if (owner == 0 || readerAlive(owner))
+        {
+            continue;
+        }
+        // Nobody else writes the slot of a dead process, and the other
+        // reclaimers hold the namespace lock
+        uint32_t registered = slot.activeReaders.exchange(0) +
+                              slot.snapshotReaders[0].exchange(0) +
+                              slot.snapshotReaders[1].exchange(0);
+        slot.owner.store(0, memory_order_release);
+        reclaimed++;
+        lg2::error("SHMEMDEBUG: Reader {PID} of {SHM_NAMESPACE} died, "
+                   "dropped its {COUNT} registrations",
+                   "PID", owner & 0xFFFFFFFFU, "SHM_NAMESPACE", nameSpace,
+                   "COUNT", registered);
+    }
+    return reclaimed;
+}
+
+ManagedShmem::~ManagedShmem()
+{
+    if (readerSlot != nullptr)
+    {
+        readerSlot->owner.store(0, memory_order_release);
+    }
+}
+
+shmem_write_lock_t ManagedShmem::lockNamedObjects()
+{
+    if (segment == nullptr)
+    {
+        return {};
+    }
+    return segment->lockDirectory();
+}
+
+shmem_read_lock_t ManagedShmem::TryReadLock()
+{
+    shmem_read_lock_t lock(*memLock, chrono::seconds(1));
     if (!lock)
     {
         throw LockAcquisitionException();
     }
+    shared_lock mapping(mappingLock);
+    if (header->sequence.load(memory_order_acquire) & 1U)
+    {
+        // Structural writers hold the lock until the sequence is even again,
+        // so the producer died in the middle of a structural change. Only the
+        // first locker sees the owner death, every reader checks the sequence
+        // as the map may be half written until the producer restarts.
+        throw BadMapException();
+    }
+    return lock;
+}
+
+ManagedShmem::SequenceWriteGuard::SequenceWriteGuard(ManagedShmem& shmem) :
+    lock(*shmem.memLock), shmem(shmem), readers(*shmem.readers)
+{
+    shmem.header->sequence.fetch_add(1, memory_order_seq_cst);
+    // Readers register before they walk the tree, wait for the ones already
+    // inside. New readers see the odd sequence and back off.
+    auto deadline = chrono::steady_clock::now() + readerDrainTimeout;
+    while (readers.activeReaders() != 0)
+    {
+        if (chrono::steady_clock::now() > deadline &&
+            (shmem.reclaimDeadReaders() == 0 || readers.activeReaders() != 0))
+        {
+            // The live readers may still be walking the tree, nodes can only
+            // be freed once they are gone
+            lg2::error("SHMEMDEBUG: Readers of {SHM_NAMESPACE} did not drain "
+                       "within timeout, {COUNT} still registered",
+                       "SHM_NAMESPACE", shmem.nameSpace, "COUNT",
+                       readers.activeReaders());
+            deadline += readerDrainTimeout;
+        }
+        this_thread::yield();
+    }
+}
+
+ManagedShmem::SequenceWriteGuard::SequenceWriteGuard(
+    ManagedShmem& shmem, chrono::steady_clock::duration drainTimeout) :
+    lock(*shmem.memLock), shmem(shmem), readers(*shmem.readers)
+{
+    shmem.header->sequence.fetch_add(1, memory_order_seq_cst);
+    auto deadline = chrono::steady_clock::now() + drainTimeout;
+    while (readers.activeReaders() != 0)
+    {
+        if (chrono::steady_clock::now() >= deadline &&
+            (shmem.reclaimDeadReaders() == 0 || readers.activeReaders() != 0))
+        {
+            // Nothing was modified, the readers go on as if the sequence had
+            // never been odd
+            SHMDEBUG("SHMEMDEBUG: Readers of {SHM_NAMESPACE} still "
+                     "registered, {COUNT} of them",
+                     "SHM_NAMESPACE", shmem.nameSpace, "COUNT",
+                     readers.activeReaders());
+            shmem.header->sequence.fetch_add(1, memory_order_release);
+            lock.unlock();
+            return;
+        }
+        this_thread::yield();
+    }
+}
+
+ManagedShmem::SequenceWriteGuard::~SequenceWriteGuard()
+{
+    if (!lock.owns_lock())
+    {
+        return;
+    }
+    shmem.header->sequence.fetch_add(1, memory_order_release);
+    if (shmem.publishMode == PublishMode::live)
+    {
+        shmem.notifyChange();
+    }
+}
+
+void ManagedShmem::notifyChange()
+{
+    // Pairs with the fence in waitForChange, either a waiter is seen here or
+    // it reads the new generation before it blocks
+    atomic_thread_fence(memory_order_seq_cst);
+    if (readers->changeWaiters.load(memory_order_relaxed) == 0)
+    {
+        return;
+    }
+    readers->changeSequence.fetch_add(1, memory_order_release);
+    // Not FUTEX_PRIVATE_FLAG, the waiters are other processes
+    syscall(SYS_futex, &readers->changeSequence, FUTEX_WAKE, INT_MAX, nullptr,
+            nullptr, 0);
+}
+
+uint64_t ManagedShmem::waitForChange(uint64_t lastGeneration,
+                                     chrono::milliseconds timeout)
+{
+    auto deadline = chrono::steady_clock::now() + timeout;
+    while (true)
+    {
+        // Registered before the generation is read, the producer only moves
+        // the futex word when it sees a waiter
+        readers->changeWaiters.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        // Read before the generation, a change after it moves the futex word
+        // and the wait returns at once
+        uint32_t sequence = readers->changeSequence.load(memory_order_acquire);
+        uint64_t generation = visibleGeneration();
+        auto remaining = deadline - chrono::steady_clock::now();
+        if (generation != lastGeneration || remaining <= remaining.zero())
+        {
+            readers->changeWaiters.fetch_sub(1, memory_order_release);
+            return generation;
+        }
+        auto remainingNs =
+            chrono::duration_cast<chrono::nanoseconds>(remaining).count();
+        timespec relative{static_cast<time_t>(remainingNs / 1000000000),
+                          static_cast<long>(remainingNs % 1000000000)};
+        long result = syscall(SYS_futex, &readers->changeSequence, FUTEX_WAIT,
+                              sequence, &relative, nullptr, 0);
+        int error = errno;
+        readers->changeWaiters.fetch_sub(1, memory_order_release);
+        if (result != 0 && error != EAGAIN && error != EINTR &&
+            error != ETIMEDOUT)
+        {
+            SHMDEBUG("SHMEMDEBUG: Futex wait on {SHM_NAMESPACE} failed with "
+                     "{ERRNO}, polling",
+                     "SHM_NAMESPACE", nameSpace, "ERRNO", error);
+            this_thread::sleep_for(
+                min<chrono::steady_clock::duration>(remaining,
+                                                    chrono::milliseconds(10)));
+        }
+    }
+}
+
+uint32_t ManagedShmem::flipFrontBuffer()
+{
+    uint32_t oldFront = header->frontBuffer.load(memory_order_relaxed);
+    header->frontBuffer.store(1U - oldFront, memory_order_seq_cst);
+    auto deadline = chrono::steady_clock::now() + readerDrainTimeout;
+    while (readers->snapshotReaders(oldFront) != 0)
+    {
+        if (chrono::steady_clock::now() > deadline &&
+            (reclaimDeadReaders() == 0 ||
+             readers->snapshotReaders(oldFront) != 0))
+        {
+            // Already published, the old front can only be written once its
+            // live readers are gone
+            lg2::error("SHMEMDEBUG: Snapshot readers of {SHM_NAMESPACE} did "
+                       "not drain within timeout, {COUNT} still registered",
+                       "SHM_NAMESPACE", nameSpace, "COUNT",
+                       readers->snapshotReaders(oldFront));
+            deadline += readerDrainTimeout;
+        }
+        this_thread::yield();
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return oldFront;
 }
@@ -0,0 +1,122 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "impl/robust_mutex.hpp"
+
+#include <phosphor-logging/lg2.hpp>
+
+#include <cerrno>
+#include <ctime>
+#include <system_error>
+
+using namespace std;
+using namespace nv::shmem;
+
+RobustMutex::RobustMutex()
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    if (int result = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT))
+    {
+        lg2::error("SHMEMDEBUG: Priority inheritance is not supported, the "
+                   "namespace lock does not use it: {ERRNO}",
+                   "ERRNO", result);
+    }
+    int result = pthread_mutex_init(&mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (result != 0)
+    {
+        throw system_error(result, generic_category(),
+                           "namespace lock initialization");
+    }
+}
+
+RobustMutex::~RobustMutex()
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+void RobustMutex::acquired(int result)
+{
+    recovered = result == EOWNERDEAD;
+    if (recovered)
+    {
+        // The holder died, the lock is ours but must be marked consistent or
+        // it becomes unusable once unlocked
+        pthread_mutex_consistent(&mutex);
+        ownerDeaths.fetch_add(1, memory_order_relaxed);
+        lg2::error("SHMEMDEBUG: Recovered the namespace lock from a process "
+                   "that died holding it");
+    }
+    acquisitions.fetch_add(1, memory_order_relaxed);
+}
+
+bool RobustMutex::try_lock()
+{
+    int result = pthread_mutex_trylock(&mutex);
+    if (result != 0 && result != EOWNERDEAD)
+    {
+        return false;
+    }
+    acquired(result);
+    return true;
+}
+
+void RobustMutex::lock()
+{
+    if (try_lock())
+    {
+        return;
+    }
+    contentions.fetch_add(1, memory_order_relaxed);
+    int result = pthread_mutex_lock(&mutex);
+    if (result != 0 && result != EOWNERDEAD)
+    {
+        throw system_error(result, generic_category(), "namespace lock");
+    }
+    acquired(result);
+}
+
+bool RobustMutex::tryLockFor(chrono::nanoseconds timeout)
+{
+    if (try_lock())
+    {
+        return true;
+    }
+    contentions.fetch_add(1, memory_order_relaxed);
+    // pthread_mutex_timedlock only takes a CLOCK_REALTIME deadline
+    timespec deadline{};
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    auto nanoseconds = deadline.tv_nsec + timeout.count();
+    deadline.tv_sec += static_cast<time_t>(nanoseconds / 1000000000);
+    deadline.tv_nsec = static_cast<long>(nanoseconds % 1000000000);
+    int result = pthread_mutex_timedlock(&mutex, &deadline);
+    if (result != 0 && result != EOWNERDEAD)
+    {
+        return false;
+    }
+    acquired(result);
+    return true;
+}
+
+void RobustMutex::unlock()
+{
+    recovered = false;
+    pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,217 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2023-2024 NVIDIA CORPORATION &
+ * AFFILIATES. All rights reserved. SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "impl/shared_segment.hpp"
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <phosphor-logging/lg2.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+using namespace nv::shmem;
+
+/** @brief Segments mapped by this process, see SharedSegment */
+static mutex registryMutex;
+static unordered_map<string, weak_ptr<SharedSegment>> producerSegments;
+static unordered_map<string, shared_ptr<SharedSegment>> clientSegments;
+
+SharedSegment::SharedSegment(const string& name, bool producer) :
+    name(name), producer(producer)
+{}
+
+SharedSegment::~SharedSegment()
+{
+    if (!producer)
+    {
+        return;
+    }
+    scoped_lock lock(registryMutex);
+    // A new producer mapping of the same name already replaced this one
+    if (!producerSegments[name].expired())
+    {
+        return;
+    }
+    producerSegments.erase(name);
+    directory->retired.store(1, memory_order_release);
+    boost::interprocess::shared_memory_object::remove(name.c_str());
+    boost::interprocess::shared_memory_object::remove(
+        string(name + "readers").c_str());
+    lg2::info("SHMEMDEBUG: Removed shared segment {SHM_SEGMENT}",
+              "SHM_SEGMENT", name);
+}
+
+shared_ptr<SharedSegment> SharedSegment::create(const string& name,
+                                                size_t size)
+{
+    scoped_lock lock(registryMutex);
+    auto& registered = producerSegments[name];
+    if (auto segment = registered.lock())
+    {
+        return segment;
+    }
+    retire(name);
+
+    shared_ptr<SharedSegment> segment(new SharedSegment(name, true));
+    // Created before the segment, clients that find the segment can lock
+    boost::interprocess::shared_memory_object object(
+        boost::interprocess::create_only, string(name + "readers").c_str(),
+        boost::interprocess::read_write);
+    object.truncate(sizeof(SegmentReaders));
+    segment->readerRegion = make_unique<boost::interprocess::mapped_region>(
+        object, boost::interprocess::read_write, 0, sizeof(SegmentReaders));
+    segment->readers =
+        new (segment->readerRegion->get_address()) SegmentReaders();
+
+    segment->memory = make_shared<boost::interprocess::managed_shared_memory>(
+        boost::interprocess::create_only, name.c_str(), size);
+    auto directoryLock = segment->lockDirectory();
+    segment->directory =
+        segment->memory->construct<SegmentDirectory>("directory")();
+    segment->directory->instance = static_cast<uint64_t>(
+        chrono::system_clock::now().time_since_epoch().count());
+    lg2::info("SHMEMDEBUG: Created shared segment {SHM_SEGMENT} of {SIZE} "
+              "bytes",
+              "SHM_SEGMENT", name, "SIZE", size);
+    registered = segment;
+    return segment;
+}
+
+void SharedSegment::retire(const string& name)
+{
+    try
+    {
+        boost::interprocess::managed_shared_memory previous(
+            boost::interprocess::open_only, name.c_str());
+        auto* directory = previous.find<SegmentDirectory>("directory").first;
+        if (directory != nullptr)
+        {
+            directory->retired.store(1, memory_order_release);
+        }
+    }
+    catch (const boost::interprocess::interprocess_exception& e)
+    {
+        SHMDEBUG("SHMEMDEBUG: No previous shared segment {SHM_SEGMENT} to "
+                 "retire: {EXCEPTION}",
+                 "SHM_SEGMENT", name, "EXCEPTION", e.what());
+    }
+    boost::interprocess::shared_memory_object::remove(name.c_str());
+    boost::interprocess::shared_memory_object::remove(
+        string(name + "readers").c_str());
+}
+
+shared_ptr<SharedSegment> SharedSegment::open(const string& name)
+{
+    scoped_lock lock(registryMutex);
+    auto& cached = clientSegments[name];
+    if (cached != nullptr &&
+        cached->directory->retired.load(memory_order_acquire) == 0)
+    {
+        return cached;
+    }
+
+    shared_ptr<SharedSegment> segment(new SharedSegment(name, false));
+    boost::interprocess::shared_memory_object object(
+        boost::interprocess::open_only, string(name + "readers").c_str(),
+        boost::interprocess::read_write);
+    boost::interprocess::offset_t size = 0;
+    if (!object.get_size(size) ||
+        size < static_cast<boost::interprocess::offset_t>(
+                   sizeof(SegmentReaders)))
+    {
+        throw BadMapException();
+    }
+    segment->readerRegion = make_unique<boost::interprocess::mapped_region>(
+        object, boost::interprocess::read_write, 0, sizeof(SegmentReaders));
+    segment->readers =
+        static_cast<SegmentReaders*>(segment->readerRegion->get_address());
+
+    segment->memory = make_shared<boost::interprocess::managed_shared_memory>(
+        boost::interprocess::open_read_only, name.c_str());
+    // The producer may be adding objects of other namespaces to the index
+    auto directoryLock = segment->lockDirectory();
+    segment->directory =
+        segment->memory->find_no_lock<SegmentDirectory>("directory").first;
+    if (segment->directory == nullptr)
+    {
+        throw BadMapException();
+    }
+    cached = segment;
+    return segment;
+}
+
+shmem_write_lock_t SharedSegment::lockDirectory()
+{
+    if (producer)
+    {
+        return shmem_write_lock_t(readers->directoryLock);
+    }
+    shmem_write_lock_t lock(readers->directoryLock, chrono::seconds(1));
+    if (!lock)
+    {
+        throw LockAcquisitionException();
+    }
+    return lock;
+}
+
+ReaderCounters& SharedSegment::addNamespace(const string& nameSpace,
+                                            ShmemHeader* header)
+{
+    ReaderCounters* counters = nullptr;
+    if (findNamespace(nameSpace, counters) != nullptr)
+    {
+        // Created again by the producer, the header object was reused
+        return *counters;
+    }
+    uint32_t count = directory->count.load(memory_order_relaxed);
+    if (count == maxSegmentNamespaces || nameSpace.size() >= segmentNameBytes)
+    {
+        lg2::error("SHMEMDEBUG: Shared segment {SHM_SEGMENT} can not host "
+                   "{SHM_NAMESPACE}, {COUNT} namespaces registered",
+                   "SHM_SEGMENT", name, "SHM_NAMESPACE", nameSpace, "COUNT",
+                   count);
+        throw BadMapException();
+    }
+    auto& entry = directory->entries[count];
+    memcpy(entry.nameSpace, nameSpace.c_str(), nameSpace.size() + 1);
+    entry.header = header;
+    directory->count.store(count + 1, memory_order_release);
+    return readers->namespaces[count];
+}
+
+ShmemHeader* SharedSegment::findNamespace(const string& nameSpace,
+                                          ReaderCounters*& counters) const
+{
+    uint32_t count = min(directory->count.load(memory_order_acquire),
+                         maxSegmentNamespaces);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto& entry = directory->entries[i];
+        if (string_view(entry.nameSpace,
+                        strnlen(entry.nameSpace, segmentNameBytes)) ==
+            nameSpace)
+        {
+            counters = &readers->namespaces[i];
+            return entry.header.get();
+        }
+    }
+    return nullptr;
+}
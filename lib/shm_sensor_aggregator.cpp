@@ -148,6 +148,8 @@ bool SHMSensorAggregator::createShmemNamespace()
 {
     bool status = true;
     const auto& producers = ConfigReader::getProducers();
+    const auto sharedSegments = ConfigReader::getSharedSegments();
+    auto sharedSegment = sharedSegments.find(producerName);
     for (const auto& producerEntry : producers)
     {
         auto it = std::find(producerEntry.second.begin(),
@@ -162,7 +164,16 @@ bool SHMSensorAggregator::createShmemNamespace()
                 {
                     const size_t shmSize = ConfigReader::getSHMSize(
                         producerEntry.first, producerName);
-                    if (!sensorMapIntf.createNamespace(shmNamespace, shmSize))
+                    auto options =
+                        ConfigReader::getNamespaceOptions(producerEntry.first);
+                    if (sharedSegment != sharedSegments.end())
+                    {
+                        options.segment = sharedSegment->second;
+                        options.segmentSize =
+                            ConfigReader::getSharedSegmentSize(producerName);
+                    }
+                    if (!sensorMapIntf.createNamespace(shmNamespace, shmSize,
+                                                       options))
                     {
                         status = false;
                         return status;
@@ -209,7 +220,8 @@ bool SHMSensorAggregator::insertShmemObject(
                         nameSpaceFields.sensorNameSpace + "_0";
     {
         scoped_lock lock(nameSpaceMapLock);
-        nameSpaceMap.emplace(sensorKey, nameSpaceFields);
+        auto [itr, inserted] = nameSpaceMap.emplace(sensorKey, nameSpaceFields);
+        (*itr).second.shmNamespace = shmNamespace;
     }
     auto [metricValues, isList] = getMetricValues(
         nameSpaceFields.sensorNameSpace, nameSpaceFields.deviceName,
@@ -241,11 +253,20 @@ bool SHMSensorAggregator::insertShmemObject(
                      "Key {SHMKEY}",
                      "SHMNAMESPACE", shmNamespace, "SHMKEY", metricVal.first);
 
+            EntryHandle handle;
+            bool deferred = false;
             if (!sensorMapIntf.insert(shmNamespace, metricVal.first,
-                                      sensorValue))
+                                      sensorValue, &handle, &deferred))
             {
                 status = false;
             }
+            else if (!deferred && !isList && metricVal.first == sensorKey)
+            {
+                // Cached for the updates of simple data types. A deferred
+                // object has no handle yet, the next update resolves it.
+                scoped_lock lock(nameSpaceMapLock);
+                nameSpaceMap[sensorKey].handle = handle;
+            }
         }
         else
         {
@@ -289,10 +310,9 @@ bool SHMSensorAggregator::updateNanValue(
     {
         return status;
     }
-    const auto [nameSpace, deviceName, subDeviceName,
-                arraySize] = nameSpaceMap[sensorKey];
-    string shmNamespace = producerName + "_" + PLATFORMDEVICEPREFIX +
-                          nameSpace + "_0";
+    const auto& fields = nameSpaceMap[sensorKey];
+    size_t arraySize = fields.arraySize;
+    const string& shmNamespace = fields.shmNamespace;
 
     // clear keys for all array data preserve first index to update nan
     if (arraySize > 1)
@@ -388,56 +408,41 @@ bool SHMSensorAggregator::handleArrayUpdates(
     const uint64_t timestamp, const string& timeStampStr, size_t arraySize)
 {
     bool status = true;
+    // All elements are written in one lock hold, readers never see a half
+    // updated array
+    vector<SensorBatchOp> ops;
+    ops.reserve(metricValues.size() + arraySize);
+    auto addUpdate = [&](const string& shmKey, const string& propertyValue) {
+        SensorBatchOp op{SensorBatchOp::Type::update, shmKey};
+        op.value.sensorValue = propertyValue;
+        op.value.timestamp = timestamp;
+        op.value.timestampStr = timeStampStr;
+        ops.push_back(std::move(op));
+    };
+    // Failed updates of grown or shrunk arrays are logged only
+    bool updateFailureIsError = true;
     if (!isList)
     {
         for (const auto& metricVal : metricValues)
         {
-            string propertyValue = get<1>(metricVal.second);
-            if (!sensorMapIntf.updateValueAndTimeStamp(shmNamespace, sensorKey,
-                                                       propertyValue, timestamp,
-                                                       timeStampStr))
-            {
-                string errorMessage =
-                    "SHMEMDEBUG: Error while updating value and timestamp for:" +
-                    sensorKey;
-                LOG_ERROR(errorMessage);
-                status = false;
-            }
+            addUpdate(sensorKey, get<1>(metricVal.second));
         }
     }
     else if (arraySize <= metricValues.size())
     {
         for (size_t i = arraySize - 1; i < metricValues.size() - 1; i++)
         {
-            string shmKey = sensorKey + "/" + to_string(i);
-            if (!sensorMapIntf.erase(shmNamespace, shmKey))
-            {
-                string errorMessage =
-                    "SHMEMDEBUG: Error while erasing object: " + sensorKey;
-                LOG_ERROR(errorMessage);
-                status = false;
-            }
+            ops.push_back({SensorBatchOp::Type::erase,
+                           sensorKey + "/" + to_string(i)});
         }
         size_t arrayCount = 0;
         for (const auto& metricVal : metricValues)
         {
-            string shmKey = sensorKey + "/" + to_string(arrayCount);
-            string propertyValue = get<1>(metricVal.second);
-            if (!sensorMapIntf.updateValueAndTimeStamp(shmNamespace, shmKey,
-                                                       propertyValue, timestamp,
-                                                       timeStampStr))
-            {
-                string errorMessage =
-                    "SHMEMDEBUG: Error while updating value and timestamp for:" +
-                    shmKey;
-                LOG_ERROR(errorMessage);
-            }
+            addUpdate(sensorKey + "/" + to_string(arrayCount),
+                      get<1>(metricVal.second));
             arrayCount += 1;
         }
-        {
-            scoped_lock lock(nameSpaceMapLock);
-            nameSpaceMap[sensorKey].arraySize = metricValues.size();
-        }
+        updateFailureIsError = false;
     }
     else if (metricValues.size() > arraySize)
     {
@@ -445,37 +450,46 @@ bool SHMSensorAggregator::handleArrayUpdates(
         size_t arrayCount = 0;
         for (const auto& metricVal : metricValues)
         {
-            auto shmKey = sensorKey + "/" + to_string(arrayCount);
             auto [tmpMetricProp, tmpMetricVal] = metricVal.second;
             if (arrayCount < arraySize)
             {
-                if (!sensorMapIntf.updateValueAndTimeStamp(
-                        shmNamespace, shmKey, tmpMetricVal, timestamp,
-                        timeStampStr))
-                {
-                    string errorMessage =
-                        "SHMEMDEBUG: Error while updating value and timestamp for:" +
-                        shmKey;
-                    LOG_ERROR(errorMessage);
-                    status = false;
-                }
+                addUpdate(sensorKey + "/" + to_string(arrayCount),
+                          tmpMetricVal);
             }
             else
             {
                 SensorValue sensorValue(tmpMetricVal, tmpMetricProp, timestamp,
                                         timeStampStr);
-                if (!sensorMapIntf.insert(shmNamespace, tmpMetricVal,
-                                          sensorValue))
-                {
-                    string errorMessage =
-                        "SHMEMDEBUG: Error while inserting object: " + shmKey;
-                    LOG_ERROR(errorMessage);
-                    status = false;
-                }
+                ops.push_back(
+                    {SensorBatchOp::Type::insert, tmpMetricVal, sensorValue});
             }
             arrayCount += 1;
         }
     }
+
+    if (!sensorMapIntf.applyBatch(shmNamespace, ops))
+    {
+        string errorMessage =
+            "SHMEMDEBUG: Error while updating array objects of: " + sensorKey;
+        LOG_ERROR(errorMessage);
+        return false;
+    }
+    for (const auto& op : ops)
+    {
+        if (!op.applied)
+        {
+            string errorMessage =
+                "SHMEMDEBUG: Error while updating value and timestamp for:" +
+                op.key;
+            LOG_ERROR(errorMessage);
+            status = status && !updateFailureIsError;
+        }
+    }
+    if (isList && arraySize <= metricValues.size())
+    {
+        scoped_lock lock(nameSpaceMapLock);
+        nameSpaceMap[sensorKey].arraySize = metricValues.size();
+    }
     return status;
 }
 
@@ -488,12 +502,13 @@ bool SHMSensorAggregator::updateSHMObject(const string& devicePath,
 {
     auto sensorKey = getSensorMapKey(devicePath, interface, propName);
     bool status = true;
-    if (nameSpaceMap.find(sensorKey) != nameSpaceMap.end())
+    auto nameSpaceItr = nameSpaceMap.find(sensorKey);
+    if (nameSpaceItr != nameSpaceMap.end())
     {
         SHMDEBUG("SHMEMDEBUG: Updating existing object: {SENSOR_KEY}",
                  "SENSOR_KEY", string(sensorKey));
-        auto [nameSpace, deviceName, subDeviceName,
-              arraySize] = nameSpaceMap[sensorKey];
+        const auto& fields = (*nameSpaceItr).second;
+        size_t arraySize = fields.arraySize;
 
         const uint64_t systemTimestamp =
             static_cast<uint64_t>(
@@ -506,19 +521,20 @@ bool SHMSensorAggregator::updateSHMObject(const string& devicePath,
                     .count()) +
             timestamp;
 
-        string timeStampStr =
-            nv::sensor_aggregation::metricUtils::getDateTimeUintMs(
-                systemTimestamp);
-
-        string shmNamespace = producerName + "_" + PLATFORMDEVICEPREFIX +
-                              nameSpace + "_0";
         if (arraySize == 0)
         {
-            auto metricVal = getMetricValue(propName, interface, value);
-            string propertyValue = get<1>(metricVal);
-            if (!sensorMapIntf.updateValueAndTimeStamp(shmNamespace, sensorKey,
-                                                       propertyValue, timestamp,
-                                                       timeStampStr))
+            // Hot path: store the raw reading and time through the cached
+            // handle, clients render them
+            auto metricValue = getRawMetricValue(propName, interface, value);
+            EntryHandle handle;
+            {
+                scoped_lock lock(nameSpaceMapLock);
+                handle = fields.handle;
+            }
+            EntryHandle cachedHandle = handle;
+            if (!sensorMapIntf.updateMetricValue(fields.shmNamespace, handle,
+                                                 sensorKey, metricValue,
+                                                 timestamp, systemTimestamp))
             {
                 string errorMessage =
                     "SHMEMDEBUG: Error while updating value and timestamp for:" +
@@ -526,15 +542,25 @@ bool SHMSensorAggregator::updateSHMObject(const string& devicePath,
                 LOG_ERROR(errorMessage);
                 status = false;
             }
+            else if (!(handle == cachedHandle))
+            {
+                // Refreshed after objects were removed from the namespace
+                scoped_lock lock(nameSpaceMapLock);
+                nameSpaceMap[sensorKey].handle = handle;
+            }
         }
         else
         {
+            string timeStampStr =
+                nv::sensor_aggregation::metricUtils::getDateTimeUintMs(
+                    systemTimestamp);
             auto [metricValues, isList] =
-                getMetricValues(nameSpace, deviceName, subDeviceName,
-                                devicePath, propName, interface, value);
-            status = handleArrayUpdates(metricValues, isList, shmNamespace,
-                                        sensorKey, timestamp, timeStampStr,
-                                        arraySize);
+                getMetricValues(fields.sensorNameSpace, fields.deviceName,
+                                fields.subDeviceName, devicePath, propName,
+                                interface, value);
+            status = handleArrayUpdates(metricValues, isList,
+                                        fields.shmNamespace, sensorKey,
+                                        timestamp, timeStampStr, arraySize);
         }
         return status;
     }
@@ -20,186 +20,1310 @@
 using namespace std;
 using namespace nv::shmem;
 
-template <>
-Map<SensorMap, SensorValue>::Map(const string& nameSpace, const int opts,
-                                 size_t maxSize) :
-    ManagedShmem(nameSpace, opts, maxSize)
+template <class MapType, class ValueType>
+SegmentLayout Map<MapType, ValueType>::segmentLayout()
 {
-    mapImpl = memory->find<SensorMap>(string(nameSpace + "map").c_str()).first;
-    if (mapImpl == nullptr)
+    uint64_t layoutHash =
+        hashCombine(hashString(MapTypeTraits<MapType>::name),
+                    shmemLayoutVersion);
+    layoutHash = hashCombine(layoutHash, sizeof(ShmemHeader));
+    layoutHash = hashCombine(layoutHash, sizeof(MapType));
+    layoutHash = hashCombine(layoutHash, sizeof(char_string_t));
+    layoutHash = hashCombine(layoutHash, sizeof(map_value_type_t));
+    layoutHash = hashCombine(layoutHash, alignof(map_value_type_t));
+    layoutHash = hashCombine(layoutHash, SHMEM_INLINE_VALUE_SIZE);
+    layoutHash = hashCombine(layoutHash, SHMEM_INLINE_TIMESTAMP_SIZE);
+    layoutHash = hashCombine(layoutHash, sizeof(void*));
+    layoutHash = hashCombine(layoutHash, BOOST_VERSION);
+    return {layoutHash, sizeof(map_value_type_t)};
+}
+
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::restoreWarmMaps()
+{
+    bool snapshot = publishMode == PublishMode::snapshot;
+    size_t dropped = 0;
     {
-        mapImpl = memory->construct<SensorMap>(
-            string(nameSpace + "map").c_str())(less<nv::shmem::char_string_t>(),
-                                               *voidAllocator);
-        if (mapImpl == nullptr)
+        SequenceWriteGuard guard(*this);
+        auto& published = snapshot ? *snapshotMaps[header->frontBuffer.load()]
+                                   : *mapImpl;
+        if (snapshot)
+        {
+            // Drop whatever the previous instance wrote but did not publish
+            mapImpl->clear();
+            if (auto* index = propertyIndex(*mapImpl))
+            {
+                index->clear();
+            }
+            if constexpr (hasCapacity)
+            {
+                // The previous instance may have died before matching the
+                // capacity of the published buffer
+                growBuffer(bufferIndex(*mapImpl), published.capacity());
+            }
+        }
+        for (auto itr = published.begin(); itr != published.end();)
         {
-            throw BadMapException();
+            if (!entryIntact(*itr))
+            {
+                // The previous instance died while writing it, its strings
+                // may be torn. Its producer writes it again.
+                dropped++;
+                if (snapshot)
+                {
+                    // Still read in the front buffer, left behind by the
+                    // publish below
+                    itr++;
+                    continue;
+                }
+                unindexEntry(published, *itr);
+                releaseJournalKey((*itr).second);
+                itr = published.erase(itr);
+                entryRemoved(published);
+                continue;
+            }
+            // The previous instance may have dropped the records of an
+            // erased but unpublished entry
+            attachEntryRecords(StringViewLess::view((*itr).first),
+                               (*itr).second);
+            attachJournalKey(StringViewLess::view((*itr).first),
+                             (*itr).second);
+            {
+                VersionWriteGuard versionGuard((*itr).second.version);
+                (*itr).second.stale = true;
+                (*itr).second.generation = nextGeneration();
+            }
+            if (snapshot)
+            {
+                indexEntry(*mapImpl, *mapImpl->insert(*itr).first);
+            }
+            itr++;
+        }
+        if (dropped != 0)
+        {
+            markRemoval();
+            lg2::error("SHMEMDEBUG: Dropped {COUNT} entries of "
+                       "{SHM_NAMESPACE} left half written by the previous "
+                       "instance",
+                       "COUNT", dropped, "SHM_NAMESPACE", nameSpace);
         }
     }
+    if (snapshot && dropped != 0)
+    {
+        // Move the readers off the dropped entries
+        {
+            scoped_lock lock(dirtyKeysLock);
+            dirtyAll = true;
+        }
+        publish();
+    }
+}
 
-    mapImpl->clear();
+template <class MapType, class ValueType>
+Map<MapType, ValueType>::Map(const string& nameSpace, const int opts,
+                             size_t maxSize, const NamespaceOptions& options) :
+    ManagedShmem(nameSpace, opts, maxSize, options, segmentLayout()),
+    keepSegment(options.warmRestart && options.segment.empty())
+{
+    auto namedObjectsLock = lockNamedObjects();
+    size_t buffers = (options.publishMode == PublishMode::snapshot) ? 2 : 1;
+    size_t maxEntries =
+        options.maxEntries
+            ? options.maxEntries
+            : MapTypeTraits<MapType>::defaultMaxEntries(maxSize, buffers);
+    uriTable = memory->find_or_construct<ShmemStringTable>(
+        string(nameSpace + "uris").c_str())(*voidAllocator);
+    if (uriTable == nullptr)
+    {
+        throw BadMapException();
+    }
+    for (size_t i = 0; i < buffers; i++)
+    {
+        string mapName = nameSpace + "map" + (i ? to_string(i) : "");
+        snapshotMaps[i] = memory->find<MapType>(mapName.c_str()).first;
+        if (snapshotMaps[i] == nullptr)
+        {
+            snapshotMaps[i] = MapTypeTraits<MapType>::construct(
+                *memory, mapName.c_str(), maxEntries, *voidAllocator);
+            if (snapshotMaps[i] == nullptr)
+            {
+                throw BadMapException();
+            }
+        }
+        if (i == 0 && options.historySamples != 0)
+        {
+            historySamples = options.historySamples;
+            historyMap = memory->find_or_construct<SensorHistoryMap>(
+                string(nameSpace + "history").c_str())(StringViewLess(),
+                                                       *voidAllocator);
+            if (historyMap == nullptr)
+            {
+                throw BadMapException();
+            }
+            if (!warmAttached)
+            {
+                historyMap->clear();
+            }
+        }
+        if (i == 0 && options.aggregationWindowSeconds != 0)
+        {
+            aggregationWindowMs =
+                uint64_t{options.aggregationWindowSeconds} * 1000;
+            aggregateMap = memory->find_or_construct<SensorAggregateMap>(
+                string(nameSpace + "aggregates").c_str())(StringViewLess(),
+                                                          *voidAllocator);
+            if (aggregateMap == nullptr)
+            {
+                throw BadMapException();
+            }
+            if (!warmAttached)
+            {
+                aggregateMap->clear();
+            }
+        }
+        if (i == 0 && options.journalRecords != 0)
+        {
+            journal = memory->find_or_construct<ChangeJournal>(
+                string(nameSpace + "journal").c_str())(options.journalRecords,
+                                                       *voidAllocator);
+            if (journal == nullptr)
+            {
+                throw BadMapException();
+            }
+            if (warmAttached)
+            {
+                // The previous instance may have left a record half written
+                // and its entries are stale now
+                journal->skip();
+                appendJournal(ChangeKind::reset, {}, 0);
+            }
+            else
+            {
+                // Held by the entries dropped below
+                journal->clear();
+            }
+        }
+        if (options.indexMetricProperty)
+        {
+            string indexName =
+                nameSpace + "propindex" + (i ? to_string(i) : "");
+            propertyIndexes[i] =
+                memory->find_or_construct<MetricPropertyIndex>(
+                    indexName.c_str())(0, MetricPropertyHash(),
+                                       MetricPropertyEqual(), *voidAllocator);
+            if (propertyIndexes[i] == nullptr)
+            {
+                throw BadMapException();
+            }
+        }
+        if (!warmAttached)
+        {
+            snapshotMaps[i]->clear();
+            if (propertyIndexes[i] != nullptr)
+            {
+                propertyIndexes[i]->clear();
+            }
+        }
+    }
+    // Producers of a snapshot map write to the buffer that is not published
+    mapImpl = (buffers == 2) ? snapshotMaps[1U - header->frontBuffer.load()]
+                             : snapshotMaps[0];
+    if (warmAttached)
+    {
+        restoreWarmMaps();
+    }
 }
 
-template <>
-Map<SensorMap, SensorValue>::Map(const string& nameSpace, const int opts) :
-    ManagedShmem(nameSpace, opts)
+template <class MapType, class ValueType>
+Map<MapType, ValueType>::Map(const string& nameSpace, const int opts,
+                             const string& segmentName) :
+    ManagedShmem(nameSpace, opts, segmentName)
 {
-    mapImpl = memory->find<SensorMap>(string(nameSpace + "map").c_str()).first;
-    if (mapImpl == nullptr)
+    if (header->layoutHash != segmentLayout().layoutHash)
     {
+        // Written by a producer built with another map type or layout
         throw BadMapException();
     }
+    auto namedObjectsLock = lockNamedObjects();
+    findObjects();
+    if (snapshotMaps[0] == nullptr ||
+        (publishMode == PublishMode::snapshot &&
+         snapshotMaps[1] == nullptr))
+    {
+        throw BadMapException();
+    }
+    mapImpl = snapshotMaps[0];
 }
 
-template <>
-ShmemKeyValuePairs Map<SensorMap, SensorValue>::getAllKeyValuePair()
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::findObjects()
+{
+    snapshotMaps[0] =
+        memory->find_no_lock<MapType>(string(nameSpace + "map").c_str()).first;
+    historyMap = memory
+                     ->find_no_lock<SensorHistoryMap>(
+                         string(nameSpace + "history").c_str())
+                     .first;
+    aggregateMap = memory
+                       ->find_no_lock<SensorAggregateMap>(
+                           string(nameSpace + "aggregates").c_str())
+                       .first;
+    journal = memory
+                  ->find_no_lock<ChangeJournal>(
+                      string(nameSpace + "journal").c_str())
+                  .first;
+    uriTable = memory
+                   ->find_no_lock<ShmemStringTable>(
+                       string(nameSpace + "uris").c_str())
+                   .first;
+    propertyIndexes[0] =
+        memory
+            ->find_no_lock<MetricPropertyIndex>(
+                string(nameSpace + "propindex").c_str())
+            .first;
+    if (publishMode == PublishMode::snapshot)
+    {
+        snapshotMaps[1] =
+            memory->find_no_lock<MapType>(string(nameSpace + "map1").c_str())
+                .first;
+        propertyIndexes[1] =
+            memory
+                ->find_no_lock<MetricPropertyIndex>(
+                    string(nameSpace + "propindex1").c_str())
+                .first;
+    }
+}
+
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::remapped()
+{
+    // Addresses in the old mapping, only compared
+    bool back = snapshotMaps[1] != nullptr && mapImpl == snapshotMaps[1];
+    findObjects();
+    mapImpl = snapshotMaps[back ? 1 : 0];
+}
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::growEntries()
+{
+    if constexpr (hasCapacity)
+    {
+        // Like the segment, the capacity only grows up to maxSizeInBytes
+        if (maxSegmentSize == 0)
+        {
+            return false;
+        }
+        SequenceWriteGuard guard(*this);
+        uint32_t buffer = bufferIndex(*mapImpl);
+        if (mapImpl->size() < mapImpl->capacity())
+        {
+            // Grown by another thread meanwhile
+            return true;
+        }
+        size_t capacity = max<size_t>(2 * mapImpl->capacity(), 1);
+        while (true)
+        {
+            try
+            {
+                growBuffer(buffer, capacity);
+                break;
+            }
+            catch (const boost::interprocess::bad_alloc&)
+            {
+                if (!growSegmentLocked())
+                {
+                    return false;
+                }
+            }
+        }
+        lg2::info("SHMEMDEBUG: Grew {SHM_NAMESPACE} to {CAPACITY} objects",
+                  "SHM_NAMESPACE", nameSpace, "CAPACITY", capacity);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::growBuffer(uint32_t buffer, size_t capacity)
+{
+    if constexpr (hasCapacity)
+    {
+        auto& map = *snapshotMaps[buffer];
+        if (map.capacity() >= capacity)
+        {
+            return;
+        }
+        map.grow(capacity, [this, &map](const map_value_type_t& from,
+                                        const map_value_type_t& to) {
+            reindexEntry(map, from, to);
+        });
+        entryRemoved(map);
+    }
+}
+
+template <class MapType, class ValueType>
+ShmemKeyValuePairs Map<MapType, ValueType>::getAllKeyValuePair()
 {
     ShmemKeyValuePairs values;
-    SensorValue value;
-    TryReadLock();
-    auto itr = mapImpl->begin();
-    for (; itr != mapImpl->end(); itr++)
+    withReadableMap([this, &values](const MapType& map) {
+        string key;
+        string value;
+        for (auto itr = map.begin(); itr != map.end(); itr++)
+        {
+            const auto& mapValue = (*itr).second;
+            RawReading raw;
+            readVersioned(mapValue.version, [&]() {
+                raw = {mapValue.valueKind, mapValue.rawValue, 0};
+                if (raw.kind == MetricValueKind::text)
+                {
+                    copyString(mapValue.sensorValue, value);
+                }
+            });
+            renderReading(raw, value, nullptr);
+            copyString((*itr).first, key);
+            values[key] = value;
+        }
+    });
+    return values;
+}
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::getValueByMetricProperty(string_view uri,
+                                                       ValueType& val)
+{
+    bool found = false;
+    withReadableMap([this, uri, &val, &found](const MapType& map) {
+        if (auto* index = propertyIndex(map))
+        {
+            auto indexItr =
+                index->find(uri, MetricPropertyHash(), MetricPropertyEqual());
+            if (indexItr != index->end())
+            {
+                readEntry(indexItr->second->second, val);
+                found = true;
+            }
+            return;
+        }
+        for (auto itr = map.begin(); itr != map.end() && !found; itr++)
+        {
+            if (hasMetricProperty((*itr).second, uri))
+            {
+                readEntry((*itr).second, val);
+                found = true;
+            }
+        }
+    });
+    return found;
+}
+
+template <class MapType, class ValueType>
+vector<ValueType>
+    Map<MapType, ValueType>::getValuesByMetricProperties(
+        const vector<string>& uris)
+{
+    vector<ValueType> values;
+    withReadableMap([this, &uris, &values](const MapType& map) {
+        ValueType value;
+        // One object per distinct URI on both paths
+        unordered_set<string_view> pending(uris.begin(), uris.end());
+        if (auto* index = propertyIndex(map))
+        {
+            for (const auto& uri : uris)
+            {
+                if (pending.erase(uri) == 0)
+                {
+                    continue;
+                }
+                auto indexItr = index->find(string_view(uri),
+                                            MetricPropertyHash(),
+                                            MetricPropertyEqual());
+                if (indexItr != index->end())
+                {
+                    readEntry(indexItr->second->second, value);
+                    values.emplace_back(std::move(value));
+                }
+            }
+            return;
+        }
+        string uri;
+        for (auto itr = map.begin(); itr != map.end() && !pending.empty();
+             itr++)
+        {
+            copyMetricProperty((*itr).second, uri);
+            auto pendingItr = pending.find(uri);
+            if (pendingItr != pending.end())
+            {
+                readEntry((*itr).second, value);
+                pending.erase(pendingItr);
+                values.emplace_back(std::move(value));
+            }
+        }
+    });
+    return values;
+}
+
+template <class MapType, class ValueType>
+vector<HistorySample> Map<MapType, ValueType>::getHistory(string_view key,
+                                                          uint64_t sinceMs)
+{
+    vector<HistorySample> samples;
+    if (historyMap == nullptr)
     {
-        value = (*itr).second;
-        values[(*itr).first] = value.sensorValue;
+        return samples;
     }
+    SampleHistory::Copy copy;
+    bool found = false;
+    // Shared by both buffers, protected by the structural writers alone
+    withReaderRegistered([this, key, &copy, &found]() {
+        auto itr = historyMap->find(key);
+        if (itr != historyMap->end())
+        {
+            const auto& history = itr->second;
+            readVersioned(history.version, [&]() { history.copy(copy); });
+            found = true;
+        }
+    });
+    if (found)
+    {
+        SampleHistory::decode(copy, sinceMs, samples);
+    }
+    return samples;
+}
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::getAggregates(string_view key,
+                                            MetricAggregates& aggregates)
+{
+    if (aggregateMap == nullptr)
+    {
+        return false;
+    }
+    bool found = false;
+    // Shared by both buffers, protected by the structural writers alone
+    withReaderRegistered([this, key, &aggregates, &found]() {
+        auto itr = aggregateMap->find(key);
+        if (itr != aggregateMap->end())
+        {
+            const auto& window = itr->second;
+            readVersioned(window.version,
+                          [&]() { aggregates = window.aggregate(); });
+            found = true;
+        }
+    });
+    return found && aggregates.samples != 0;
+}
+
+template <class MapType, class ValueType>
+vector<ValueType> Map<MapType, ValueType>::getValuesByPrefix(string_view prefix)
+{
+    vector<ValueType> values;
+    withReadableMap([this, &values, prefix](const MapType& map) {
+        ValueType value;
+        auto itr = map.begin();
+        if constexpr (requires { map.lower_bound(prefix); })
+        {
+            itr = map.lower_bound(prefix);
+        }
+        for (; itr != map.end(); itr++)
+        {
+            if (!StringViewLess::view((*itr).first).starts_with(prefix))
+            {
+                if constexpr (requires { map.lower_bound(prefix); })
+                {
+                    // Keys sharing the prefix are contiguous
+                    break;
+                }
+                continue;
+            }
+            readEntry((*itr).second, value);
+            values.emplace_back(std::move(value));
+        }
+    });
     return values;
 }
 
-template <>
-vector<SensorValue> Map<SensorMap, SensorValue>::getAllValues()
+template <class MapType, class ValueType>
+vector<ValueType> Map<MapType, ValueType>::getValuesChangedSince(
+    ChangeCursor& cursor, bool& full)
 {
-    vector<SensorValue> values;
-    SensorValue value;
-    TryReadLock();
-    auto itr = mapImpl->begin();
-    for (; itr != mapImpl->end(); itr++)
+    vector<ValueType> values;
+    // Taken before the scan: entries written meanwhile are returned now and
+    // again by the next call, never missed
+    uint64_t generation = 0;
+    uint64_t instance = 0;
     {
-        value = (*itr).second;
+        shared_lock mapping(mappingLock);
+        generation =
+            (publishMode == PublishMode::snapshot)
+                ? header->publishedGeneration.load(memory_order_acquire)
+                : header->generation.load(memory_order_acquire);
+        instance = header->instance;
+        full = cursor.instance != instance ||
+               cursor.generation < header->removalGeneration.load(
+                                       memory_order_acquire) ||
+               cursor.generation > generation;
+    }
+    uint64_t since = full ? 0 : cursor.generation;
+    withReadableMap([this, &values, since](const MapType& map) {
+        ValueType value;
+        for (auto itr = map.begin(); itr != map.end(); itr++)
+        {
+            const auto& mapValue = (*itr).second;
+            uint64_t entryGeneration = 0;
+            RawReading raw;
+            readVersioned(mapValue.version, [&]() {
+                entryGeneration = mapValue.generation;
+                if (entryGeneration > since)
+                {
+                    copyValue(mapValue, value, raw);
+                }
+            });
+            if (entryGeneration > since)
+            {
+                renderReading(raw, value.sensorValue, &value.timestampStr);
+                values.emplace_back(std::move(value));
+            }
+        }
+    });
+    // Only reached when every entry was read, an entry left locked throws
+    // before the cursor moves past its change
+    cursor = {instance, generation};
+    return values;
+}
+
+template <class MapType, class ValueType>
+vector<ChangeRecord> Map<MapType, ValueType>::getChangesSince(
+    JournalCursor& cursor, bool& resync, size_t maxRecords)
+{
+    vector<ChangeRecord> records;
+    resync = true;
+    // Registered so that the keys, interned after a grow, are mapped
+    withReaderRegistered([&]() {
+        if (journal == nullptr)
+        {
+            cursor = {header->instance, 0};
+            return;
+        }
+        if (cursor.instance == header->instance)
+        {
+            resync = !journal->read(cursor.position, maxRecords, records);
+        }
+        if (resync)
+        {
+            records.clear();
+            cursor = {header->instance, journal->end()};
+        }
+    });
+    return records;
+}
+
+template <class MapType, class ValueType>
+vector<ValueType> Map<MapType, ValueType>::getAllValues()
+{
+    vector<ValueType> values;
+    withReadableMap([this, &values](const MapType& map) {
+        values.reserve(map.size());
+        ValueType value;
+        for (auto itr = map.begin(); itr != map.end(); itr++)
+        {
+            readEntry((*itr).second, value);
+            values.emplace_back(std::move(value));
+        }
+    });
+    return values;
+}
+
+template <class MapType, class ValueType>
+vector<ValueType> Map<MapType, ValueType>::getValuesChunk(ScanCursor& cursor,
+                                                          size_t chunkEntries)
+{
+    vector<ValueType> values;
+    if (cursor.done)
+    {
+        return values;
+    }
+    ValueType value;
+    scanChunk(cursor, chunkEntries, [this, &values, &value](const auto& entry) {
+        readEntry(entry.second, value);
         values.emplace_back(std::move(value));
+    });
+    return values;
+}
+
+template <class MapType, class ValueType>
+vector<ValueType> Map<MapType, ValueType>::getAllValuesChunked(
+    size_t chunkEntries)
+{
+    vector<ValueType> values;
+    ScanCursor cursor;
+    while (!cursor.done)
+    {
+        auto chunk = getValuesChunk(cursor, chunkEntries);
+        values.insert(values.end(), make_move_iterator(chunk.begin()),
+                      make_move_iterator(chunk.end()));
     }
     return values;
 }
 
-template <>
-Map<SensorMap, SensorValue>::~Map()
+template <class MapType, class ValueType>
+Map<MapType, ValueType>::~Map()
 {
-    if (opts & O_CREAT)
+    if ((opts & O_CREAT) && !keepSegment)
     {
-        memory->destroy<SensorMap>(string(nameSpace + "map").c_str());
+        auto namedObjectsLock = lockNamedObjects();
+        memory->destroy<MapType>(string(nameSpace + "map").c_str());
+        if (publishMode == PublishMode::snapshot)
+        {
+            memory->destroy<MapType>(string(nameSpace + "map1").c_str());
+        }
+        memory->destroy<SensorHistoryMap>(
+            string(nameSpace + "history").c_str());
+        memory->destroy<SensorAggregateMap>(
+            string(nameSpace + "aggregates").c_str());
+        memory->destroy<ChangeJournal>(string(nameSpace + "journal").c_str());
+        memory->destroy<MetricPropertyIndex>(
+            string(nameSpace + "propindex").c_str());
+        memory->destroy<MetricPropertyIndex>(
+            string(nameSpace + "propindex1").c_str());
+        memory->destroy<ShmemStringTable>(string(nameSpace + "uris").c_str());
     }
 }
 
-template <>
-bool Map<SensorMap, SensorValue>::getValue(const string& key, SensorValue& val)
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::syncBackBuffer(const MapType& front,
+                                             MapType& back)
 {
-    TryReadLock();
-    auto itr = mapImpl->find(getMapKey(key));
-    if (itr != mapImpl->end())
+    if (dirtyAll)
     {
-        val = (*itr).second;
-        return true;
+        back.clear();
+        entryRemoved(back);
+        back.insert(front.begin(), front.end());
+        if (auto* index = propertyIndex(back))
+        {
+            // The index of the front points to the entries of the front
+            index->clear();
+            for (const auto& entry : back)
+            {
+                indexEntry(back, entry);
+            }
+        }
+        return;
     }
-    else
+    // Removals first, so that the back buffer never holds more objects than
+    // the front one and fits in its capacity
+    for (const auto& key : dirtyKeys)
     {
-        return false;
+        if (front.find(string_view(key)) != front.end())
+        {
+            continue;
+        }
+        auto backItr = back.find(string_view(key));
+        if (backItr != back.end())
+        {
+            unindexEntry(back, *backItr);
+            back.erase(backItr);
+            entryRemoved(back);
+        }
+    }
+    for (const auto& key : dirtyKeys)
+    {
+        auto frontItr = front.find(string_view(key));
+        if (frontItr == front.end())
+        {
+            continue;
+        }
+        auto backItr = back.find(string_view(key));
+        if (backItr == back.end())
+        {
+            indexEntry(back, *back.insert(*frontItr).first);
+        }
+        else
+        {
+            auto& backValue = (*backItr).second;
+            bool uriChanged = backValue.metricPropertyBase !=
+                                  (*frontItr).second.metricPropertyBase ||
+                              backValue.metricPropertySuffix !=
+                                  (*frontItr).second.metricPropertySuffix;
+            if (uriChanged)
+            {
+                unindexEntry(back, *backItr);
+            }
+            backValue.sensorValue = (*frontItr).second.sensorValue;
+            backValue.timestampStr = (*frontItr).second.timestampStr;
+            backValue.metricPropertyBase =
+                (*frontItr).second.metricPropertyBase;
+            backValue.metricPropertySuffix =
+                (*frontItr).second.metricPropertySuffix;
+            backValue.timestamp = (*frontItr).second.timestamp;
+            backValue.rawValue = (*frontItr).second.rawValue;
+            backValue.timestampEpochMs = (*frontItr).second.timestampEpochMs;
+            backValue.valueKind = (*frontItr).second.valueKind;
+            backValue.stale = (*frontItr).second.stale;
+            backValue.generation = (*frontItr).second.generation;
+            backValue.history = (*frontItr).second.history;
+            backValue.aggregates = (*frontItr).second.aggregates;
+            if (uriChanged)
+            {
+                indexEntry(back, *backItr);
+            }
+        }
     }
 }
 
-template <>
-bool Map<SensorMap, SensorValue>::updateTimestamp(const string& key,
-                                                  const uint64_t timestamp,
-                                                  const string& timestampStr)
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::journalPublished(const MapType& front)
 {
-    if (opts & O_CREAT)
+    if (journal == nullptr)
+    {
+        return;
+    }
+    if (dirtyAll)
+    {
+        appendJournal(ChangeKind::reset, {}, 0);
+        return;
+    }
+    for (const auto& key : dirtyKeys)
     {
-        shmem_write_lock_t lock(*memLock);
-        auto itr = mapImpl->find(getMapKey(key));
-        if (itr != mapImpl->end())
+        auto itr = front.find(string_view(key));
+        if (itr == front.end())
         {
-            (*itr).second.timestamp = timestamp;
-            (*itr).second.timestampStr = timestampStr;
-            return true;
+            appendJournal(ChangeKind::erase, key, 0);
         }
         else
         {
-            return false;
+            appendJournal(ChangeKind::upsert, key, (*itr).second.generation);
         }
     }
-    else
+}
+
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::publish()
+{
+    if (!(opts & O_CREAT))
     {
         throw PermissionErrorException();
     }
+    if (publishMode != PublishMode::snapshot)
+    {
+        return;
+    }
+    // Published along with everything else written since the last publish
+    flushDeferred();
+    SequenceWriteGuard guard(*this);
+    scoped_lock lock(dirtyKeysLock);
+    uint32_t back = flipFrontBuffer();
+    // Only after the flip, a reader seeing this generation reads the new front
+    header->publishedGeneration.store(
+        header->generation.load(memory_order_acquire), memory_order_release);
+    journalPublished(*snapshotMaps[1U - back]);
+    notifyChange();
+    while (true)
+    {
+        try
+        {
+            // The published buffer may have grown since the last publish
+            if constexpr (hasCapacity)
+            {
+                growBuffer(back, snapshotMaps[1U - back]->capacity());
+            }
+            syncBackBuffer(*snapshotMaps[1U - back], *snapshotMaps[back]);
+            break;
+        }
+        catch (const boost::interprocess::bad_alloc&)
+        {
+            // Already published, finish the sync in the grown segment
+            if (!growSegmentLocked())
+            {
+                throw;
+            }
+        }
+    }
+    dropUnpublishedRecords(*snapshotMaps[1U - back]);
+    dirtyKeys.clear();
+    dirtyAll = false;
+    mapImpl = snapshotMaps[back];
 }
 
-template <>
-bool Map<SensorMap, SensorValue>::updateValue(const string& key,
-                                              const string& val)
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::dropUnpublishedRecords(const MapType& front)
 {
-    if (opts & O_CREAT)
+    if (!dirtyAll)
     {
-        shmem_write_lock_t lock(*memLock);
-        auto itr = mapImpl->find(getMapKey(key));
-        if (itr != mapImpl->end())
+        for (const auto& key : dirtyKeys)
         {
-            (*itr).second.sensorValue = val;
-            return true;
+            if (front.find(string_view(key)) == front.end())
+            {
+                dropEntryRecords(key);
+            }
+        }
+        return;
+    }
+    auto dropOrphans = [&front](auto& records) {
+        for (auto itr = records.begin(); itr != records.end();)
+        {
+            if (front.find(StringViewLess::view(itr->first)) == front.end())
+            {
+                itr = records.erase(itr);
+            }
+            else
+            {
+                itr++;
+            }
+        }
+    };
+    if (historyMap != nullptr)
+    {
+        dropOrphans(*historyMap);
+    }
+    if (aggregateMap != nullptr)
+    {
+        dropOrphans(*aggregateMap);
+    }
+}
+
+template <class MapType, class ValueType>
+size_t Map<MapType, ValueType>::eraseStale()
+{
+    if (!(opts & O_CREAT))
+    {
+        throw PermissionErrorException();
+    }
+    size_t erased = 0;
+    // A deferred insert refreshes its entry
+    flushDeferred();
+    SequenceWriteGuard guard(*this);
+    for (auto itr = mapImpl->begin(); itr != mapImpl->end();)
+    {
+        if ((*itr).second.stale)
+        {
+            string key((*itr).first.data(), (*itr).first.size());
+            markDirty(key);
+            unindexEntry(*mapImpl, *itr);
+            eraseEntryRecords(*itr);
+            itr = mapImpl->erase(itr);
+            entryRemoved(*mapImpl);
+            markRemoval();
+            journalChange(ChangeKind::erase, key);
+            erased++;
         }
         else
         {
-            return false;
+            itr++;
         }
     }
-    else
+    return erased;
+}
+
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::flushDeferred()
+{
+    if (!(opts & O_CREAT))
     {
         throw PermissionErrorException();
     }
+    if (deferred.empty())
+    {
+        return;
+    }
+    withGrowth([this]() {
+        SequenceWriteGuard guard(*this);
+        applyDeferredLocked();
+    });
 }
 
-template <>
-void Map<SensorMap, SensorValue>::insert(const string& key,
-                                         const SensorValue& val)
+template <class MapType, class ValueType>
+void Map<MapType, ValueType>::clearLocked()
+{
+    if (journal != nullptr && publishMode == PublishMode::live)
+    {
+        for (auto& entry : *mapImpl)
+        {
+            releaseJournalKey(entry.second);
+        }
+    }
+    mapImpl->clear();
+    entryRemoved(*mapImpl);
+    markRemoval();
+    journalChange(ChangeKind::reset, {});
+    if (auto* index = propertyIndex(*mapImpl))
+    {
+        index->clear();
+    }
+    if (publishMode == PublishMode::snapshot)
+    {
+        // The records are dropped by publish
+        scoped_lock lock(dirtyKeysLock);
+        dirtyAll = true;
+    }
+    else
+    {
+        if (historyMap != nullptr)
+        {
+            historyMap->clear();
+        }
+        if (aggregateMap != nullptr)
+        {
+            aggregateMap->clear();
+        }
+    }
+}
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::getValue(const string& key, ValueType& val)
+{
+    bool found = false;
+    withReadableMap([this, &key, &val, &found](const MapType& map) {
+        auto itr = map.find(string_view(key));
+        if (itr != map.end())
+        {
+            readEntry((*itr).second, val);
+            found = true;
+        }
+    });
+    return found;
+}
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::updateTimestamp(const string& key,
+                                              const uint64_t timestamp,
+                                              const string& timestampStr)
+{
+    return updateEntry(
+        key,
+        [&](SensorMapValue& mapValue) {
+            mapValue.timestamp = timestamp;
+            mapValue.timestampStr = timestampStr;
+            mapValue.timestampEpochMs = 0;
+            return true;
+        },
+        [&](ValueType& value) {
+            value.timestamp = timestamp;
+            value.timestampStr = timestampStr;
+            return true;
+        });
+}
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::updateValue(const string& key, const string& val)
+{
+    return updateEntry(
+        key,
+        [&](SensorMapValue& mapValue) {
+            mapValue.sensorValue = val;
+            mapValue.valueKind = MetricValueKind::text;
+            return true;
+        },
+        [&](ValueType& value) {
+            value.sensorValue = val;
+            return true;
+        });
+}
+
+template <class MapType, class ValueType>
+EntryHandle Map<MapType, ValueType>::insert(const string& key,
+                                            const ValueType& val,
+                                            bool& isDeferred)
 {
     if (opts & O_CREAT)
     {
-        shmem_write_lock_t lock(*memLock);
-        SensorMapValue mapValue(*voidAllocator);
-        mapValue.metricProperty = val.metricProperty;
+        EntryHandle handle;
+        isDeferred = false;
+        // Interning a new URI changes the string table, only an entry that
+        // keeps its URI can be rewritten without the structural guard. A
+        // deferred change of the key is followed by a deferred insert.
+        if (updateEntry(
+                handle, key,
+                [&](SensorMapValue& mapValue) {
+                    if (!hasMetricProperty(mapValue, val.metricProperty))
+                    {
+                        return false;
+                    }
+                    mapValue.timestampStr = val.timestampStr;
+                    mapValue.sensorValue = val.sensorValue;
+                    mapValue.timestamp = val.timestamp;
+                    mapValue.timestampEpochMs = 0;
+                    mapValue.valueKind = MetricValueKind::text;
+                    return true;
+                },
+                [](ValueType&) { return false; }))
+        {
+            return handle;
+        }
+        isDeferred = !writeOrDefer(
+            !deferred.empty(),
+            [&]() {
+                applyDeferredLocked();
+                handle = insertLocked(key, val);
+            },
+            [&]() {
+                handle = {};
+                deferred.push({BatchOp<ValueType>::Type::insert, key, val});
+            });
+        return handle;
+    }
+    else
+    {
+        throw PermissionErrorException();
+    }
+}
+
+template <class MapType, class ValueType>
+EntryHandle Map<MapType, ValueType>::insertLocked(const string& key,
+                                                  const ValueType& val)
+{
+    EntryHandle handle;
+    auto itr = mapImpl->find(string_view(key));
+    if (itr != mapImpl->end())
+    {
+        setHandle(handle, *itr);
+        auto& mapValue = (*itr).second;
+        VersionWriteGuard versionGuard(mapValue.version);
+        if (!hasMetricProperty(mapValue, val.metricProperty))
+        {
+            unindexEntry(*mapImpl, *itr);
+            setMetricProperty(mapValue, val.metricProperty);
+            indexEntry(*mapImpl, *itr);
+        }
+        attachEntryRecords(key, mapValue);
+        attachJournalKey(key, mapValue);
         mapValue.timestampStr = val.timestampStr;
         mapValue.sensorValue = val.sensorValue;
         mapValue.timestamp = val.timestamp;
-        map_value_type_t mapEntry(getMapKey(key), mapValue);
-        mapImpl->insert(mapEntry);
+        mapValue.timestampEpochMs = 0;
+        mapValue.valueKind = MetricValueKind::text;
+        mapValue.stale = false;
+        mapValue.generation = nextGeneration();
+        markDirty(key);
+        journalChange(ChangeKind::upsert, key, mapValue.generation);
+        return handle;
     }
-    else
+    SensorMapValue mapValue(*voidAllocator);
+    setMetricProperty(mapValue, val.metricProperty);
+    mapValue.timestampStr = val.timestampStr;
+    mapValue.sensorValue = val.sensorValue;
+    mapValue.timestamp = val.timestamp;
+    mapValue.generation = nextGeneration();
+    attachEntryRecords(key, mapValue);
+    map_value_type_t mapEntry(getMapKey(key), mapValue);
+    auto& entry = *mapImpl->insert(mapEntry).first;
+    // Once inserted, so that a failed insert holds no key
+    attachJournalKey(key, entry.second);
+    setHandle(handle, entry);
+    indexEntry(*mapImpl, entry);
+    markDirty(key);
+    journalChange(ChangeKind::upsert, key, mapValue.generation);
+    return handle;
+}
+
+template <class MapType, class ValueType>
+size_t Map<MapType, ValueType>::applyBatch(span<BatchOp<ValueType>> ops)
+{
+    if (!(opts & O_CREAT))
     {
         throw PermissionErrorException();
     }
+    // Run again from the start in a grown segment, the operations are
+    // idempotent
+    size_t applied = 0;
+    writeOrDefer(
+        !deferred.empty(),
+        [&]() {
+            applyDeferredLocked();
+            applied = applyBatchLocked(ops);
+        },
+        [&]() { applied = deferBatch(ops); });
+    return applied;
 }
 
-template <>
-bool Map<SensorMap, SensorValue>::updateValueAndTimeStamp(
-    const string& key, const string& val, const uint64_t timestamp,
-    const string& timestampStr)
+template <class MapType, class ValueType>
+size_t Map<MapType, ValueType>::deferBatch(span<BatchOp<ValueType>> ops)
 {
-    if (opts & O_CREAT)
+    using Type = typename BatchOp<ValueType>::Type;
+    size_t applied = 0;
+    vector<BatchOp<ValueType>> batch;
+    // Whether the keys written by the batch so far are present
+    unordered_map<string_view, bool> written;
+    for (auto& op : ops)
     {
-        shmem_write_lock_t lock(*memLock);
-        auto itr = mapImpl->find(getMapKey(key));
-        if (itr != mapImpl->end())
+        op.applied = true;
+        if (op.type != Type::update)
         {
-            (*itr).second.sensorValue = val;
-            (*itr).second.timestamp = timestamp;
-            (*itr).second.timestampStr = timestampStr;
-            return true;
+            written[op.key] = op.type == Type::insert;
         }
-        else
+        else if (auto itr = written.find(op.key); itr != written.end())
         {
-            return false;
+            op.applied = itr->second;
+        }
+        else if (!deferred.visitLast(op.key, [&op](BatchOp<ValueType>* last) {
+                     op.applied = last != nullptr &&
+                                  last->type != Type::erase;
+                 }))
+        {
+            withReaderRegistered([this, &op]() {
+                op.applied =
+                    mapImpl->find(string_view(op.key)) != mapImpl->end();
+            });
+        }
+        if (op.applied)
+        {
+            batch.push_back(op);
+            applied++;
         }
     }
-    else
+    // Queued at once, so that it is applied at once
+    deferred.push(span(batch));
+    return applied;
+}
+
+template <class MapType, class ValueType>
+size_t Map<MapType, ValueType>::applyBatchLocked(span<BatchOp<ValueType>> ops)
+{
+    size_t applied = 0;
+    for (auto& op : ops)
     {
-        throw PermissionErrorException();
+        op.applied = true;
+        switch (op.type)
+        {
+            case BatchOp<ValueType>::Type::insert:
+                insertLocked(op.key, op.value);
+                break;
+            case BatchOp<ValueType>::Type::update:
+            {
+                auto itr = mapImpl->find(string_view(op.key));
+                if (itr == mapImpl->end())
+                {
+                    op.applied = false;
+                    break;
+                }
+                auto& mapValue = (*itr).second;
+                VersionWriteGuard versionGuard(mapValue.version);
+                mapValue.sensorValue = op.value.sensorValue;
+                mapValue.valueKind = MetricValueKind::text;
+                mapValue.timestamp = op.value.timestamp;
+                mapValue.timestampStr = op.value.timestampStr;
+                mapValue.timestampEpochMs = 0;
+                mapValue.stale = false;
+                mapValue.generation = nextGeneration();
+                markDirty(op.key);
+                journalChange(ChangeKind::upsert, op.key,
+                              mapValue.generation);
+                break;
+            }
+            case BatchOp<ValueType>::Type::erase:
+            {
+                auto itr = mapImpl->find(string_view(op.key));
+                if (itr != mapImpl->end())
+                {
+                    unindexEntry(*mapImpl, *itr);
+                    eraseEntryRecords(*itr);
+                    mapImpl->erase(itr);
+                    entryRemoved(*mapImpl);
+                    markRemoval();
+                    journalChange(ChangeKind::erase, op.key);
+                }
+                markDirty(op.key);
+                break;
+            }
+        }
+        if (op.applied)
+        {
+            applied++;
+        }
     }
+    return applied;
+}
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::updateValueAndTimeStamp(
+    const string& key, const string& val, const uint64_t timestamp,
+    const string& timestampStr)
+{
+    return updateEntry(
+        key,
+        [&](SensorMapValue& mapValue) {
+            mapValue.sensorValue = val;
+            mapValue.valueKind = MetricValueKind::text;
+            mapValue.timestamp = timestamp;
+            mapValue.timestampStr = timestampStr;
+            mapValue.timestampEpochMs = 0;
+            return true;
+        },
+        [&](ValueType& value) {
+            value.sensorValue = val;
+            value.timestamp = timestamp;
+            value.timestampStr = timestampStr;
+            return true;
+        });
 }
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::updateMetricValue(const string& key,
+                                                const MetricValue& value,
+                                                const uint64_t timestamp,
+                                                const uint64_t timestampEpochMs)
+{
+    EntryHandle handle;
+    return updateMetricValue(handle, key, value, timestamp, timestampEpochMs);
+}
+
+template <class MapType, class ValueType>
+bool Map<MapType, ValueType>::updateMetricValue(
+    EntryHandle& handle, const string& key, const MetricValue& value,
+    const uint64_t timestamp, const uint64_t timestampEpochMs)
+{
+    return updateEntry(
+        handle, key,
+        [&](SensorMapValue& mapValue) {
+            if (value.kind == MetricValueKind::text)
+            {
+                mapValue.sensorValue = value.text;
+            }
+            else
+            {
+                mapValue.rawValue = value.raw;
+            }
+            mapValue.valueKind = value.kind;
+            mapValue.timestamp = timestamp;
+            mapValue.timestampEpochMs = timestampEpochMs;
+            if (value.kind == MetricValueKind::text)
+            {
+                return true;
+            }
+            uint64_t sampleMs = timestampEpochMs ? timestampEpochMs
+                                                 : timestamp;
+            if (mapValue.history != nullptr)
+            {
+                VersionWriteGuard historyGuard(mapValue.history->version);
+                mapValue.history->append(sampleMs, metricValueToDouble(value));
+            }
+            if (mapValue.aggregates != nullptr)
+            {
+                VersionWriteGuard aggregatesGuard(
+                    mapValue.aggregates->version);
+                mapValue.aggregates->add(sampleMs, metricValueToDouble(value));
+            }
+            return true;
+        },
+        [&](ValueType& pending) {
+            // Rendered now, the deferred object only holds strings
+            pending.sensorValue = (value.kind == MetricValueKind::text)
+                                      ? value.text
+                                      : renderMetricValue(value.kind,
+                                                          value.raw);
+            pending.timestamp = timestamp;
+            if (timestampEpochMs != 0)
+            {
+                pending.timestampStr =
+                    nv::sensor_aggregation::metricUtils::getDateTimeUintMs(
+                        timestampEpochMs);
+            }
+            return true;
+        });
+}
+
+template class nv::shmem::Map<SensorMap, SensorValue>;
+template class nv::shmem::Map<SensorHashMap, SensorValue>;
+template class nv::shmem::Map<SensorDenseMap, SensorValue>;
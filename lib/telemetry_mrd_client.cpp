@@ -25,6 +25,9 @@
 
 #include <phosphor-logging/lg2.hpp>
 
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <string>
 #include <unordered_map>
 
@@ -37,6 +40,64 @@ namespace shmem
 namespace sensor_aggregation
 {
 
+/** @brief Shared segment of the producer of nameSpace, empty when the
+ * namespace has a segment of its own */
+static string segmentOf(const string& nameSpace)
+{
+    static const unordered_map<string, string> sharedSegments =
+        ConfigReader::getSharedSegments();
+    string segment;
+    size_t matched = 0;
+    for (const auto& [producerName, segmentName] : sharedSegments)
+    {
+        if (producerName.size() > matched &&
+            nameSpace.starts_with(producerName + "_"))
+        {
+            segment = segmentName;
+            matched = producerName.size();
+        }
+    }
+    return segment;
+}
+
+/** @brief MRD namespaces and the producers publishing to them */
+static const unordered_map<string, vector<string>>& mrdNamespaceLookup()
+{
+    static const unordered_map<string, vector<string>> lookup =
+        ConfigReader::getMRDNamespaceLookup();
+    return lookup;
+}
+
+/**
+ * @brief Producers publishing to an MRD namespace
+ *
+ * @param[in] mrdNamespace - metric report definitions namespace
+ * @return producer names, the shared memory namespaces are
+ * <producer>_<mrdNamespace>
+ * @throws NameSpaceNotFoundException if mrdNamespace is not in the MRD lookup
+ */
+static const vector<string>& mrdProducers(const string& mrdNamespace)
+{
+    auto lookup = mrdNamespaceLookup().find(mrdNamespace);
+    if (lookup == mrdNamespaceLookup().end())
+    {
+        string errorMessage = "SHMEMDEBUG: Requested " + mrdNamespace +
+                              " namespace is not found in the MRD lookup.";
+        LOG_ERROR(errorMessage);
+        throw NameSpaceNotFoundException();
+    }
+    return lookup->second;
+}
+
+/** @brief Log an exception reading a shared memory namespace, the clients
+ * carry on with the other producers */
+static void logReadError(const string& nameSpace, const exception& e)
+{
+    lg2::error("SHMEMDEBUG: Exception {EXCEPTION} while reading from {MRD} "
+               "namespace",
+               "EXCEPTION", e.what(), "MRD", nameSpace);
+}
+
 ShmemKeyValuePairs getAllKeyValuePair(const std::string& mrdNamespace)
 {
     static unordered_map<string, unique_ptr<sensor_map_type>> sensor_map;
@@ -46,84 +107,294 @@ ShmemKeyValuePairs getAllKeyValuePair(const std::string& mrdNamespace)
         {
             sensor_map.insert(std::make_pair(
                 mrdNamespace,
-                make_unique<sensor_map_type>(mrdNamespace, O_RDONLY)));
+                make_unique<sensor_map_type>(mrdNamespace, O_RDONLY,
+                                             segmentOf(mrdNamespace))));
         }
         return sensor_map[mrdNamespace]->getAllKeyValuePair();
     }
     catch (const exception& e)
     {
-        lg2::error("SHMEMDEBUG: Exception {EXCEPTION} while reading from {MRD} "
-                   "namespace",
-                   "EXCEPTION", e.what(), "MRD", mrdNamespace);
+        logReadError(mrdNamespace, e);
         throw NameSpaceNotFoundException();
     }
     throw NoElementsException();
 }
 
+uint64_t waitForChange(const string& nameSpace, uint64_t lastGeneration,
+                       chrono::milliseconds timeout)
+{
+    unique_ptr<sensor_map_type> sensor_map;
+    try
+    {
+        sensor_map = make_unique<sensor_map_type>(nameSpace, O_RDONLY,
+                                                  segmentOf(nameSpace));
+    }
+    catch (const exception& e)
+    {
+        logReadError(nameSpace, e);
+        throw NameSpaceNotFoundException();
+    }
+    return sensor_map->waitForChange(lastGeneration, timeout);
+}
+
 vector<SensorValue> getAllMRDValues(const string& mrdNamespace)
 {
-    static unordered_map<string, vector<string>> mrdNamespaceLookup =
-        ConfigReader::getMRDNamespaceLookup();
+    return getAllMRDValues(mrdNamespace, 0);
+}
+
+vector<SensorValue> getAllMRDValues(const string& mrdNamespace,
+                                    size_t chunkEntries)
+{
+    const auto& producerNames = mrdProducers(mrdNamespace);
     vector<SensorValue> values;
-    if (mrdNamespaceLookup.find(mrdNamespace) != mrdNamespaceLookup.end())
+    for (const auto& producerName : producerNames)
     {
-        for (auto& producerName : mrdNamespaceLookup[mrdNamespace])
+        auto nameSpace = producerName + "_" + mrdNamespace;
+        try
         {
-            try
+            sensor_map_type sensor_map(nameSpace, O_RDONLY,
+                                       segmentOf(nameSpace));
+            auto mrdValues = chunkEntries
+                                 ? sensor_map.getAllValuesChunked(chunkEntries)
+                                 : sensor_map.getAllValues();
+            if (mrdValues.size())
             {
-                auto nameSpace = producerName + "_" + mrdNamespace;
-                sensor_map_type sensor_map(nameSpace, O_RDONLY);
-                auto mrdValues = sensor_map.getAllValues();
-                if (mrdValues.size())
-                {
-                    SHMDEBUG(
-                        "SHMEMDEBUG: Requested {MRD} namespace has {NUMBER} of elements",
-                        "MRD", nameSpace, "NUMBER", mrdValues.size());
-                    values.insert(values.end(), mrdValues.begin(),
-                                  mrdValues.end());
-                }
-                else
-                {
-                    string errorMessage = "SHMEMDEBUG: Requested" + nameSpace +
-                                          "namespace has no elements";
-                    LOG_ERROR(errorMessage);
-                }
+                SHMDEBUG(
+                    "SHMEMDEBUG: Requested {MRD} namespace has {NUMBER} of elements",
+                    "MRD", nameSpace, "NUMBER", mrdValues.size());
+                values.insert(values.end(),
+                              make_move_iterator(mrdValues.begin()),
+                              make_move_iterator(mrdValues.end()));
             }
-            catch (const exception& e)
+            else
             {
-                lg2::error(
-                    "SHMEMDEBUG: Exception {EXCEPTION} while reading from {MRD} "
-                    "namespace",
-                    "EXCEPTION", e.what(), "MRD", mrdNamespace);
+                string errorMessage = "SHMEMDEBUG: Requested " + nameSpace +
+                                      " namespace has no elements";
+                LOG_ERROR(errorMessage);
             }
         }
-        if (values.size() != 0)
+        catch (const exception& e)
         {
-            return values;
+            logReadError(nameSpace, e);
+        }
+    }
+    if (values.size() == 0)
+    {
+        string errorMessage = "SHMEMDEBUG: Requested " + mrdNamespace +
+                              " namespace has no elements.";
+        LOG_ERROR(errorMessage);
+        throw NoElementsException();
+    }
+    return values;
+}
+
+vector<SensorValue> getMRDValuesByPrefix(const string& mrdNamespace,
+                                         string_view prefix)
+{
+    const auto& producerNames = mrdProducers(mrdNamespace);
+    vector<SensorValue> values;
+    for (const auto& producerName : producerNames)
+    {
+        auto nameSpace = producerName + "_" + mrdNamespace;
+        try
+        {
+            sensor_map_type sensor_map(nameSpace, O_RDONLY,
+                                       segmentOf(nameSpace));
+            auto mrdValues = sensor_map.getValuesByPrefix(prefix);
+            values.insert(values.end(), make_move_iterator(mrdValues.begin()),
+                          make_move_iterator(mrdValues.end()));
         }
-        else
+        catch (const exception& e)
         {
-            string errorMessage = "SHMEMDEBUG: Requested" + mrdNamespace +
-                                  "namespace has no elements.";
-            LOG_ERROR(errorMessage);
-            throw NoElementsException();
+            logReadError(nameSpace, e);
         }
     }
-    else
+    return values;
+}
+
+vector<SensorValue>
+    getMRDValuesByMetricProperties(const string& mrdNamespace,
+                                   const vector<string>& uris)
+{
+    const auto& producerNames = mrdProducers(mrdNamespace);
+    vector<SensorValue> values;
+    for (const auto& producerName : producerNames)
     {
-        string errorMessage = "SHMEMDEBUG: Requested" + mrdNamespace +
-                              "namespace is not found in the MRD lookup.";
+        auto nameSpace = producerName + "_" + mrdNamespace;
+        try
+        {
+            sensor_map_type sensor_map(nameSpace, O_RDONLY,
+                                       segmentOf(nameSpace));
+            auto mrdValues = sensor_map.getValuesByMetricProperties(uris);
+            values.insert(values.end(), make_move_iterator(mrdValues.begin()),
+                          make_move_iterator(mrdValues.end()));
+        }
+        catch (const exception& e)
+        {
+            logReadError(nameSpace, e);
+        }
+    }
+    return values;
+}
+
+vector<HistorySample> getMRDHistory(const string& mrdNamespace,
+                                    const string& key, uint64_t sinceMs)
+{
+    const auto& producerNames = mrdProducers(mrdNamespace);
+    for (const auto& producerName : producerNames)
+    {
+        auto nameSpace = producerName + "_" + mrdNamespace;
+        try
+        {
+            sensor_map_type sensor_map(nameSpace, O_RDONLY,
+                                       segmentOf(nameSpace));
+            auto samples = sensor_map.getHistory(key, sinceMs);
+            if (!samples.empty())
+            {
+                return samples;
+            }
+        }
+        catch (const exception& e)
+        {
+            logReadError(nameSpace, e);
+        }
+    }
+    return {};
+}
+
+bool getMRDAggregates(const string& mrdNamespace, const string& key,
+                      MetricAggregates& aggregates)
+{
+    const auto& producerNames = mrdProducers(mrdNamespace);
+    for (const auto& producerName : producerNames)
+    {
+        auto nameSpace = producerName + "_" + mrdNamespace;
+        try
+        {
+            sensor_map_type sensor_map(nameSpace, O_RDONLY,
+                                       segmentOf(nameSpace));
+            if (sensor_map.getAggregates(key, aggregates))
+            {
+                return true;
+            }
+        }
+        catch (const exception& e)
+        {
+            logReadError(nameSpace, e);
+        }
+    }
+    return false;
+}
+
+size_t visitMRDValues(const string& mrdNamespace,
+                      const function<void(const SensorValueView&)>& visitor)
+{
+    const auto& producerNames = mrdProducers(mrdNamespace);
+    size_t visited = 0;
+    for (const auto& producerName : producerNames)
+    {
+        auto nameSpace = producerName + "_" + mrdNamespace;
+        unique_ptr<sensor_map_type> sensor_map;
+        try
+        {
+            sensor_map = make_unique<sensor_map_type>(nameSpace, O_RDONLY,
+                                                      segmentOf(nameSpace));
+        }
+        catch (const exception& e)
+        {
+            logReadError(nameSpace, e);
+            continue;
+        }
+        // Exceptions of the visitor are the caller's
+        visited += sensor_map->visitValues(visitor);
+    }
+    if (visited == 0)
+    {
+        string errorMessage = "SHMEMDEBUG: Requested " + mrdNamespace +
+                              " namespace has no elements.";
         LOG_ERROR(errorMessage);
-        throw NameSpaceNotFoundException();
+        throw NoElementsException();
     }
+    return visited;
+}
+
+vector<SensorValue> getMRDValuesChangedSince(const string& mrdNamespace,
+                                             MRDChangeCursors& cursors,
+                                             bool& full)
+{
+    const auto& producerNames = mrdProducers(mrdNamespace);
+    full = cursors.empty();
+    while (true)
+    {
+        vector<SensorValue> values;
+        // Set when the client must drop values of a producer it read before,
+        // all producers are then read again
+        bool restart = false;
+        for (const auto& producerName : producerNames)
+        {
+            auto nameSpace = producerName + "_" + mrdNamespace;
+            bool known = cursors.find(nameSpace) != cursors.end();
+            try
+            {
+                sensor_map_type sensor_map(nameSpace, O_RDONLY,
+                                           segmentOf(nameSpace));
+                bool producerFull = false;
+                auto mrdValues = sensor_map.getValuesChangedSince(
+                    cursors[nameSpace], producerFull);
+                restart |= known && producerFull && !full;
+                values.insert(values.end(),
+                              make_move_iterator(mrdValues.begin()),
+                              make_move_iterator(mrdValues.end()));
+            }
+            catch (const exception& e)
+            {
+                restart |= cursors.erase(nameSpace) != 0 && !full;
+                logReadError(nameSpace, e);
+            }
+        }
+        if (!restart)
+        {
+            return values;
+        }
+        cursors.clear();
+        full = true;
+    }
+}
+
+vector<ChangeRecord> getMRDChanges(const string& mrdNamespace,
+                                   MRDJournalCursors& cursors, bool& resync)
+{
+    const auto& producerNames = mrdProducers(mrdNamespace);
+    vector<ChangeRecord> changes;
+    resync = false;
+    for (const auto& producerName : producerNames)
+    {
+        auto nameSpace = producerName + "_" + mrdNamespace;
+        try
+        {
+            sensor_map_type sensor_map(nameSpace, O_RDONLY,
+                                       segmentOf(nameSpace));
+            bool producerResync = false;
+            auto records =
+                sensor_map.getChangesSince(cursors[nameSpace], producerResync);
+            resync |= producerResync;
+            changes.insert(changes.end(), make_move_iterator(records.begin()),
+                           make_move_iterator(records.end()));
+        }
+        catch (const exception& e)
+        {
+            // The values of the producer must be dropped
+            resync |= cursors.erase(nameSpace) != 0;
+            logReadError(nameSpace, e);
+        }
+    }
+    return changes;
 }
 
 vector<string> getMrdNamespacesValues()
 {
-    static unordered_map<string, vector<string>> mrdNamespaceLookup =
-        ConfigReader::getMRDNamespaceLookup();
     vector<string> mrd;
-    for (const auto& pair : mrdNamespaceLookup)
+    for (const auto& pair : mrdNamespaceLookup())
     {
         mrd.push_back(pair.first);
     }
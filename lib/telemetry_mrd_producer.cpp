@@ -111,3 +111,30 @@ bool AggregationService::updateTelemetry(const string& devicePath,
                                                  associatedEntityPath);
     }
 }
+
+bool AggregationService::publishUpdates()
+{
+    if (sensorAggregator == nullptr)
+    {
+        return false;
+    }
+    return sensorAggregator->publishShmemNamespaces();
+}
+
+bool AggregationService::flushDeferredUpdates()
+{
+    if (sensorAggregator == nullptr)
+    {
+        return false;
+    }
+    return sensorAggregator->flushShmemNamespaces();
+}
+
+bool AggregationService::purgeStaleTelemetry()
+{
+    if (sensorAggregator == nullptr)
+    {
+        return false;
+    }
+    return sensorAggregator->purgeStaleObjects();
+}
@@ -25,10 +25,12 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <bit>
 #include <cctype>
 #include <regex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
@@ -208,6 +210,13 @@ static MetricNameMap processorPerfMap = {
     {"PCIeRXBytes", "/Oem/Nvidia/PCIeRXBytes"},
     {"Value", "#/Oem/Nvidia/PowerBreakPerformanceState"}};
 
+/* Throttle durations of the processor performance pdi, read in nanoseconds
+ * and reported as redfish durations */
+static const unordered_set<MetricName> throttleDurationMetrics = {
+    "PowerLimitThrottleDuration", "ThermalLimitThrottleDuration",
+    "HardwareViolationThrottleDuration",
+    "GlobalSoftwareViolationThrottleDuration"};
+
 /* Map for NvLinkMetricsMap pdi to redfish string based on metric name*/
 static MetricNameMap nvLinkMetricsMap = {
     {"NVLinkRawTxBandwidthGbps", "/Oem/Nvidia/NVLinkRawTxBandwidthGbps"},
@@ -884,10 +893,7 @@ inline string translateThrottleDuration(const string& metricName,
                                         const uint64_t& reading)
 {
     string metricValue;
-    if ((metricName == "PowerLimitThrottleDuration") ||
-        (metricName == "ThermalLimitThrottleDuration") ||
-        (metricName == "HardwareViolationThrottleDuration") ||
-        (metricName == "GlobalSoftwareViolationThrottleDuration"))
+    if (throttleDurationMetrics.contains(metricName))
     {
         optional<string> duration =
             nv::sensor_aggregation::metricUtils::toDurationStringFromNano(
@@ -1135,6 +1141,77 @@ inline SHMValue getMetricValue(const string& metricName,
     return shmValue;
 }
 
+/**
+ * @brief This method returns the metric value of a simple data type in its
+ * D-Bus type, to be rendered to the same string as getMetricValue when a client
+ * reads it. Only string readings are translated here. This method should be
+ * used for value and timestamp updates.
+ *
+ * @param[in] metricName
+ * @param[in] ifaceName
+ * @param[in] value
+ * @return MetricValue
+ */
+inline nv::shmem::MetricValue getRawMetricValue(const string& metricName,
+                                                const string& ifaceName,
+                                                DbusVariantType& value)
+{
+    using nv::shmem::MetricValueKind;
+    nv::shmem::MetricValue metricValue;
+    if (const string* reading = get_if<string>(&value))
+    {
+        metricValue.text = translateReading(ifaceName, metricName, *reading);
+    }
+    else if (const int* reading = get_if<int>(&value))
+    {
+        metricValue = {MetricValueKind::signedInteger,
+                       static_cast<uint64_t>(*reading), {}};
+    }
+    else if (const int16_t* reading = get_if<int16_t>(&value))
+    {
+        metricValue = {MetricValueKind::signedInteger,
+                       static_cast<uint64_t>(*reading), {}};
+    }
+    else if (const int64_t* reading = get_if<int64_t>(&value))
+    {
+        metricValue = {MetricValueKind::signedInteger,
+                       static_cast<uint64_t>(*reading), {}};
+    }
+    else if (const uint16_t* reading = get_if<uint16_t>(&value))
+    {
+        metricValue = {MetricValueKind::unsignedInteger, *reading, {}};
+    }
+    else if (const uint32_t* reading = get_if<uint32_t>(&value))
+    {
+        metricValue = {MetricValueKind::unsignedInteger, *reading, {}};
+    }
+    else if (const uint64_t* reading = get_if<uint64_t>(&value))
+    {
+        MetricValueKind kind = MetricValueKind::unsignedInteger;
+        if ((ifaceName == "xyz.openbmc_project.State.ProcessorPerformance") &&
+            ((metricName == "AccumulatedSMUtilizationDuration") ||
+             (metricName == "AccumulatedGPUContextUtilizationDuration")))
+        {
+            kind = MetricValueKind::durationMs;
+        }
+        else if (throttleDurationMetrics.contains(metricName))
+        {
+            kind = MetricValueKind::durationNs;
+        }
+        metricValue = {kind, *reading, {}};
+    }
+    else if (const double* reading = get_if<double>(&value))
+    {
+        metricValue = {MetricValueKind::floatingPoint,
+                       bit_cast<uint64_t>(*reading), {}};
+    }
+    else if (const bool* reading = get_if<bool>(&value))
+    {
+        metricValue = {MetricValueKind::boolean, *reading ? 1U : 0U, {}};
+    }
+    return metricValue;
+}
+
 } // namespace metricUtils
 } // namespace sensor_aggregation
 } // namespace nv
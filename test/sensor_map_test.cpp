@@ -17,15 +17,37 @@
 
 #include "config.h"
 
+#include "impl/gorilla_codec.hpp"
 #include "impl/shmem_map.hpp"
+#include "impl/shmem_struct_map.hpp"
 
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <limits>
+#include <map>
 #include <memory>
+#include <set>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include <gtest/gtest.h>
 
 using namespace nv::shmem;
 
+/** @brief Reader with access to the namespace lock and its reader slot */
+class LockHolder : public ManagedShmem
+{
+  public:
+    using ManagedShmem::ManagedShmem;
+    using ManagedShmem::memLock;
+    using ManagedShmem::readerSlot;
+};
+
 class SensorMapTests : public testing::Test
 {
   public:
@@ -207,3 +229,1850 @@ TEST_F(SensorMapTests, testSensorMapReadOnlyMapErrorInUpdate)
                                  1699255438, "1/1/2022");
     EXPECT_THROW(mShmemROnly->insert(sensorName, value), std::runtime_error);
 }
+
+TEST_F(SensorMapTests, testSensorMapConcurrentReadIsConsistent)
+{
+    mShmem->clear();
+    auto sensorName = "HGX_Chassis_0_My_Sensor_1";
+    nv::shmem::SensorValue value("0",
+                                 "/redfish/v1/HGX_Chassis_0/Sensors/Sensor_1",
+                                 0, "0");
+    mShmem->insert(sensorName, value);
+
+    std::atomic<bool> done{false};
+    std::thread writer([this, &done, &value, sensorName]() {
+        for (int i = 1; i < 20000; i++)
+        {
+            // value and timestamp string always carry the same number, long
+            // enough to leave the short string buffer
+            auto str = std::to_string(i) + std::string(40, 'x');
+            mShmem->updateValueAndTimeStamp(sensorName, str, i, str);
+            if (i % 100 == 0)
+            {
+                mShmem->insert("HGX_Chassis_0_My_Sensor_" + std::to_string(i),
+                               value);
+                mShmem->erase("HGX_Chassis_0_My_Sensor_" +
+                              std::to_string(i - 100));
+            }
+        }
+        done = true;
+    });
+
+    auto reader = std::make_unique<Map<SensorMap, SensorValue>>("maptest",
+                                                                O_RDONLY);
+    while (!done)
+    {
+        nv::shmem::SensorValue readValue;
+        EXPECT_TRUE(reader->getValue(sensorName, readValue));
+        EXPECT_EQ(readValue.sensorValue, readValue.timestampStr);
+        for (const auto& v : reader->getAllValues())
+        {
+            EXPECT_EQ(v.sensorValue.empty(), v.timestampStr.empty());
+        }
+    }
+    writer.join();
+}
+
+TEST_F(SensorMapTests, testSensorMapConcurrentEntryWriters)
+{
+    mShmem->clear();
+    for (int i = 0; i < 4; i++)
+    {
+        nv::shmem::SensorValue value(
+            "0",
+            "/redfish/v1/HGX_Chassis_0/Sensors/Sensor_" + std::to_string(i), 0,
+            "0");
+        mShmem->insert("HGX_Chassis_0_My_Sensor_" + std::to_string(i), value);
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 4; w++)
+    {
+        writers.emplace_back([this, w]() {
+            auto sensorName = "HGX_Chassis_0_My_Sensor_" + std::to_string(w);
+            for (int i = 1; i < 5000; i++)
+            {
+                auto str = std::to_string(i) + std::string(w * 10, 'x');
+                EXPECT_TRUE(
+                    mShmem->updateValueAndTimeStamp(sensorName, str, i, str));
+            }
+        });
+    }
+    std::thread reader([&done]() {
+        Map<SensorMap, SensorValue> readOnly("maptest", O_RDONLY);
+        while (!done)
+        {
+            for (const auto& v : readOnly.getAllValues())
+            {
+                EXPECT_EQ(v.sensorValue, v.timestampStr);
+            }
+        }
+    });
+    for (auto& writer : writers)
+    {
+        writer.join();
+    }
+    done = true;
+    reader.join();
+
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_3", readValue));
+    EXPECT_EQ(readValue.sensorValue, "4999" + std::string(30, 'x'));
+    EXPECT_EQ(readValue.timestamp, 4999);
+}
+
+TEST_F(SensorMapTests, testSensorMapSlowReaderDefersStructuralWrite)
+{
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    mShmem->insert("Port_1", value);
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+
+    // A reader stays registered for longer than the drain timeout
+    LockHolder slowReader("maptest", O_RDONLY);
+    auto& registered = slowReader.readerSlot->activeReaders;
+    registered.fetch_add(1);
+
+    // Structural writes are deferred rather than dropped, the map is left as
+    // the reader found it
+    mShmem->erase("Port_0");
+    bool deferred = false;
+    auto handle = mShmem->insert("Port_2", value, deferred);
+    EXPECT_TRUE(deferred);
+    EXPECT_TRUE(handle == EntryHandle{});
+    EXPECT_EQ(reader.size(), 2);
+    SensorValue result;
+    EXPECT_TRUE(reader.getValue("Port_0", result));
+    EXPECT_FALSE(reader.getValue("Port_2", result));
+
+    // Value updates follow the deferred changes of their key
+    EXPECT_FALSE(mShmem->updateValue("Port_0", "1"));
+    EXPECT_TRUE(mShmem->updateValue("Port_2", "2"));
+    EXPECT_TRUE(mShmem->updateValue("Port_1", "1"));
+    ASSERT_TRUE(reader.getValue("Port_1", result));
+    EXPECT_EQ(result.sensorValue, "1");
+
+    // Once the reader left the next write applies them in order
+    registered.fetch_sub(1);
+    mShmem->erase("Port_1");
+    EXPECT_EQ(reader.size(), 1);
+    EXPECT_FALSE(reader.getValue("Port_0", result));
+    ASSERT_TRUE(reader.getValue("Port_2", result));
+    EXPECT_EQ(result.sensorValue, "2");
+
+    // Or an explicit flush
+    registered.fetch_add(1);
+    mShmem->clear();
+    mShmem->insert("Port_3", value);
+    EXPECT_EQ(reader.size(), 1);
+    registered.fetch_sub(1);
+    mShmem->flushDeferred();
+    EXPECT_EQ(reader.size(), 1);
+    EXPECT_TRUE(reader.getValue("Port_3", result));
+
+    // Without readers the insert is applied and returns a handle
+    handle = mShmem->insert("Port_4", value, deferred);
+    EXPECT_FALSE(deferred);
+    EXPECT_FALSE(handle == EntryHandle{});
+}
+
+TEST_F(SensorMapTests, testSensorMapEntryLockedIsReported)
+{
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    mShmem->insert("Port_1", value);
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+
+    // A writer stalls in the middle of an entry update
+    boost::interprocess::managed_shared_memory segment(
+        boost::interprocess::open_only, "maptest");
+    auto* map = segment.find<SensorMap>("maptestmap").first;
+    ASSERT_NE(map, nullptr);
+    auto& version = map->find(std::string_view("Port_0"))->second.version;
+    version.fetch_add(1);
+
+    // Readers report it rather than a missing key or a partial scan
+    SensorValue result;
+    EXPECT_THROW(reader.getValue("Port_0", result), LockAcquisitionException);
+    EXPECT_THROW(reader.getAllValues(), LockAcquisitionException);
+    EXPECT_TRUE(reader.getValue("Port_1", result));
+
+    // The next writer waits for it instead of taking the entry over
+    std::atomic<bool> updated = false;
+    std::thread writer([&]() {
+        EXPECT_TRUE(mShmem->updateValue("Port_0", "1"));
+        updated = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(updated);
+    version.fetch_add(1);
+    writer.join();
+    ASSERT_TRUE(reader.getValue("Port_0", result));
+    EXPECT_EQ(result.sensorValue, "1");
+    EXPECT_EQ(reader.getAllValues().size(), 2);
+}
+
+TEST_F(SensorMapTests, testSensorMapSnapshotPublish)
+{
+    mShmem.reset();
+    auto producer = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.publishMode = PublishMode::snapshot});
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+
+    for (int i = 0; i < 5; i++)
+    {
+        nv::shmem::SensorValue value(
+            std::to_string(i),
+            "/redfish/v1/HGX_Chassis_0/Sensors/Sensor_" + std::to_string(i), 0,
+            "1/1/2022");
+        producer->insert("HGX_Chassis_0_My_Sensor_" + std::to_string(i),
+                         value);
+    }
+    // nothing is visible before the first publish
+    EXPECT_EQ(reader.getAllValues().size(), 0);
+    producer->publish();
+    EXPECT_EQ(reader.getAllValues().size(), 5);
+
+    // updates of the next cycle stay invisible until published
+    producer->updateValue("HGX_Chassis_0_My_Sensor_1", "101");
+    producer->erase("HGX_Chassis_0_My_Sensor_4");
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("1", readValue.sensorValue);
+    EXPECT_EQ(reader.size(), 5);
+
+    producer->publish();
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("101", readValue.sensorValue);
+    EXPECT_FALSE(reader.getValue("HGX_Chassis_0_My_Sensor_4", readValue));
+    EXPECT_EQ(reader.size(), 4);
+
+    // the back buffer was brought up to date: the next cycle starts from the
+    // published state
+    producer->updateValue("HGX_Chassis_0_My_Sensor_2", "102");
+    producer->publish();
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("101", readValue.sensorValue);
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_2", readValue));
+    EXPECT_EQ("102", readValue.sensorValue);
+    EXPECT_EQ(reader.size(), 4);
+}
+
+TEST_F(SensorMapTests, testSensorMapWarmRestart)
+{
+    mShmem.reset();
+    NamespaceOptions options{.warmRestart = true, .configHash = 1};
+    auto producer = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000, options);
+    for (int i = 0; i < 5; i++)
+    {
+        nv::shmem::SensorValue value(
+            std::to_string(i),
+            "/redfish/v1/HGX_Chassis_0/Sensors/Sensor_" + std::to_string(i), 0,
+            "1/1/2022");
+        producer->insert("HGX_Chassis_0_My_Sensor_" + std::to_string(i),
+                         value);
+    }
+
+    // the producer dies while writing two of them
+    {
+        boost::interprocess::managed_shared_memory segment(
+            boost::interprocess::open_only, "maptest");
+        auto* map = segment.find<SensorMap>("maptestmap").first;
+        ASSERT_NE(map, nullptr);
+        map->find(std::string_view("HGX_Chassis_0_My_Sensor_3"))
+            ->second.version.fetch_add(1);
+        map->find(std::string_view("HGX_Chassis_0_My_Sensor_4"))
+            ->second.sensorValue.length = 1000;
+    }
+
+    // restart: the entries are kept and served as stale, the half written
+    // ones are dropped
+    producer.reset();
+    producer = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000, options);
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    EXPECT_EQ(reader.size(), 3);
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("1", readValue.sensorValue);
+    EXPECT_TRUE(readValue.stale);
+
+    // rediscovered objects are refreshed in place
+    nv::shmem::SensorValue value("11", "/redfish/v1/HGX_Chassis_0/Sensors/",
+                                 1, "1/1/2023");
+    producer->insert("HGX_Chassis_0_My_Sensor_1", value);
+    producer->updateValue("HGX_Chassis_0_My_Sensor_2", "12");
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("11", readValue.sensorValue);
+    EXPECT_FALSE(readValue.stale);
+    EXPECT_EQ(reader.size(), 3);
+
+    EXPECT_EQ(producer->eraseStale(), 1);
+    EXPECT_EQ(reader.size(), 2);
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_2", readValue));
+    EXPECT_FALSE(reader.getValue("HGX_Chassis_0_My_Sensor_3", readValue));
+    EXPECT_FALSE(reader.getValue("HGX_Chassis_0_My_Sensor_4", readValue));
+}
+
+TEST_F(SensorMapTests, testSensorMapWarmRestartSnapshot)
+{
+    mShmem.reset();
+    NamespaceOptions options{.publishMode = PublishMode::snapshot,
+                             .warmRestart = true,
+                             .configHash = 1};
+    auto producer = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000, options);
+    nv::shmem::SensorValue value("1", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    producer->insert("Sensor_0", value);
+    producer->insert("Sensor_1", value);
+    producer->publish();
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+
+    // the producer dies while writing a published entry
+    {
+        boost::interprocess::managed_shared_memory segment(
+            boost::interprocess::open_only, "maptest");
+        for (const char* name : {"maptestmap", "maptestmap1"})
+        {
+            auto* map = segment.find<SensorMap>(name).first;
+            ASSERT_NE(map, nullptr);
+            map->find(std::string_view("Sensor_1"))
+                ->second.version.fetch_add(1);
+        }
+    }
+    producer.reset();
+    producer = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000, options);
+
+    // readers are moved to a front buffer without it
+    nv::shmem::SensorValue readValue;
+    EXPECT_EQ(reader.size(), 1);
+    EXPECT_TRUE(reader.getValue("Sensor_0", readValue));
+    EXPECT_TRUE(readValue.stale);
+    EXPECT_FALSE(reader.getValue("Sensor_1", readValue));
+    producer->insert("Sensor_1", value);
+    producer->publish();
+    EXPECT_EQ(reader.size(), 2);
+    EXPECT_EQ(reader.getAllValues().size(), 2);
+}
+
+TEST_F(SensorMapTests, testSensorMapWarmRestartConfigChanged)
+{
+    mShmem.reset();
+    NamespaceOptions options{.warmRestart = true, .configHash = 1};
+    auto producer = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000, options);
+    nv::shmem::SensorValue value("1", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    producer->insert("HGX_Chassis_0_My_Sensor_1", value);
+    producer.reset();
+
+    // a different configuration falls back to a cold start
+    options.configHash = 2;
+    producer = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000, options);
+    EXPECT_EQ(producer->size(), 0);
+}
+
+TEST_F(SensorMapTests, testSensorHashMapInsertEraseLookup)
+{
+    mShmem.reset();
+    using HashMapShmem = Map<SensorHashMap, SensorValue>;
+    HashMapShmem producer("maptest", O_CREAT, 1024 * 1000,
+                          NamespaceOptions{.maxEntries = 64});
+    for (int i = 0; i < 64; i++)
+    {
+        nv::shmem::SensorValue value(
+            std::to_string(i),
+            "/redfish/v1/HGX_Chassis_0/Sensors/Sensor_" + std::to_string(i), 0,
+            "1/1/2022");
+        producer.insert("HGX_Chassis_0_My_Sensor_" + std::to_string(i), value);
+    }
+    HashMapShmem reader("maptest", O_RDONLY);
+    EXPECT_EQ(reader.size(), 64);
+    EXPECT_EQ(reader.getAllValues().size(), 64);
+
+    // erasing shifts probe runs back, every remaining key must stay reachable
+    for (int i = 0; i < 64; i += 2)
+    {
+        producer.erase("HGX_Chassis_0_My_Sensor_" + std::to_string(i));
+    }
+    EXPECT_EQ(reader.size(), 32);
+    nv::shmem::SensorValue readValue;
+    for (int i = 0; i < 64; i++)
+    {
+        EXPECT_EQ(reader.getValue("HGX_Chassis_0_My_Sensor_" +
+                                      std::to_string(i),
+                                  readValue),
+                  i % 2 == 1);
+    }
+    EXPECT_TRUE(producer.updateValueAndTimeStamp("HGX_Chassis_0_My_Sensor_7",
+                                                 "107", 7, "1/1/2023"));
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_7", readValue));
+    EXPECT_EQ("107", readValue.sensorValue);
+    EXPECT_EQ(7, readValue.timestamp);
+
+    // readers built for another map type refuse the segment
+    EXPECT_THROW((Map<SensorMap, SensorValue>("maptest", O_RDONLY)),
+                 BadMapException);
+}
+
+TEST_F(SensorMapTests, testSensorHashMapCapacity)
+{
+    mShmem.reset();
+    Map<SensorHashMap, SensorValue> producer(
+        "maptest", O_CREAT, 1024 * 1000, NamespaceOptions{.maxEntries = 4});
+    nv::shmem::SensorValue value("1", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    for (int i = 0; i < 4; i++)
+    {
+        producer.insert("HGX_Chassis_0_My_Sensor_" + std::to_string(i), value);
+    }
+    EXPECT_THROW(producer.insert("HGX_Chassis_0_My_Sensor_4", value),
+                 MapFullException);
+    producer.erase("HGX_Chassis_0_My_Sensor_0");
+    producer.insert("HGX_Chassis_0_My_Sensor_4", value);
+    EXPECT_EQ(producer.size(), 4);
+}
+
+template <class MapType>
+void checkCapacityGrowth(PublishMode mode)
+{
+    Map<MapType, SensorValue> producer(
+        "maptest", O_CREAT, 256 * 1024,
+        NamespaceOptions{.publishMode = mode,
+                         .maxEntries = 4,
+                         .indexMetricProperty = true,
+                         .maxSizeInBytes = 4 * 1024 * 1024});
+    Map<MapType, SensorValue> reader("maptest", O_RDONLY);
+    auto sensor = [](int i) {
+        return SensorValue(std::to_string(i),
+                           "/redfish/v1/Sensors/Sensor_" + std::to_string(i),
+                           0, "1/1/2022");
+    };
+    EntryHandle handle = producer.insert("Sensor_0", sensor(0));
+    for (int i = 1; i < 4; i++)
+    {
+        producer.insert("Sensor_" + std::to_string(i), sensor(i));
+    }
+    producer.publish();
+    ScanCursor cursor;
+    std::map<std::string, int> scanned;
+    for (const auto& object : reader.getValuesChunk(cursor, 2))
+    {
+        scanned[object.metricProperty]++;
+    }
+
+    // Past maxEntries the capacity doubles instead of throwing
+    for (int i = 4; i < 64; i++)
+    {
+        producer.insert("Sensor_" + std::to_string(i), sensor(i));
+    }
+    producer.publish();
+    EXPECT_EQ(reader.size(), 64);
+
+    // Handles and index entries follow entries moved by the growth
+    MetricValue reading{MetricValueKind::unsignedInteger, 42, {}};
+    EXPECT_TRUE(producer.updateMetricValue(handle, "Sensor_0", reading, 5,
+                                           1700000000123));
+    producer.publish();
+    SensorValue value;
+    ASSERT_TRUE(reader.getValueByMetricProperty(
+        "/redfish/v1/Sensors/Sensor_0", value));
+    EXPECT_EQ(value.sensorValue, "42");
+    ASSERT_TRUE(reader.getValueByMetricProperty(
+        "/redfish/v1/Sensors/Sensor_63", value));
+    EXPECT_EQ(value.sensorValue, "63");
+
+    // A scan spanning the growth returns the objects present throughout
+    // exactly once, and no other object twice
+    while (!cursor.done)
+    {
+        for (const auto& object : reader.getValuesChunk(cursor, 2))
+        {
+            scanned[object.metricProperty]++;
+        }
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(scanned.contains(sensor(i).metricProperty));
+    }
+    for (const auto& [uri, count] : scanned)
+    {
+        EXPECT_EQ(count, 1) << uri;
+    }
+    EXPECT_EQ(reader.getAllValues().size(), 64);
+}
+
+TEST_F(SensorMapTests, testSensorHashMapGrowCapacity)
+{
+    mShmem.reset();
+    for (auto mode : {PublishMode::live, PublishMode::snapshot})
+    {
+        checkCapacityGrowth<SensorHashMap>(mode);
+        checkCapacityGrowth<SensorDenseMap>(mode);
+    }
+}
+
+TEST_F(SensorMapTests, testSensorDenseMapInsertEraseScan)
+{
+    mShmem.reset();
+    using DenseMapShmem = Map<SensorDenseMap, SensorValue>;
+    DenseMapShmem producer("maptest", O_CREAT, 1024 * 1000,
+                           NamespaceOptions{.maxEntries = 32});
+    for (int i = 0; i < 32; i++)
+    {
+        nv::shmem::SensorValue value(
+            std::to_string(i),
+            "/redfish/v1/HGX_Chassis_0/Sensors/Sensor_" + std::to_string(i), i,
+            "1/1/2022");
+        producer.insert("HGX_Chassis_0_My_Sensor_" + std::to_string(i), value);
+    }
+    EXPECT_THROW(producer.insert("HGX_Chassis_0_My_Sensor_32",
+                                 nv::shmem::SensorValue()),
+                 MapFullException);
+    for (int i = 0; i < 32; i += 2)
+    {
+        producer.erase("HGX_Chassis_0_My_Sensor_" + std::to_string(i));
+    }
+
+    // scans walk the entry array, freed entries are skipped and reused
+    DenseMapShmem reader("maptest", O_RDONLY);
+    auto values = reader.getAllValues();
+    ASSERT_EQ(values.size(), 16);
+    for (const auto& value : values)
+    {
+        EXPECT_EQ(value.timestamp % 2, 1);
+    }
+    producer.insert("HGX_Chassis_0_My_Sensor_32", nv::shmem::SensorValue());
+    EXPECT_EQ(reader.getAllValues().size(), 17);
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_31", readValue));
+    EXPECT_EQ("31", readValue.sensorValue);
+
+    EXPECT_THROW((Map<SensorHashMap, SensorValue>("maptest", O_RDONLY)),
+                 BadMapException);
+}
+
+TEST_F(SensorMapTests, testSensorMapInlineValueUpdates)
+{
+    nv::shmem::SensorValue value("1", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "2024-01-01T00:00:00.000+00:00");
+    mShmem->insert("HGX_Chassis_0_My_Sensor_1", value);
+    size_t freeSize = mShmem->getFreeSize();
+
+    // short values are rewritten in place without touching the allocator
+    for (int i = 0; i < 1000; i++)
+    {
+        EXPECT_TRUE(mShmem->updateValueAndTimeStamp(
+            "HGX_Chassis_0_My_Sensor_1", std::to_string(i * 1.5), i,
+            "2024-01-01T00:00:00.000+00:00"));
+    }
+    EXPECT_EQ(mShmem->getFreeSize(), freeSize);
+
+    // long values go through the overflow string
+    std::string longValue(SHMEM_INLINE_VALUE_SIZE + 10, 'x');
+    EXPECT_TRUE(mShmem->updateValue("HGX_Chassis_0_My_Sensor_1", longValue));
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ(longValue, readValue.sensorValue);
+    EXPECT_EQ("2024-01-01T00:00:00.000+00:00", readValue.timestampStr);
+
+    EXPECT_TRUE(mShmem->updateValue("HGX_Chassis_0_My_Sensor_1", "2"));
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("2", readValue.sensorValue);
+}
+
+TEST_F(SensorMapTests, testSensorMapInternedMetricProperty)
+{
+    const std::string portBase = "/redfish/v1/Fabrics/HGX_NVLinkFabric_0/"
+                                 "Switches/NVSwitch_0/Ports/NVLink_";
+    for (int i = 0; i < 4; i++)
+    {
+        nv::shmem::SensorValue value(
+            std::to_string(i),
+            portBase + std::to_string(i) + "/Metrics#/Oem/Nvidia/RXBytes", 0,
+            "1/1/2022");
+        mShmem->insert("NVLink_" + std::to_string(i) + "_RXBytes", value);
+    }
+    nv::shmem::SensorValue sensor("1", "/redfish/v1/Chassis/HGX_GPU_0/Sensors/"
+                                       "HGX_GPU_0_Power_0",
+                                  0, "1/1/2022");
+    mShmem->insert("HGX_GPU_0_Power_0", sensor);
+
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(mShmem->getValue("NVLink_2_RXBytes", readValue));
+    EXPECT_EQ(portBase + "2/Metrics#/Oem/Nvidia/RXBytes",
+              readValue.metricProperty);
+    EXPECT_TRUE(mShmem->getValue("HGX_GPU_0_Power_0", readValue));
+    EXPECT_EQ("/redfish/v1/Chassis/HGX_GPU_0/Sensors/HGX_GPU_0_Power_0",
+              readValue.metricProperty);
+
+    // inserting an existing key with another URI repoints the entry
+    sensor.metricProperty = "/redfish/v1/Chassis/HGX_GPU_0/Sensors/Power_0";
+    mShmem->insert("HGX_GPU_0_Power_0", sensor);
+    EXPECT_TRUE(mShmem->getValue("HGX_GPU_0_Power_0", readValue));
+    EXPECT_EQ(sensor.metricProperty, readValue.metricProperty);
+    EXPECT_EQ(mShmem->size(), 5);
+}
+
+TEST_F(SensorMapTests, testSensorMapTypedReadings)
+{
+    using nv::shmem::MetricValueKind;
+    nv::shmem::SensorValue value("0", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    mShmem->insert("HGX_Chassis_0_My_Sensor_1", value);
+
+    uint64_t epochMs = 1700000000123;
+    nv::shmem::MetricValue reading{MetricValueKind::floatingPoint,
+                                   std::bit_cast<uint64_t>(12.5), {}};
+    EXPECT_TRUE(mShmem->updateMetricValue("HGX_Chassis_0_My_Sensor_1", reading,
+                                          5, epochMs));
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ(std::to_string(12.5), readValue.sensorValue);
+    EXPECT_EQ(nv::sensor_aggregation::metricUtils::getDateTimeUintMs(epochMs),
+              readValue.timestampStr);
+    EXPECT_EQ(5, readValue.timestamp);
+
+    reading = {MetricValueKind::boolean, 1, {}};
+    EXPECT_TRUE(mShmem->updateMetricValue("HGX_Chassis_0_My_Sensor_1", reading,
+                                          6, epochMs));
+    EXPECT_EQ("true",
+              mShmem->getAllKeyValuePair()["HGX_Chassis_0_My_Sensor_1"]);
+
+    reading = {MetricValueKind::durationNs, 1500000000, {}};
+    EXPECT_TRUE(mShmem->updateMetricValue("HGX_Chassis_0_My_Sensor_1", reading,
+                                          7, epochMs));
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ(nv::sensor_aggregation::metricUtils::toDurationStringFromNano(
+                  1500000000)
+                  .value_or(""),
+              readValue.sensorValue);
+
+    // string updates switch the entry back to stored text
+    EXPECT_TRUE(mShmem->updateValueAndTimeStamp("HGX_Chassis_0_My_Sensor_1",
+                                                "Enabled", 8, "1/1/2023"));
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("Enabled", readValue.sensorValue);
+    EXPECT_EQ("1/1/2023", readValue.timestampStr);
+}
+
+TEST_F(SensorMapTests, testSensorMapLookupsDoNotAllocate)
+{
+    nv::shmem::SensorValue value("1", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    mShmem->insert("HGX_Chassis_0_My_Sensor_1", value);
+    size_t freeSize = mShmem->getFreeSize();
+
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_FALSE(mShmem->getValue("HGX_Chassis_0_My_Sensor_2", readValue));
+    EXPECT_TRUE(mShmem->updateValue("HGX_Chassis_0_My_Sensor_1", "2"));
+    mShmem->erase("HGX_Chassis_0_My_Sensor_2");
+    EXPECT_EQ(mShmem->getFreeSize(), freeSize);
+
+    // readers map the segment read only, a write would fault
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("2", readValue.sensorValue);
+    EXPECT_FALSE(reader.getValue("HGX_Chassis_0_My_Sensor_2", readValue));
+    EXPECT_EQ(reader.getAllValues().size(), 1);
+    EXPECT_EQ(reader.getFreeSize(), freeSize);
+}
+
+TEST_F(SensorMapTests, testSensorMapEntryHandles)
+{
+    nv::shmem::SensorValue value("0", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    auto handle = mShmem->insert("HGX_Chassis_0_My_Sensor_1", value);
+    mShmem->insert("HGX_Chassis_0_My_Sensor_2", value);
+    nv::shmem::MetricValue reading{nv::shmem::MetricValueKind::unsignedInteger,
+                                   7, {}};
+
+    // a valid handle is used as is
+    auto original = handle;
+    EXPECT_TRUE(mShmem->updateMetricValue(handle, "HGX_Chassis_0_My_Sensor_1",
+                                          reading, 1, 0));
+    EXPECT_EQ(original, handle);
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("7", readValue.sensorValue);
+
+    // removing any object invalidates the handles, they are resolved again
+    mShmem->erase("HGX_Chassis_0_My_Sensor_2");
+    reading.raw = 8;
+    EXPECT_TRUE(mShmem->updateMetricValue(handle, "HGX_Chassis_0_My_Sensor_1",
+                                          reading, 2, 0));
+    EXPECT_NE(original, handle);
+    EXPECT_TRUE(mShmem->getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+    EXPECT_EQ("8", readValue.sensorValue);
+
+    mShmem->erase("HGX_Chassis_0_My_Sensor_1");
+    EXPECT_FALSE(mShmem->updateMetricValue(
+        handle, "HGX_Chassis_0_My_Sensor_1", reading, 3, 0));
+}
+
+TEST_F(SensorMapTests, testSensorMapEntryHandlesAcrossPublish)
+{
+    mShmem.reset();
+    Map<SensorMap, SensorValue> producer(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.publishMode = PublishMode::snapshot});
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    nv::shmem::SensorValue value("0", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    auto handle = producer.insert("HGX_Chassis_0_My_Sensor_1", value);
+    nv::shmem::SensorValue readValue;
+    for (uint64_t i = 1; i <= 4; i++)
+    {
+        producer.publish();
+        nv::shmem::MetricValue reading{
+            nv::shmem::MetricValueKind::unsignedInteger, i, {}};
+        EXPECT_TRUE(producer.updateMetricValue(
+            handle, "HGX_Chassis_0_My_Sensor_1", reading, i, 0));
+        producer.publish();
+        EXPECT_TRUE(reader.getValue("HGX_Chassis_0_My_Sensor_1", readValue));
+        EXPECT_EQ(std::to_string(i), readValue.sensorValue);
+    }
+}
+
+TEST_F(SensorMapTests, testSensorMapApplyBatch)
+{
+    using Op = nv::shmem::BatchOp<SensorValue>;
+    nv::shmem::SensorValue value("0", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    mShmem->insert("Port_0", value);
+    mShmem->insert("Port_1", value);
+
+    std::vector<Op> ops;
+    ops.push_back({Op::Type::update, "Port_0",
+                   nv::shmem::SensorValue("10", "", 1, "1/1/2023")});
+    ops.push_back({Op::Type::erase, "Port_1"});
+    ops.push_back({Op::Type::insert, "Port_2", value});
+    ops.push_back({Op::Type::update, "Port_3",
+                   nv::shmem::SensorValue("13", "", 1, "1/1/2023")});
+    EXPECT_EQ(mShmem->applyBatch(ops), 3);
+    EXPECT_TRUE(ops[0].applied);
+    EXPECT_TRUE(ops[2].applied);
+    EXPECT_FALSE(ops[3].applied);
+
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(mShmem->getValue("Port_0", readValue));
+    EXPECT_EQ("10", readValue.sensorValue);
+    EXPECT_EQ("1/1/2023", readValue.timestampStr);
+    EXPECT_FALSE(mShmem->getValue("Port_1", readValue));
+    EXPECT_TRUE(mShmem->getValue("Port_2", readValue));
+    EXPECT_EQ(mShmem->size(), 2);
+
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    EXPECT_THROW(reader.applyBatch(ops), PermissionErrorException);
+}
+
+TEST_F(SensorMapTests, testSensorMapApplyBatchIsAtomicForReaders)
+{
+    using Op = nv::shmem::BatchOp<SensorValue>;
+    nv::shmem::SensorValue value("0", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    for (int i = 0; i < 8; i++)
+    {
+        mShmem->insert("Port_" + std::to_string(i), value);
+    }
+
+    std::atomic<bool> done{false};
+    std::thread writer([this, &done]() {
+        std::vector<Op> ops(8);
+        for (int cycle = 1; cycle < 2000; cycle++)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                ops[i] = {Op::Type::update, "Port_" + std::to_string(i),
+                          nv::shmem::SensorValue(std::to_string(cycle), "",
+                                                 cycle, "1/1/2022")};
+            }
+            mShmem->applyBatch(ops);
+        }
+        done = true;
+    });
+
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    while (!done)
+    {
+        auto values = reader.getAllValues();
+        ASSERT_EQ(values.size(), 8);
+        for (const auto& v : values)
+        {
+            EXPECT_EQ(v.sensorValue, values[0].sensorValue);
+        }
+    }
+    writer.join();
+}
+
+TEST_F(SensorMapTests, testSensorMapValuesChangedSince)
+{
+    nv::shmem::SensorValue value("0", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    for (int i = 0; i < 4; i++)
+    {
+        mShmem->insert("Port_" + std::to_string(i), value);
+    }
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    nv::shmem::ChangeCursor cursor;
+    bool full = false;
+    EXPECT_EQ(reader.getValuesChangedSince(cursor, full).size(), 4);
+    EXPECT_TRUE(full);
+    EXPECT_EQ(reader.getValuesChangedSince(cursor, full).size(), 0);
+    EXPECT_FALSE(full);
+
+    // only the updated entries are returned, once
+    mShmem->updateValue("Port_1", "11");
+    mShmem->insert("Port_4", value);
+    auto changes = reader.getValuesChangedSince(cursor, full);
+    EXPECT_FALSE(full);
+    ASSERT_EQ(changes.size(), 2);
+    std::set<std::string> values{changes[0].sensorValue,
+                                 changes[1].sensorValue};
+    EXPECT_EQ(values, (std::set<std::string>{"0", "11"}));
+    EXPECT_EQ(reader.getValuesChangedSince(cursor, full).size(), 0);
+
+    // a removal cannot be expressed as a change, the reader gets all entries
+    mShmem->erase("Port_0");
+    EXPECT_EQ(reader.getValuesChangedSince(cursor, full).size(), 4);
+    EXPECT_TRUE(full);
+    EXPECT_EQ(reader.getValuesChangedSince(cursor, full).size(), 0);
+    EXPECT_FALSE(full);
+
+    // a recreated namespace restarts its history
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>("maptest", O_CREAT,
+                                                           1024 * 1000);
+    mShmem->insert("Port_0", value);
+    Map<SensorMap, SensorValue> newReader("maptest", O_RDONLY);
+    EXPECT_EQ(newReader.getValuesChangedSince(cursor, full).size(), 1);
+    EXPECT_TRUE(full);
+}
+
+TEST_F(SensorMapTests, testSensorMapValuesChangedSincePublish)
+{
+    mShmem.reset();
+    auto producer = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.publishMode = PublishMode::snapshot});
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    nv::shmem::SensorValue value("0", "/redfish/v1/HGX_Chassis_0/Sensors/", 0,
+                                 "1/1/2022");
+    producer->insert("Port_0", value);
+    producer->insert("Port_1", value);
+    producer->publish();
+
+    nv::shmem::ChangeCursor cursor;
+    bool full = false;
+    EXPECT_EQ(reader.getValuesChangedSince(cursor, full).size(), 2);
+
+    // unpublished updates are not reported, nor skipped after the publish
+    producer->updateValue("Port_1", "11");
+    EXPECT_EQ(reader.getValuesChangedSince(cursor, full).size(), 0);
+    producer->publish();
+    auto changes = reader.getValuesChangedSince(cursor, full);
+    EXPECT_FALSE(full);
+    ASSERT_EQ(changes.size(), 1);
+    EXPECT_EQ("11", changes[0].sensorValue);
+
+    // the copy to the back buffer is not a change
+    producer->publish();
+    EXPECT_EQ(reader.getValuesChangedSince(cursor, full).size(), 0);
+    EXPECT_FALSE(full);
+}
+
+TEST_F(SensorMapTests, testSensorMapVisitValues)
+{
+    mShmem->insert("Port_0",
+                   nv::shmem::SensorValue("10", "/redfish/v1/Sensors/Port_0",
+                                          1, "1/1/2022"));
+    nv::shmem::MetricValue reading{nv::shmem::MetricValueKind::unsignedInteger,
+                                   42, {}};
+    EXPECT_TRUE(mShmem->updateMetricValue("Port_0", reading, 2, 1700000000000));
+    mShmem->insert("Port_1",
+                   nv::shmem::SensorValue("text", "/redfish/v1/Sensors/Port_1",
+                                          3, "1/1/2023"));
+
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    std::map<std::string, SensorValue> visited;
+    EXPECT_EQ(reader.visitValues([&](const nv::shmem::SensorValueView& view) {
+        visited[std::string(view.key)] = SensorValue(
+            std::string(view.sensorValue), std::string(view.metricProperty),
+            view.timestamp, std::string(view.timestampStr));
+    }),
+              2);
+    ASSERT_EQ(visited.size(), 2);
+
+    // the views carry what getValue returns
+    for (const auto& [key, value] : visited)
+    {
+        SensorValue readValue;
+        EXPECT_TRUE(reader.getValue(key, readValue));
+        EXPECT_EQ(readValue.sensorValue, value.sensorValue);
+        EXPECT_EQ(readValue.metricProperty, value.metricProperty);
+        EXPECT_EQ(readValue.timestamp, value.timestamp);
+        EXPECT_EQ(readValue.timestampStr, value.timestampStr);
+    }
+    EXPECT_EQ("42", visited["Port_0"].sensorValue);
+    EXPECT_EQ("text", visited["Port_1"].sensorValue);
+
+    // the visitor runs unregistered, structural writes are not deferred
+    size_t size = 0;
+    reader.visitValues([&](const nv::shmem::SensorValueView& view) {
+        mShmem->erase(std::string(view.key));
+        size = reader.size();
+    });
+    EXPECT_EQ(size, 0);
+}
+
+TEST_F(SensorMapTests, testSensorMapValuesByPrefix)
+{
+    for (const auto* device : {"GPU_3", "GPU_30", "GPU_4"})
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            auto key = std::string("/xyz/openbmc_project/inventory/") + device +
+                       "/xyz.openbmc_project.Metric.Value_" + std::to_string(i);
+            mShmem->insert(key, nv::shmem::SensorValue(key, "", i, ""));
+        }
+    }
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    auto values =
+        reader.getValuesByPrefix("/xyz/openbmc_project/inventory/GPU_3/");
+    ASSERT_EQ(values.size(), 3);
+    for (const auto& value : values)
+    {
+        EXPECT_TRUE(value.sensorValue.starts_with(
+            "/xyz/openbmc_project/inventory/GPU_3/"));
+    }
+    EXPECT_EQ(reader.getValuesByPrefix("/xyz/openbmc_project/inventory/GPU_3")
+                  .size(),
+              6);
+    EXPECT_EQ(reader.getValuesByPrefix("").size(), 9);
+    EXPECT_EQ(reader.getValuesByPrefix("/xyz/openbmc_project/inventory/GPU_5")
+                  .size(),
+              0);
+
+    Map<SensorHashMap, SensorValue> hashMap("hashprefixtest", O_CREAT,
+                                            1024 * 1000);
+    hashMap.insert("/GPU_3/Value", nv::shmem::SensorValue("1", "", 0, ""));
+    hashMap.insert("/GPU_4/Value", nv::shmem::SensorValue("2", "", 0, ""));
+    values = hashMap.getValuesByPrefix("/GPU_4/");
+    ASSERT_EQ(values.size(), 1);
+    EXPECT_EQ("2", values[0].sensorValue);
+}
+
+TEST_F(SensorMapTests, testSensorMapMetricPropertyIndex)
+{
+    for (auto mode : {PublishMode::live, PublishMode::snapshot})
+    {
+        mShmem.reset();
+        auto producer = std::make_unique<Map<SensorMap, SensorValue>>(
+            "maptest", O_CREAT, 1024 * 1000,
+            NamespaceOptions{.publishMode = mode,
+                             .indexMetricProperty = true});
+        Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+        for (int i = 0; i < 4; i++)
+        {
+            producer->insert("Port_" + std::to_string(i),
+                             nv::shmem::SensorValue(
+                                 std::to_string(i),
+                                 "/redfish/v1/Ports/Port_" + std::to_string(i) +
+                                     "#/RXBytes",
+                                 0, "1/1/2022"));
+        }
+        // a new URI for an existing key moves its index entry
+        producer->insert("Port_3",
+                         nv::shmem::SensorValue("3", "/redfish/v1/Other/Port_3",
+                                                0, "1/1/2022"));
+        producer->erase("Port_2");
+        producer->publish();
+
+        nv::shmem::SensorValue readValue;
+        EXPECT_TRUE(reader.getValueByMetricProperty(
+            "/redfish/v1/Ports/Port_1#/RXBytes", readValue));
+        EXPECT_EQ("1", readValue.sensorValue);
+        EXPECT_FALSE(reader.getValueByMetricProperty(
+            "/redfish/v1/Ports/Port_2#/RXBytes", readValue));
+        EXPECT_FALSE(reader.getValueByMetricProperty(
+            "/redfish/v1/Ports/Port_3#/RXBytes", readValue));
+        EXPECT_TRUE(reader.getValueByMetricProperty("/redfish/v1/Other/Port_3",
+                                                    readValue));
+
+        auto values = reader.getValuesByMetricProperties(
+            {"/redfish/v1/Ports/Port_0#/RXBytes", "/redfish/v1/Missing",
+             "/redfish/v1/Other/Port_3", "/redfish/v1/Ports/Port_0#/RXBytes"});
+        ASSERT_EQ(values.size(), 2);
+        EXPECT_EQ("0", values[0].sensorValue);
+        EXPECT_EQ("3", values[1].sensorValue);
+
+        // the other buffer was brought up to date by the publish
+        producer->updateValue("Port_1", "11");
+        producer->publish();
+        EXPECT_TRUE(reader.getValueByMetricProperty(
+            "/redfish/v1/Ports/Port_1#/RXBytes", readValue));
+        EXPECT_EQ("11", readValue.sensorValue);
+        EXPECT_FALSE(reader.getValueByMetricProperty(
+            "/redfish/v1/Ports/Port_2#/RXBytes", readValue));
+
+        producer->clear();
+        producer->publish();
+        EXPECT_FALSE(reader.getValueByMetricProperty(
+            "/redfish/v1/Ports/Port_1#/RXBytes", readValue));
+    }
+}
+
+TEST_F(SensorMapTests, testSensorMapMetricPropertyLookupWithoutIndex)
+{
+    mShmem->insert("Port_0", nv::shmem::SensorValue(
+                                 "0", "/redfish/v1/Ports/Port_0", 0, ""));
+    mShmem->insert("Port_1", nv::shmem::SensorValue(
+                                 "1", "/redfish/v1/Ports/Port_1", 0, ""));
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    nv::shmem::SensorValue readValue;
+    EXPECT_TRUE(
+        reader.getValueByMetricProperty("/redfish/v1/Ports/Port_1", readValue));
+    EXPECT_EQ("1", readValue.sensorValue);
+    EXPECT_EQ(reader
+                  .getValuesByMetricProperties(
+                      {"/redfish/v1/Ports/Port_0", "/redfish/v1/Ports/Port_1",
+                       "/redfish/v1/Ports/Port_0"})
+                  .size(),
+              2);
+}
+
+struct InventoryStatus
+{
+    static constexpr uint32_t shmemLayoutVersion = 1;
+    uint32_t state;
+    double temperature;
+    char serialNumber[16];
+};
+
+TEST_F(SensorMapTests, testStructMap)
+{
+    using StatusMap = Map<StructMap<InventoryStatus>, InventoryStatus>;
+    StatusMap producer("structtest", O_CREAT, 1024 * 100);
+    producer.insert("GPU_0", InventoryStatus{1, 40.5, "1320000000001"});
+    producer.insert("GPU_1", InventoryStatus{2, 41.5, "1320000000002"});
+
+    StatusMap reader("structtest", O_RDONLY);
+    InventoryStatus status{};
+    EXPECT_TRUE(reader.getValue("GPU_1", status));
+    EXPECT_EQ(status.state, 2);
+    EXPECT_EQ(status.temperature, 41.5);
+    EXPECT_STREQ(status.serialNumber, "1320000000002");
+
+    EXPECT_TRUE(producer.update("GPU_1", InventoryStatus{3, 45.0, "x"}));
+    EXPECT_FALSE(producer.update("GPU_2", InventoryStatus{}));
+    EXPECT_TRUE(reader.getValue("GPU_1", status));
+    EXPECT_EQ(status.state, 3);
+
+    producer.erase("GPU_0");
+    auto values = reader.getAllValues();
+    ASSERT_EQ(values.size(), 1);
+    EXPECT_EQ(values[0].first, "GPU_1");
+    EXPECT_EQ(values[0].second.temperature, 45.0);
+    EXPECT_THROW(reader.insert("GPU_3", status), PermissionErrorException);
+
+    // structural writes are deferred while a reader is registered
+    LockHolder slowReader("structtest", O_RDONLY);
+    slowReader.readerSlot->activeReaders.fetch_add(1);
+    producer.insert("GPU_3", InventoryStatus{4, 30.0, "1320000000004"});
+    EXPECT_TRUE(producer.update("GPU_3", InventoryStatus{5, 31.0, "y"}));
+    EXPECT_FALSE(reader.getValue("GPU_3", status));
+    slowReader.readerSlot->activeReaders.fetch_sub(1);
+    producer.flushDeferred();
+    EXPECT_TRUE(reader.getValue("GPU_3", status));
+    EXPECT_EQ(status.state, 5);
+
+    // a reader built with another layout is refused
+    EXPECT_THROW((Map<StructMap<uint64_t>, uint64_t>("structtest", O_RDONLY)),
+                 BadMapException);
+    EXPECT_THROW((StatusMap("structsnapshot", O_CREAT, 1024 * 100,
+                            NamespaceOptions{
+                                .publishMode = PublishMode::snapshot})),
+                 BadMapException);
+}
+
+TEST_F(SensorMapTests, testStructMapWarmRestart)
+{
+    using StatusMap = Map<StructMap<InventoryStatus>, InventoryStatus>;
+    NamespaceOptions options{.warmRestart = true, .configHash = 1};
+    auto producer = std::make_unique<StatusMap>("structtest", O_CREAT,
+                                                1024 * 100, options);
+    producer->insert("GPU_0", InventoryStatus{1, 40.5, "1320000000001"});
+    producer->insert("GPU_1", InventoryStatus{2, 41.5, "1320000000002"});
+
+    // the producer dies while writing one of them
+    {
+        boost::interprocess::managed_shared_memory segment(
+            boost::interprocess::open_only, "structtest");
+        auto* map =
+            segment.find<StructMap<InventoryStatus>>("structtestmap").first;
+        ASSERT_NE(map, nullptr);
+        map->find(std::string_view("GPU_1"))->second.version.fetch_add(1);
+    }
+    producer.reset();
+    producer = std::make_unique<StatusMap>("structtest", O_CREAT, 1024 * 100,
+                                           options);
+
+    // the intact struct is kept, the half written one is dropped
+    StatusMap reader("structtest", O_RDONLY);
+    InventoryStatus status{};
+    EXPECT_TRUE(reader.getValue("GPU_0", status));
+    EXPECT_EQ(status.state, 1);
+    EXPECT_FALSE(reader.getValue("GPU_1", status));
+    EXPECT_EQ(reader.getAllValues().size(), 1);
+}
+
+TEST_F(SensorMapTests, testGorillaCodecRoundTrip)
+{
+    std::vector<std::pair<uint64_t, double>> input;
+    uint64_t timestamp = 1700000000000;
+    double value = 100.0;
+    for (int i = 0; i < 200; i++)
+    {
+        // regular ticks with jitter and gaps, steady and changing values
+        timestamp += 1000 + (i % 7 == 0 ? 3 : 0) + (i % 50 == 0 ? 90000 : 0);
+        value += (i % 3 == 0) ? 0.0 : 0.25 * i;
+        input.emplace_back(timestamp, value);
+    }
+    input.emplace_back(timestamp + 1, -0.0);
+    input.emplace_back(timestamp + 2, std::numeric_limits<double>::infinity());
+    input.emplace_back(timestamp + 2, 1e-300);
+    input.emplace_back(timestamp - 5000, 42.0);
+
+    std::vector<uint8_t> block(4096);
+    nv::shmem::GorillaState state;
+    for (const auto& [t, v] : input)
+    {
+        ASSERT_TRUE(nv::shmem::gorillaAppend(state, block, t, v));
+    }
+    // steady 1 Hz samples take a few bytes each
+    EXPECT_LT(state.bits / 8, input.size() * 6);
+
+    std::vector<std::pair<uint64_t, double>> output;
+    EXPECT_TRUE(nv::shmem::gorillaDecode(
+        block, state,
+        [&](uint64_t t, double v) { output.emplace_back(t, v); }));
+    ASSERT_EQ(output.size(), input.size());
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        EXPECT_EQ(output[i].first, input[i].first);
+        EXPECT_EQ(std::bit_cast<uint64_t>(output[i].second),
+                  std::bit_cast<uint64_t>(input[i].second));
+    }
+
+    // a sample that does not fit leaves the block unchanged
+    std::vector<uint8_t> small(20);
+    nv::shmem::GorillaState smallState;
+    EXPECT_TRUE(nv::shmem::gorillaAppend(smallState, small, 1000, 1.5));
+    EXPECT_TRUE(nv::shmem::gorillaAppend(smallState, small, 2000, 1.5));
+    EXPECT_FALSE(nv::shmem::gorillaAppend(smallState, small, 3000, 1e300));
+    EXPECT_EQ(smallState.count, 2);
+}
+
+TEST_F(SensorMapTests, testSensorMapHistory)
+{
+    using nv::shmem::MetricValueKind;
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.historySamples = 30});
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    mShmem->insert("Port_1", value);
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    EXPECT_TRUE(reader.getHistory("Port_0").empty());
+
+    uint64_t epochMs = 1700000000000;
+    for (uint64_t i = 0; i < 100; i++)
+    {
+        nv::shmem::MetricValue reading{MetricValueKind::unsignedInteger,
+                                       1000 + i * 10, {}};
+        EXPECT_TRUE(mShmem->updateMetricValue("Port_0", reading, i,
+                                              epochMs + i * 1000));
+    }
+    // text updates are not recorded
+    mShmem->updateValue("Port_1", "text");
+    EXPECT_TRUE(reader.getHistory("Port_1").empty());
+
+    auto samples = reader.getHistory("Port_0");
+    ASSERT_GE(samples.size(), 30);
+    EXPECT_LE(samples.size(), 40);
+    EXPECT_EQ(samples.back().timestampMs, epochMs + 99 * 1000);
+    EXPECT_EQ(samples.back().value, 1990.0);
+    for (size_t i = 1; i < samples.size(); i++)
+    {
+        EXPECT_EQ(samples[i].timestampMs, samples[i - 1].timestampMs + 1000);
+    }
+
+    samples = reader.getHistory("Port_0", epochMs + 97 * 1000);
+    ASSERT_EQ(samples.size(), 2);
+    EXPECT_EQ(samples[0].value, 1980.0);
+
+    mShmem->erase("Port_0");
+    EXPECT_TRUE(reader.getHistory("Port_0").empty());
+    mShmem->insert("Port_0", value);
+    EXPECT_TRUE(reader.getHistory("Port_0").empty());
+}
+
+TEST_F(SensorMapTests, testSensorMapHistorySnapshot)
+{
+    using nv::shmem::MetricAggregates;
+    using nv::shmem::MetricValueKind;
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.publishMode = nv::shmem::PublishMode::snapshot,
+                         .historySamples = 30,
+                         .aggregationWindowSeconds = 8});
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    mShmem->insert("Port_1", value);
+    uint64_t epochMs = 1700000000000;
+    for (uint64_t i = 0; i < 4; i++)
+    {
+        nv::shmem::MetricValue reading{MetricValueKind::unsignedInteger, i,
+                                       {}};
+        mShmem->updateMetricValue("Port_0", reading, i, epochMs + i * 1000);
+        mShmem->updateMetricValue("Port_1", reading, i, epochMs + i * 1000);
+    }
+    mShmem->publish();
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    MetricAggregates aggregates{};
+    EXPECT_EQ(reader.getHistory("Port_0").size(), 4);
+
+    // The published entry keeps its records until the erase is published
+    mShmem->erase("Port_0");
+    EXPECT_EQ(reader.getHistory("Port_0").size(), 4);
+    EXPECT_TRUE(reader.getAggregates("Port_0", aggregates));
+    mShmem->publish();
+    EXPECT_TRUE(reader.getHistory("Port_0").empty());
+    EXPECT_FALSE(reader.getAggregates("Port_0", aggregates));
+
+    mShmem->clear();
+    EXPECT_EQ(reader.getHistory("Port_1").size(), 4);
+    mShmem->publish();
+    EXPECT_TRUE(reader.getHistory("Port_1").empty());
+    EXPECT_FALSE(reader.getAggregates("Port_1", aggregates));
+}
+
+TEST_F(SensorMapTests, testSensorMapWindowAggregates)
+{
+    using nv::shmem::MetricAggregates;
+    using nv::shmem::MetricValueKind;
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.aggregationWindowSeconds = 8});
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    MetricAggregates aggregates{};
+    EXPECT_FALSE(reader.getAggregates("Port_0", aggregates));
+    EXPECT_FALSE(reader.getAggregates("Port_1", aggregates));
+
+    // One sample per bucket, the first 12 fall out of the window
+    uint64_t epochMs = 1700000000000;
+    for (uint64_t i = 0; i < 20; i++)
+    {
+        nv::shmem::MetricValue reading{MetricValueKind::unsignedInteger,
+                                       100 + i * 10, {}};
+        EXPECT_TRUE(mShmem->updateMetricValue("Port_0", reading, i,
+                                              epochMs + i * 1000));
+    }
+    ASSERT_TRUE(reader.getAggregates("Port_0", aggregates));
+    EXPECT_EQ(aggregates.windowMs, 8000);
+    EXPECT_EQ(aggregates.samples, 8);
+    EXPECT_EQ(aggregates.minimum, 220.0);
+    EXPECT_EQ(aggregates.maximum, 290.0);
+    EXPECT_EQ(aggregates.average, 255.0);
+    EXPECT_EQ(aggregates.ratePerSecond, 10.0);
+
+    // A decrease is a counter reset, the new value is the increase
+    nv::shmem::MetricValue reset{MetricValueKind::unsignedInteger, 5, {}};
+    EXPECT_TRUE(
+        mShmem->updateMetricValue("Port_0", reset, 20, epochMs + 20 * 1000));
+    ASSERT_TRUE(reader.getAggregates("Port_0", aggregates));
+    EXPECT_EQ(aggregates.samples, 8);
+    EXPECT_EQ(aggregates.minimum, 5.0);
+    EXPECT_EQ(aggregates.maximum, 290.0);
+    EXPECT_EQ(aggregates.ratePerSecond, 75.0 / 8);
+
+    mShmem->erase("Port_0");
+    EXPECT_FALSE(reader.getAggregates("Port_0", aggregates));
+}
+
+TEST_F(SensorMapTests, testSensorMapChangeJournal)
+{
+    using nv::shmem::ChangeKind;
+    using nv::shmem::JournalCursor;
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.journalRecords = 4});
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+
+    // A new cursor resyncs, then tails from there
+    JournalCursor cursor;
+    bool resync = false;
+    EXPECT_TRUE(reader.getChangesSince(cursor, resync).empty());
+    EXPECT_TRUE(resync);
+    EXPECT_TRUE(reader.getChangesSince(cursor, resync).empty());
+    EXPECT_FALSE(resync);
+
+    mShmem->insert("Port_1", value);
+    mShmem->updateValue("Port_0", "1");
+    mShmem->erase("Port_1");
+    auto changes = reader.getChangesSince(cursor, resync, 2);
+    EXPECT_FALSE(resync);
+    ASSERT_EQ(changes.size(), 2);
+    EXPECT_EQ(changes[0].key, "Port_1");
+    EXPECT_EQ(changes[0].kind, ChangeKind::upsert);
+    EXPECT_EQ(changes[1].key, "Port_0");
+    EXPECT_LT(changes[0].generation, changes[1].generation);
+    changes = reader.getChangesSince(cursor, resync);
+    ASSERT_EQ(changes.size(), 1);
+    EXPECT_EQ(changes[0].kind, ChangeKind::erase);
+
+    // Repointing an entry to another URI is a single change
+    value.metricProperty = "/redfish/v1/Ports/Port_0/Metrics";
+    mShmem->insert("Port_0", value);
+    changes = reader.getChangesSince(cursor, resync);
+    ASSERT_EQ(changes.size(), 1);
+    EXPECT_EQ(changes[0].key, "Port_0");
+
+    // A second reader keeps its own position
+    JournalCursor other = cursor;
+    for (int i = 0; i < 5; i++)
+    {
+        mShmem->updateValue("Port_0", to_string(i));
+    }
+    EXPECT_TRUE(reader.getChangesSince(cursor, resync).empty());
+    EXPECT_TRUE(resync);
+    EXPECT_TRUE(reader.getChangesSince(cursor, resync).empty());
+    EXPECT_FALSE(resync);
+    EXPECT_TRUE(reader.getChangesSince(other, resync).empty());
+    EXPECT_TRUE(resync);
+
+    mShmem->updateValue("Port_0", "2");
+    mShmem->clear();
+    changes = reader.getChangesSince(cursor, resync);
+    EXPECT_TRUE(resync);
+    EXPECT_TRUE(changes.empty());
+
+    // Keys of any length, such as the NVSwitch port keys, are recorded
+    std::string longKey = "/xyz/openbmc_project/inventory/system/fabrics/"
+                          "HGX_NVLinkFabric_0/Switches/NVSwitch_0/Ports/"
+                          "NVLink_0/xyz.openbmc_project.Metric.Port."
+                          "RXNoProtocolBytes" +
+                          string(100, 'x');
+    mShmem->insert(longKey, value);
+    mShmem->updateValue(longKey, "3");
+    mShmem->erase(longKey);
+    changes = reader.getChangesSince(cursor, resync);
+    EXPECT_FALSE(resync);
+    ASSERT_EQ(changes.size(), 3);
+    EXPECT_EQ(changes[0].key, longKey);
+    EXPECT_EQ(changes[1].key, longKey);
+    EXPECT_EQ(changes[1].kind, ChangeKind::upsert);
+    EXPECT_EQ(changes[2].kind, ChangeKind::erase);
+
+    // Only the keys of objects present or still in the ring are kept
+    for (int i = 0; i < 100; i++)
+    {
+        mShmem->insert("Port_" + to_string(i), value);
+        mShmem->erase("Port_" + to_string(i));
+    }
+    mShmem->insert("Port_0", value);
+    mShmem->updateValue("Port_0", "4");
+    boost::interprocess::managed_shared_memory segment(
+        boost::interprocess::open_only, "maptest");
+    auto* journal =
+        segment.find<nv::shmem::ChangeJournal>("maptestjournal").first;
+    ASSERT_NE(journal, nullptr);
+    EXPECT_LE(journal->keyCount(), 5);
+
+    // Value updates record the key held by the object
+    EXPECT_TRUE(reader.getChangesSince(cursor, resync).empty());
+    EXPECT_TRUE(resync);
+    mShmem->updateValue("Port_0", "5");
+    changes = reader.getChangesSince(cursor, resync);
+    EXPECT_FALSE(resync);
+    ASSERT_EQ(changes.size(), 1);
+    EXPECT_EQ(changes[0].key, "Port_0");
+}
+
+TEST_F(SensorMapTests, testSensorMapChangeJournalSnapshot)
+{
+    using nv::shmem::ChangeKind;
+    using nv::shmem::JournalCursor;
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.publishMode = nv::shmem::PublishMode::snapshot,
+                         .journalRecords = 16});
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    mShmem->publish();
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    JournalCursor cursor;
+    bool resync = false;
+    reader.getChangesSince(cursor, resync);
+    EXPECT_TRUE(resync);
+
+    mShmem->updateValue("Port_0", "1");
+    mShmem->updateValue("Port_0", "2");
+    mShmem->insert("Port_1", value);
+    EXPECT_TRUE(reader.getChangesSince(cursor, resync).empty());
+    EXPECT_FALSE(resync);
+
+    mShmem->erase("Port_1");
+    mShmem->publish();
+    auto changes = reader.getChangesSince(cursor, resync);
+    EXPECT_FALSE(resync);
+    std::map<string, ChangeKind> kinds;
+    for (const auto& change : changes)
+    {
+        kinds[change.key] = change.kind;
+    }
+    EXPECT_EQ(changes.size(), 2);
+    EXPECT_EQ(kinds["Port_0"], ChangeKind::upsert);
+    EXPECT_EQ(kinds["Port_1"], ChangeKind::erase);
+}
+
+TEST_F(SensorMapTests, testSensorMapWaitForChange)
+{
+    using namespace std::chrono_literals;
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    uint64_t generation = reader.visibleGeneration();
+    EXPECT_NE(reader.waitForChange(0, 1s), 0);
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(reader.waitForChange(generation, 20ms), generation);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 20ms);
+
+    // Woken by a value update from another thread
+    std::thread writer([this]() {
+        std::this_thread::sleep_for(20ms);
+        mShmem->updateValue("Port_0", "1");
+    });
+    start = std::chrono::steady_clock::now();
+    uint64_t next = reader.waitForChange(generation, 10s);
+    writer.join();
+    EXPECT_GT(next, generation);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+    SensorValue read;
+    ASSERT_TRUE(reader.getValue("Port_0", read));
+    EXPECT_EQ(read.sensorValue, "1");
+
+    // And by a structural write
+    writer = std::thread([this]() {
+        std::this_thread::sleep_for(20ms);
+        mShmem->erase("Port_0");
+    });
+    EXPECT_GT(reader.waitForChange(next, 10s), next);
+    writer.join();
+}
+
+TEST_F(SensorMapTests, testSensorMapWaitForPublish)
+{
+    using namespace std::chrono_literals;
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.publishMode = nv::shmem::PublishMode::snapshot});
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    mShmem->publish();
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    uint64_t generation = reader.visibleGeneration();
+
+    // Unpublished writes are not visible
+    mShmem->updateValue("Port_0", "1");
+    mShmem->insert("Port_1", value);
+    EXPECT_EQ(reader.waitForChange(generation, 20ms), generation);
+
+    std::thread writer([this]() {
+        std::this_thread::sleep_for(20ms);
+        mShmem->publish();
+    });
+    EXPECT_GT(reader.waitForChange(generation, 10s), generation);
+    writer.join();
+    EXPECT_EQ(reader.getAllValues().size(), 2);
+}
+
+TEST_F(SensorMapTests, testSensorMapChunkedScan)
+{
+    // Crowded hash maps shift entries on erase
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000, NamespaceOptions{.maxEntries = 320});
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    for (int i = 0; i < 300; i++)
+    {
+        value.sensorValue = "Port_" + std::to_string(i);
+        mShmem->insert(value.sensorValue, value);
+    }
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    EXPECT_EQ(reader.getAllValuesChunked(7).size(), 300);
+
+    // Objects present for the whole scan are returned once, whatever is
+    // inserted and erased between the chunks
+    std::map<string, int> seen;
+    nv::shmem::ScanCursor cursor;
+    int chunks = 0;
+    while (!cursor.done)
+    {
+        for (const auto& object : reader.getValuesChunk(cursor, 16))
+        {
+            seen[object.sensorValue]++;
+        }
+        // Erase on both sides of the cursor
+        mShmem->erase("Port_" +
+                      std::to_string(chunks % 2 ? chunks : 299 - chunks));
+        value.sensorValue = "New_" + std::to_string(chunks);
+        mShmem->insert(value.sensorValue, value);
+        chunks++;
+    }
+    EXPECT_GT(chunks, 5);
+    EXPECT_TRUE(reader.getValuesChunk(cursor, 16).empty());
+    std::set<string> erased;
+    for (int i = 0; i < chunks; i++)
+    {
+        erased.insert("Port_" + std::to_string(i % 2 ? i : 299 - i));
+    }
+    for (int i = 0; i < 300; i++)
+    {
+        string key = "Port_" + std::to_string(i);
+        if (erased.count(key) == 0)
+        {
+            EXPECT_EQ(seen.count(key), 1) << key;
+        }
+    }
+    for (const auto& [key, count] : seen)
+    {
+        EXPECT_EQ(count, 1) << key;
+    }
+}
+
+TEST_F(SensorMapTests, testNamespaceLockOwnerDeath)
+{
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    auto before = mShmem->getLockStats();
+    EXPECT_GT(before.acquisitions, 0);
+    EXPECT_EQ(before.ownerDeaths, 0);
+
+    // A reader dies holding the lock
+    pid_t child = fork();
+    ASSERT_NE(child, -1);
+    if (child == 0)
+    {
+        LockHolder holder("maptest", O_RDONLY);
+        holder.memLock->lock();
+        _exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+
+    // The producer recovers it instead of blocking
+    mShmem->insert("Port_1", value);
+    auto after = mShmem->getLockStats();
+    EXPECT_EQ(after.ownerDeaths, 1);
+    EXPECT_EQ(mShmem->size(), 2);
+
+    // And readers keep going
+    LockHolder reader("maptest", O_RDONLY);
+    EXPECT_NO_THROW(reader.TryReadLock());
+    EXPECT_EQ(reader.getLockStats().ownerDeaths, 1);
+
+    // A writer finding the lock held is counted
+    std::atomic<bool> held = false;
+    std::thread holder([&reader, &held]() {
+        auto lock = reader.TryReadLock();
+        held = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    });
+    while (!held)
+    {
+        std::this_thread::yield();
+    }
+    mShmem->insert("Port_2", value);
+    holder.join();
+    EXPECT_GT(mShmem->getLockStats().contentions, after.contentions);
+
+    // A producer dies in the middle of a structural change
+    child = fork();
+    ASSERT_NE(child, -1);
+    if (child == 0)
+    {
+        LockHolder writer("maptest", O_RDONLY);
+        writer.memLock->lock();
+        boost::interprocess::managed_shared_memory segment(
+            boost::interprocess::open_only, "maptest");
+        segment.find<ShmemHeader>("maptestheader").first->sequence.fetch_add(1);
+        _exit(0);
+    }
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+
+    // Every reader is told, not only the one recovering the lock
+    LockHolder secondReader("maptest", O_RDONLY);
+    EXPECT_THROW(reader.TryReadLock(), BadMapException);
+    EXPECT_THROW(secondReader.TryReadLock(), BadMapException);
+    EXPECT_THROW(reader.TryReadLock(), BadMapException);
+    EXPECT_EQ(secondReader.getLockStats().ownerDeaths, 2);
+
+    // Back to even, as a restarted producer would leave it
+    boost::interprocess::managed_shared_memory segment(
+        boost::interprocess::open_only, "maptest");
+    segment.find<ShmemHeader>("maptestheader").first->sequence.fetch_add(1);
+    EXPECT_NO_THROW(secondReader.TryReadLock());
+}
+
+TEST_F(SensorMapTests, testDeadReaderIsReclaimed)
+{
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    mShmem->insert("Port_1", value);
+
+    // A reader is killed while registered
+    pid_t child = fork();
+    ASSERT_NE(child, -1);
+    if (child == 0)
+    {
+        LockHolder reader("maptest", O_RDONLY);
+        reader.readerSlot->activeReaders.fetch_add(1);
+        _exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+
+    // Its registration is dropped instead of deferring every write
+    mShmem->erase("Port_0");
+    EXPECT_EQ(mShmem->size(), 1);
+    mShmem->insert("Port_2", value);
+    EXPECT_EQ(mShmem->size(), 2);
+
+    // A live reader keeps its slot and is still waited for
+    LockHolder reader("maptest", O_RDONLY);
+    reader.readerSlot->activeReaders.fetch_add(1);
+    mShmem->erase("Port_1");
+    EXPECT_EQ(mShmem->size(), 2);
+    reader.readerSlot->activeReaders.fetch_sub(1);
+    mShmem->flushDeferred();
+    EXPECT_EQ(mShmem->size(), 1);
+}
+
+TEST_F(SensorMapTests, testDeadSnapshotReaderIsReclaimed)
+{
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 1024 * 1000,
+        NamespaceOptions{.publishMode = PublishMode::snapshot});
+    nv::shmem::SensorValue value("0", "/redfish/v1/Ports/Port_0", 0, "");
+    mShmem->insert("Port_0", value);
+    mShmem->publish();
+
+    // A reader is killed while reading the front buffer
+    pid_t child = fork();
+    ASSERT_NE(child, -1);
+    if (child == 0)
+    {
+        LockHolder reader("maptest", O_RDONLY);
+        reader.readerSlot->snapshotReaders[0].fetch_add(1);
+        reader.readerSlot->snapshotReaders[1].fetch_add(1);
+        _exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+
+    // Publishing drops its registration instead of waiting forever
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    mShmem->insert("Port_1", value);
+    mShmem->publish();
+    mShmem->insert("Port_2", value);
+    mShmem->publish();
+    EXPECT_EQ(reader.getAllValues().size(), 3);
+}
+
+TEST_F(SensorMapTests, testSensorMapSharedSegment)
+{
+    NamespaceOptions options{.segment = "maptestshared",
+                             .segmentSize = 2 * 1024 * 1000};
+    auto first = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest_a", O_CREAT, 1024 * 1000, options);
+    auto second = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest_b", O_CREAT, 1024 * 1000, options);
+    first->insert("A", SensorValue("1", "/redfish/v1/Sensors/A", 0, ""));
+    second->insert("B", SensorValue("2", "/redfish/v1/Sensors/B", 0, ""));
+    // Both namespaces allocate from the free space of the one segment
+    EXPECT_EQ(first->getFreeSize(), second->getFreeSize());
+    EXPECT_GT(first->getFreeSize(), 1024 * 1000);
+
+    Map<SensorMap, SensorValue> readerA("maptest_a", O_RDONLY,
+                                        "maptestshared");
+    Map<SensorMap, SensorValue> readerB("maptest_b", O_RDONLY,
+                                        "maptestshared");
+    SensorValue value;
+    ASSERT_TRUE(readerA.getValue("A", value));
+    EXPECT_EQ(value.sensorValue, "1");
+    EXPECT_FALSE(readerA.getValue("B", value));
+    ASSERT_TRUE(readerB.getValue("B", value));
+    EXPECT_EQ(value.sensorValue, "2");
+    EXPECT_EQ(readerB.size(), 1);
+    EXPECT_THROW((Map<SensorMap, SensorValue>("maptest_c", O_RDONLY,
+                                              "maptestshared")),
+                 BadMapException);
+
+    // A restarted producer replaces the segment, clients drop the mapping
+    // they cached
+    first.reset();
+    second.reset();
+    first = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest_a", O_CREAT, 1024 * 1000, options);
+    first->insert("A", SensorValue("3", "/redfish/v1/Sensors/A", 0, ""));
+    {
+        Map<SensorMap, SensorValue> restarted("maptest_a", O_RDONLY,
+                                              "maptestshared");
+        ASSERT_TRUE(restarted.getValue("A", value));
+        EXPECT_EQ(value.sensorValue, "3");
+    }
+
+    // The segment goes away with the producer, clients stop finding it
+    first.reset();
+    for (const char* name : {"maptestshared", "maptestsharedreaders"})
+    {
+        EXPECT_THROW(boost::interprocess::shared_memory_object(
+                         boost::interprocess::open_only, name,
+                         boost::interprocess::read_only),
+                     boost::interprocess::interprocess_exception);
+    }
+    EXPECT_THROW((Map<SensorMap, SensorValue>("maptest_a", O_RDONLY,
+                                              "maptestshared")),
+                 boost::interprocess::interprocess_exception);
+}
+
+TEST_F(SensorMapTests, testSensorMapGrowSegment)
+{
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 128 * 1024,
+        NamespaceOptions{.maxSizeInBytes = 2 * 1024 * 1024});
+    // Mapped before the segment grows
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+
+    // 400KB of values do not fit in the initial segment
+    std::string payload(4096, 'x');
+    for (int i = 0; i < 100; i++)
+    {
+        mShmem->insert("Sensor_" + std::to_string(i),
+                       SensorValue(payload + std::to_string(i),
+                                   "/redfish/v1/Sensors/" + std::to_string(i),
+                                   0, ""));
+    }
+
+    EXPECT_EQ(reader.size(), 100);
+    SensorValue value;
+    ASSERT_TRUE(reader.getValue("Sensor_99", value));
+    EXPECT_EQ(value.sensorValue, payload + "99");
+    EXPECT_EQ(reader.getAllValues().size(), 100);
+
+    // Without a maximum size the segment keeps its size
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 128 * 1024);
+    EXPECT_THROW(
+        for (int i = 0; i < 100; i++) {
+            mShmem->insert("Sensor_" + std::to_string(i),
+                           SensorValue(payload, "/redfish/v1/Sensors/A", 0,
+                                       ""));
+        },
+        boost::interprocess::bad_alloc);
+}
+
+TEST_F(SensorMapTests, testSensorMapGrowSegmentWhileReading)
+{
+    mShmem.reset();
+    mShmem = std::make_unique<Map<SensorMap, SensorValue>>(
+        "maptest", O_CREAT, 128 * 1024,
+        NamespaceOptions{.publishMode = PublishMode::snapshot,
+                         .journalRecords = 512,
+                         .maxSizeInBytes = 4 * 1024 * 1024});
+    Map<SensorMap, SensorValue> reader("maptest", O_RDONLY);
+    mShmem->insert("Sensor_0", SensorValue("0", "/redfish/v1/Sensors/0", 0,
+                                           ""));
+    mShmem->publish();
+    nv::shmem::JournalCursor cursor;
+    bool resync = false;
+    reader.getChangesSince(cursor, resync);
+
+    // Threads of both processes keep reading the front buffer while the
+    // producer grows and remaps the segment underneath them
+    std::atomic<bool> done{false};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> readers;
+    for (auto* map : {mShmem.get(), &reader, &reader})
+    {
+        readers.emplace_back([map, &done, &failed]() {
+            while (!done.load())
+            {
+                SensorValue value;
+                if (!map->getValue("Sensor_0", value) ||
+                    value.sensorValue != "0")
+                {
+                    failed = true;
+                }
+            }
+        });
+    }
+    // A client tails the journal, whose keys are interned in the grown part
+    std::set<std::string> changed;
+    readers.emplace_back([&reader, &done, &failed, &changed, cursor]() mutable {
+        bool resync = false;
+        bool last = false;
+        while (!last)
+        {
+            last = done.load();
+            for (const auto& change : reader.getChangesSince(cursor, resync))
+            {
+                changed.insert(change.key);
+            }
+            failed = failed || resync;
+        }
+    });
+    std::string payload(4096, 'x');
+    for (int i = 1; i < 200; i++)
+    {
+        mShmem->insert("Sensor_" + std::to_string(i),
+                       SensorValue(payload, "/redfish/v1/Sensors/A", 0, ""));
+        if (i % 20 == 0)
+        {
+            mShmem->publish();
+        }
+    }
+    mShmem->publish();
+    done = true;
+    for (auto& thread : readers)
+    {
+        thread.join();
+    }
+
+    EXPECT_FALSE(failed.load());
+    EXPECT_EQ(reader.getAllValues().size(), 200);
+    EXPECT_EQ(changed.size(), 199);
+    EXPECT_TRUE(changed.contains("Sensor_199"));
+}
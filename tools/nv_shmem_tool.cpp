@@ -25,6 +25,8 @@
 static constexpr auto now = std::chrono::steady_clock::now;
 static const auto start = now();
 using namespace std::chrono_literals;
+using SensorMapShmem =
+    nv::shmem::Map<nv::shmem::SensorMapType, nv::shmem::SensorValue>;
 
 void trace([[maybe_unused]] const auto&... msg)
 {
@@ -38,7 +40,8 @@ int main(int argc, char* argv[])
     if (argc < 3)
     {
         std::cerr << "Usage: " << argv[0]
-                  << " [read|erase|perf|create|stat|readraw] [namespace]"
+                  << " [read|erase|perf|create|stat|readraw] [namespace] "
+                     "[shared segment]"
                   << std::endl;
         return 1; // Return an error code
     }
@@ -46,10 +49,10 @@ int main(int argc, char* argv[])
     try
     {
         auto name_space = argv[2];
+        std::string segment = (argc > 3) ? argv[3] : "";
         if (std::string(argv[1]) == "read")
         {
-            nv::shmem::Map<nv::shmem::SensorMap, nv::shmem::SensorValue> mShmem(
-                name_space, O_RDONLY);
+            SensorMapShmem mShmem(name_space, O_RDONLY, segment);
             trace(name_space, "Shmem Created (read-only).");
             auto freeSize = mShmem.getFreeSize();
             trace(name_space, "Shmem FreeSize: ", freeSize, " Bytes");
@@ -62,8 +65,7 @@ int main(int argc, char* argv[])
         }
         else if (std::string(argv[1]) == "readraw")
         {
-            nv::shmem::Map<nv::shmem::SensorMap, nv::shmem::SensorValue> mShmem(
-                name_space, O_RDONLY);
+            SensorMapShmem mShmem(name_space, O_RDONLY, segment);
             trace(name_space, "Shmem Created (read-only).");
             auto freeSize = mShmem.getFreeSize();
             trace(name_space, "Shmem FreeSize: ", freeSize, " Bytes");
@@ -75,17 +77,16 @@ int main(int argc, char* argv[])
         }
         else if (std::string(argv[1]) == "erase")
         {
-            nv::shmem::Map<nv::shmem::SensorMap, nv::shmem::SensorValue> mShmem(
-                name_space, O_CREAT, 1024 * 1000);
+            SensorMapShmem mShmem(name_space, O_CREAT, 1024 * 1000);
             trace(name_space, "Shmem Created.");
             mShmem.clear();
             trace(name_space, "Shmem Erase done.");
         }
         else if (std::string(argv[1]) == "stat")
         {
-            nv::shmem::Map<nv::shmem::SensorMap, nv::shmem::SensorValue> mShmem(
-                name_space, O_RDONLY);
+            SensorMapShmem mShmem(name_space, O_RDONLY, segment);
             trace(name_space, "Shmem Created (read-only).");
+            uint64_t generation = mShmem.visibleGeneration();
             while (1)
             {
                 auto values = mShmem.getAllValues();
@@ -94,13 +95,15 @@ int main(int argc, char* argv[])
                     trace("Sensor ", e.metricProperty, " : ", e.timestampStr,
                           " : ", e.timestamp, " : ", e.sensorValue);
                 }
-                usleep(1000000);
+                // Dump again once the producer changed something
+                uint64_t last = generation;
+                while ((generation = mShmem.waitForChange(last, 1s)) == last)
+                {}
             }
         }
         else if (std::string(argv[1]) == "perf")
         {
-            nv::shmem::Map<nv::shmem::SensorMap, nv::shmem::SensorValue> mShmem(
-                name_space, O_CREAT, 1024 * 1000);
+            SensorMapShmem mShmem(name_space, O_CREAT, 1024 * 1000);
             trace(name_space, "Shmem Created.");
 
             for (int i = 0; i < 5000; i++)
@@ -142,8 +145,7 @@ int main(int argc, char* argv[])
         }
         else if (std::string(argv[1]) == "create")
         {
-            nv::shmem::Map<nv::shmem::SensorMap, nv::shmem::SensorValue> mShmem(
-                name_space, O_CREAT, 1024 * 1000);
+            SensorMapShmem mShmem(name_space, O_CREAT, 1024 * 1000);
             trace(name_space, "Shmem Created.");
             for (int i = 0; i < 1000; i++)
             {